@@ -0,0 +1,109 @@
+/*
+ * Derived fields
+ *
+ * Values Home Assistant users would otherwise compute in templates, kept as
+ * ordinary fields so they are versioned, formatted and published like the
+ * decoded ones. Each declares the fields it is computed from; at commit only
+ * those whose inputs changed are recomputed (the others just inherit the
+ * receive time of their inputs, for staleness).
+ */
+
+#include "apc_hid_derived.h"
+
+typedef bool (*derive_fn_t)(const ups_metrics_t *m, int32_t *value);
+
+typedef struct {
+    apc_field_t field;
+    apc_field_mask_t inputs;
+    derive_fn_t compute;
+} derived_field_t;
+
+#define IN(field) APC_FIELD_BIT(APC_FIELD_##field)
+
+// Percentage of a rating, rounded to the nearest unit
+static int32_t percent_of(int32_t percent, int32_t rating)
+{
+    return (int32_t)(((int64_t)percent * rating + 50) / 100);
+}
+
+static bool derive_output_power(const ups_metrics_t *m, int32_t *value)
+{
+    if (m->value[APC_FIELD_NOMINAL_POWER] <= 0) {
+        return false;
+    }
+    *value = percent_of(m->value[APC_FIELD_LOAD_PERCENT], m->value[APC_FIELD_NOMINAL_POWER]);
+    return true;
+}
+
+static bool derive_output_apparent_power(const ups_metrics_t *m, int32_t *value)
+{
+    if (m->value[APC_FIELD_NOMINAL_APPARENT_POWER] <= 0) {
+        return false;
+    }
+    *value = percent_of(m->value[APC_FIELD_LOAD_PERCENT], m->value[APC_FIELD_NOMINAL_APPARENT_POWER]);
+    return true;
+}
+
+static bool derive_power_headroom(const ups_metrics_t *m, int32_t *value)
+{
+    *value = m->value[APC_FIELD_NOMINAL_POWER] - m->value[APC_FIELD_OUTPUT_POWER];
+    return true;
+}
+
+// Dependency order: a field only reads fields listed above it
+static const derived_field_t derived_fields[] = {
+    { APC_FIELD_OUTPUT_POWER,          IN(LOAD_PERCENT) | IN(NOMINAL_POWER),          derive_output_power },
+    { APC_FIELD_OUTPUT_APPARENT_POWER, IN(LOAD_PERCENT) | IN(NOMINAL_APPARENT_POWER), derive_output_apparent_power },
+    { APC_FIELD_POWER_HEADROOM,        IN(NOMINAL_POWER) | IN(OUTPUT_POWER),          derive_power_headroom },
+};
+
+#define NUM_DERIVED_FIELDS (sizeof(derived_fields) / sizeof(derived_fields[0]))
+
+apc_field_mask_t apc_hid_field_inputs(apc_field_t field)
+{
+    for (size_t i = 0; i < NUM_DERIVED_FIELDS; i++) {
+        if (derived_fields[i].field == field) {
+            return derived_fields[i].inputs;
+        }
+    }
+    return 0;
+}
+
+apc_field_mask_t apc_hid_derive(ups_metrics_t *metrics, int64_t field_time_us[APC_FIELD_COUNT],
+                                apc_field_mask_t dirty)
+{
+    apc_field_mask_t changed = 0;
+
+    for (size_t i = 0; i < NUM_DERIVED_FIELDS; i++) {
+        const derived_field_t *d = &derived_fields[i];
+        apc_field_mask_t bit = APC_FIELD_BIT(d->field);
+        if ((metrics->present & d->inputs) != d->inputs) {
+            continue;
+        }
+
+        // As fresh as its oldest input, even when no input changed
+        int64_t time_us = 0;
+        for (int f = 0; f < APC_FIELD_COUNT; f++) {
+            if ((d->inputs & APC_FIELD_BIT(f)) && (time_us == 0 || field_time_us[f] < time_us)) {
+                time_us = field_time_us[f];
+            }
+        }
+        if (metrics->present & bit) {
+            field_time_us[d->field] = time_us;
+        }
+
+        int32_t value;
+        if (!(dirty & d->inputs) || !d->compute(metrics, &value)) {
+            continue;
+        }
+        field_time_us[d->field] = time_us;
+
+        if (!(metrics->present & bit) || metrics->value[d->field] != value) {
+            metrics->value[d->field] = value;
+            metrics->present |= bit;
+            changed |= bit;
+            dirty |= bit;
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,13 @@
+#ifndef APC_HID_DERIVED_H
+#define APC_HID_DERIVED_H
+
+#include "apc_hid_parser.h"
+
+// Recompute the derived fields whose inputs are in `dirty` (in dependency
+// order, so derived inputs are up to date first), stamping each with the
+// oldest receive time of its inputs in `field_time_us`. Returns the derived
+// fields that changed or became available.
+apc_field_mask_t apc_hid_derive(ups_metrics_t *metrics, int64_t field_time_us[APC_FIELD_COUNT],
+                                apc_field_mask_t dirty);
+
+#endif // APC_HID_DERIVED_H
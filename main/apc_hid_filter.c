@@ -0,0 +1,171 @@
+/*
+ * Glitch filter
+ *
+ * Some UPS firmware occasionally answers a feature report with junk, e.g.
+ * 0 V input or 0 Hz, which would otherwise reach Home Assistant and fire
+ * automations. Each decoded sample passes through up to three stages
+ * before it is stored:
+ *
+ *   median   -> the median of the last N samples (N <= 5) replaces it;
+ *               a single outlier never gets through, a real change is
+ *               delayed by N / 2 samples. Until the window holds N
+ *               samples (after creation or reconfiguration) samples are
+ *               held, so one in the first N - 1 can't slip through
+ *   max_step -> a jump larger than max_step from the stored value is held
+ *               until `confirm` consecutive samples agree on the new level
+ *   confirm  -> an enum code other than the stored one must repeat
+ *               `confirm` times in a row
+ *
+ * A held or replaced sample is counted per stage and per field.
+ */
+
+#include "apc_hid_filter.h"
+#include "sdkconfig.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    apc_field_t field;
+    apc_hid_filter_config_t config;
+} filter_default_t;
+
+static const filter_default_t filter_defaults[] = {
+#if CONFIG_APC_HID_GLITCH_FILTER
+    { APC_FIELD_INPUT_VOLTAGE,     { .median = 3 } },
+    { APC_FIELD_INPUT_FREQUENCY,   { .median = 3 } },
+    { APC_FIELD_OUTPUT_VOLTAGE,    { .median = 3 } },
+    { APC_FIELD_BATTERY_VOLTAGE,   { .median = 3 } },
+    { APC_FIELD_BATTERY_CHARGE,    { .max_step = 20, .confirm = 2 } },
+    { APC_FIELD_INPUT_SENSITIVITY, { .confirm = 2 } },
+    { APC_FIELD_BEEPER_STATUS,     { .confirm = 2 } },
+    { APC_FIELD_SELF_TEST_RESULT,  { .confirm = 2 } },
+#endif
+    { APC_FIELD_NONE,              { 0 } },
+};
+
+void apc_hid_filter_reset(apc_hid_filter_t *filter)
+{
+    memset(filter, 0, sizeof(*filter));
+    for (const filter_default_t *d = filter_defaults; d->field != APC_FIELD_NONE; d++) {
+        apc_hid_filter_configure(filter, d->field, &d->config);
+    }
+}
+
+void apc_hid_filter_configure(apc_hid_filter_t *filter, apc_field_t field, const apc_hid_filter_config_t *config)
+{
+    if (field <= APC_FIELD_NONE || field >= APC_FIELD_COUNT || field == APC_FIELD_STATUS) {
+        return;
+    }
+    apc_hid_filter_config_t *c = &filter->config[field];
+    memset(c, 0, sizeof(*c));
+    if (config != NULL) {
+        *c = *config;
+        if (c->median > APC_FILTER_MAX_MEDIAN) {
+            c->median = APC_FILTER_MAX_MEDIAN;
+        }
+        if (c->median != 0 && (c->median & 1) == 0) {
+            c->median--;
+        }
+    }
+    memset(&filter->state[field], 0, sizeof(filter->state[field]));
+}
+
+static void window_push(const apc_hid_filter_config_t *c, apc_hid_filter_state_t *s, int32_t value)
+{
+    s->window[s->head] = value;
+    s->head = (s->head + 1) % c->median;
+    if (s->count < c->median) {
+        s->count++;
+    }
+}
+
+static int32_t window_median(const apc_hid_filter_state_t *s)
+{
+    int32_t sorted[APC_FILTER_MAX_MEDIAN];
+    int n = s->count;
+    for (int i = 0; i < n; i++) {
+        int32_t v = s->window[i];
+        int j = i;
+        for (; j > 0 && sorted[j - 1] > v; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = v;
+    }
+    return sorted[n / 2];
+}
+
+// Counts consecutive samples agreeing on one level; true once `confirm` have
+static bool confirmed(apc_hid_filter_state_t *s, int32_t value, int32_t tolerance, uint8_t confirm)
+{
+    if (s->pending_count > 0 && abs(value - s->pending) <= tolerance) {
+        s->pending_count++;
+    } else {
+        s->pending = value;
+        s->pending_count = 1;
+    }
+    if (s->pending_count >= confirm) {
+        s->pending_count = 0;
+        return true;
+    }
+    return false;
+}
+
+apc_filter_result_t apc_hid_filter_apply(apc_hid_filter_t *filter, apc_field_t field, int32_t *value,
+                                         int32_t stored, bool have_stored)
+{
+    const apc_hid_filter_config_t *c = &filter->config[field];
+    apc_hid_filter_state_t *s = &filter->state[field];
+    apc_filter_result_t result = APC_FILTER_PASS;
+
+    if (c->median > 1) {
+        window_push(c, s, *value);
+        if (s->count < c->median) {
+            return APC_FILTER_HELD;
+        }
+        int32_t median = window_median(s);
+        if (median != *value) {
+            *value = median;
+            result = APC_FILTER_REPLACED;
+            filter->stats.smoothed++;
+            filter->stats.field[field]++;
+        }
+    }
+
+    if (!have_stored || *value == stored) {
+        s->pending_count = 0;
+        return result;
+    }
+
+    bool held = false;
+    if (c->max_step > 0 && abs(*value - stored) > c->max_step) {
+        held = !confirmed(s, *value, c->max_step, c->confirm);
+        if (held) {
+            filter->stats.step_held++;
+        }
+    } else if (c->max_step == 0 && c->confirm > 1) {
+        held = !confirmed(s, *value, 0, c->confirm);
+        if (held) {
+            filter->stats.enum_held++;
+        }
+    } else {
+        s->pending_count = 0;
+    }
+
+    if (held) {
+        if (result == APC_FILTER_PASS) {
+            filter->stats.field[field]++;
+        }
+        return APC_FILTER_HELD;
+    }
+    return result;
+}
+
+void apc_hid_filter_repeat(apc_hid_filter_t *filter, apc_field_t field, int32_t stored)
+{
+    const apc_hid_filter_config_t *c = &filter->config[field];
+    apc_hid_filter_state_t *s = &filter->state[field];
+    if (c->median > 1) {
+        window_push(c, s, stored);
+    }
+    s->pending_count = 0;
+}
@@ -0,0 +1,41 @@
+#ifndef APC_HID_FILTER_H
+#define APC_HID_FILTER_H
+
+#include "apc_hid_parser.h"
+
+typedef struct {
+    int32_t window[APC_FILTER_MAX_MEDIAN];
+    uint8_t count;               // Samples in the window
+    uint8_t head;
+    uint8_t pending_count;       // Consecutive samples agreeing on `pending`
+    int32_t pending;
+} apc_hid_filter_state_t;
+
+typedef struct {
+    apc_hid_filter_config_t config[APC_FIELD_COUNT];
+    apc_hid_filter_state_t state[APC_FIELD_COUNT];
+    apc_hid_filter_stats_t stats;
+} apc_hid_filter_t;
+
+typedef enum {
+    APC_FILTER_PASS = 0,         // Store the sample as decoded
+    APC_FILTER_REPLACED,         // Store *value, which the filter replaced
+    APC_FILTER_HELD,             // Keep the stored value
+} apc_filter_result_t;
+
+// Load the default configuration and clear all state
+void apc_hid_filter_reset(apc_hid_filter_t *filter);
+
+void apc_hid_filter_configure(apc_hid_filter_t *filter, apc_field_t field, const apc_hid_filter_config_t *config);
+
+// Run one decoded sample of `field` through its stages. `stored` is the
+// value in the metrics (`have_stored` false before the first one). Constant
+// time: at most APC_FILTER_MAX_MEDIAN samples are sorted.
+apc_filter_result_t apc_hid_filter_apply(apc_hid_filter_t *filter, apc_field_t field, int32_t *value,
+                                         int32_t stored, bool have_stored);
+
+// A cached report repeated the stored value of `field` without a decode;
+// counts it as a sample so the median window keeps up
+void apc_hid_filter_repeat(apc_hid_filter_t *filter, apc_field_t field, int32_t stored);
+
+#endif // APC_HID_FILTER_H
@@ -1,28 +1,138 @@
 #include "apc_hid_parser.h"
+#include "apc_hid_usage.h"
+#include "apc_hid_trace.h"
+#include "apc_hid_stats.h"
+#include "apc_hid_derived.h"
+#include "apc_hid_filter.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 static const char *TAG = "apc_hid_parser";
-static ups_metrics_t current_metrics = {0};
 
-void apc_hid_parser_init(void)
+// Dedupe cache entry: last raw bytes of one report ID
+#define REPORT_CACHE_BYTES 16
+
+typedef struct {
+    uint8_t length;
+    uint8_t data[REPORT_CACHE_BYTES];
+    apc_field_mask_t fields;                     // Fields these bytes decode into
+} report_cache_entry_t;
+
+struct apc_hid_parser {
+    ups_metrics_t current;                       // Working copy, written only by the owning task
+
+    // Readers never see `current` directly: every update is copied into
+    // `published` under a sequence lock (odd = copy in progress), so the
+    // writer never blocks and readers retry until they get a consistent copy.
+    ups_metrics_t published;
+    uint32_t published_seq;
+    uint32_t published_version;
+
+    // Fields changed in `current` since the last published version
+    apc_field_mask_t dirty;
+
+    // While a batch is open, decoded reports stay in `current` and are
+    // published together at commit
+    bool batch_open;
+    bool batch_updated;
+    apc_field_mask_t batch_received;             // Fields decoded or confirmed by the batch
+
+    const apc_hid_profile_t *profile;
+    apc_hid_usage_table_t usage_table;
+
+    // Feature reports to poll: the profile's list, limited to IDs the table decodes
+    uint8_t poll_list[APC_HID_MAX_USAGES];
+    int poll_count;
+
+    // Dedupe cache, see REPORT CACHE below
+    report_cache_entry_t report_cache[APC_HID_MAX_USAGES];
+    uint8_t report_cache_slot[256];              // APC_HID_NO_USAGE if the ID has no entry
+    uint8_t report_cache_count;
+    apc_hid_cache_stats_t cache_stats;
+
+    // esp_timer time each field was last received, published as ages
+    // (ups_metrics_t.field_age_ms)
+    int64_t field_time_us[APC_FIELD_COUNT];
+
+    // Rolling statistics, fed at each commit and summarized on request.
+    // Updates run under their own sequence lock, like `published`.
+    apc_hid_stats_t stats;
+    uint32_t stats_seq;
+
+    // Glitch filter between decode and store; a report with a held or
+    // replaced sample drops its cached bytes, so its repeats still reach the
+    // filter
+    apc_hid_filter_t filter;
+    bool filter_active;                          // Set by store_value during a decode
+
+    apc_hid_sample_cb_t sample_cb;
+    void *sample_ctx;
+    apc_hid_sample_cb_t raw_sample_cb;
+    void *raw_sample_ctx;
+};
+
+static void publish_snapshot(apc_hid_parser_t *p)
 {
-    memset(&current_metrics, 0, sizeof(ups_metrics_t));
-    current_metrics.valid = false;
+    if (p->dirty != 0) {
+        uint32_t version = ++p->current.version;
+        for (int f = 0; f < APC_FIELD_COUNT; f++) {
+            if (p->dirty & APC_FIELD_BIT(f)) {
+                p->current.field_version[f] = version;
+            }
+        }
+        p->dirty = 0;
+    }
+
+    // Receive times as ages at the update time: 32 bits a field instead of 64
+    for (int f = 0; f < APC_FIELD_COUNT; f++) {
+        int64_t time_us = p->field_time_us[f];
+        uint32_t age_ms = APC_FIELD_AGE_NEVER;
+        if (time_us != 0) {
+            int64_t age = (p->current.update_time_us - time_us) / 1000;
+            age_ms = (age <= 0) ? 0 : (age >= APC_FIELD_AGE_NEVER) ? APC_FIELD_AGE_NEVER - 1 : (uint32_t)age;
+        }
+        p->current.field_age_ms[f] = age_ms;
+    }
+
+    uint32_t seq = p->published_seq;
+    __atomic_store_n(&p->published_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&p->published, &p->current, sizeof(p->published));
+    __atomic_store_n(&p->published_seq, seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&p->published_version, p->current.version, __ATOMIC_RELEASE);
+}
+
+apc_hid_parser_t* apc_hid_parser_create(void)
+{
+    apc_hid_parser_t *p = calloc(1, sizeof(apc_hid_parser_t));
+    if (p == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate parser (%u bytes)", (unsigned)sizeof(apc_hid_parser_t));
+        return NULL;
+    }
 
     // Set default values
-    strcpy(current_metrics.driver_name, "esp32-usb-hid");
-    strcpy(current_metrics.driver_version, "1.0.0");
-    strcpy(current_metrics.driver_state, "running");
-    strcpy(current_metrics.battery_type, "PbAc");
-    strcpy(current_metrics.power_failure_status, "OK");
+    p->current.value[APC_FIELD_BATTERY_TYPE] = 1;   // PbAc
+    p->current.present = APC_FIELD_BIT(APC_FIELD_BATTERY_TYPE);
+    apc_hid_filter_reset(&p->filter);
+
+    apc_hid_parser_select_profile(p, apc_hid_default_profile());
+    publish_snapshot(p);
 
     ESP_LOGI(TAG, "🔋 APC HID parser initialized");
+    return p;
+}
+
+void apc_hid_parser_destroy(apc_hid_parser_t *p)
+{
+    free(p);
 }
 
+#if CONFIG_APC_HID_TRACE_LEVEL >= APC_HID_TRACE_VERBOSE
 // Helper function to print hex dump
 static void log_hex_dump(const char *prefix, const uint8_t *data, size_t length)
 {
@@ -31,526 +141,802 @@ static void log_hex_dump(const char *prefix, const uint8_t *data, size_t length)
     int hex_pos = 0;
     int ascii_pos = 0;
 
-    for (size_t i = 0; i < length && hex_pos < sizeof(hex_str) - 4; i++) {
+    for (size_t i = 0; i < length && hex_pos < (int)sizeof(hex_str) - 4 && ascii_pos < (int)sizeof(ascii_str) - 1; i++) {
         hex_pos += snprintf(hex_str + hex_pos, sizeof(hex_str) - hex_pos, "%02X ", data[i]);
         ascii_str[ascii_pos++] = (data[i] >= 32 && data[i] <= 126) ? data[i] : '.';
     }
     ascii_str[ascii_pos] = '\0';
 
-    ESP_LOGI(TAG, "%s [%d bytes]: %s | %s", prefix, length, hex_str, ascii_str);
+    ESP_LOGI(TAG, "%s [%u bytes]: %s | %s", prefix, (unsigned)length, hex_str, ascii_str);
 }
+#endif
+
+//══════════════════════════════════════════════════════════════════════════════
+// FIELD DECODERS
+//══════════════════════════════════════════════════════════════════════════════
+
+// Common values: 1=PbAc (Lead Acid), 2=Li-ion, 3=NiCd, 4=NiMH
+// NOTE: APC typically uses PbAc but this UPS reports code 4 (NiMH)
+// Mapping might be vendor-specific. Reporting as-is.
+static const char *const chemistry_names[] = {"Unknown", "PbAc", "Li-ion", "NiCd", "NiMH"};
+static const char *const beeper_names[] = {"disabled", "enabled", "muted"};
+static const char *const sensitivity_names[] = {"low", "medium", "high"};
+static const char *const self_test_names[] = {
+    "No test initiated",
+    "Test passed",
+    "Test in progress",
+    "General test failed",
+    "Battery failed",
+    "Deep battery test failed",
+    "Test aborted"
+};
+static const char *const transfer_reason_names[] = {
+    "No transfer",
+    "High line voltage",
+    "Brownout",
+    "Blackout",
+    "Small momentary sag",
+    "Deep momentary sag",
+    "Small momentary spike",
+    "Large momentary spike",
+    "Self test",
+    "Input frequency out of range",
+    "Input voltage out of range"
+};
+
+#define NUMBER(name, unit, decimals) { name, unit, APC_KIND_NUMBER, decimals, 0, NULL }
+#define ENUM(name, table)            { name, NULL, APC_KIND_ENUM, 0, sizeof(table) / sizeof(table[0]), table }
+#define OTHER(name, kind)            { name, NULL, kind, 0, 0, NULL }
+
+static const apc_field_info_t field_info[APC_FIELD_COUNT] = {
+    [APC_FIELD_NONE]                          = OTHER("none", APC_KIND_NUMBER),
+    [APC_FIELD_BATTERY_CHARGE]                = NUMBER("battery_charge", "%", 0),
+    [APC_FIELD_BATTERY_VOLTAGE]               = NUMBER("battery_voltage", "V", 2),
+    [APC_FIELD_BATTERY_RUNTIME]               = NUMBER("battery_runtime", "s", 0),
+    [APC_FIELD_BATTERY_NOMINAL_VOLTAGE]       = NUMBER("battery_nominal_voltage", "V", 1),
+    [APC_FIELD_BATTERY_WARNING_THRESHOLD]     = NUMBER("battery_warning_threshold", "%", 0),
+    [APC_FIELD_BATTERY_TYPE]                  = ENUM("battery_type", chemistry_names),
+    [APC_FIELD_BATTERY_MFR_DATE]              = OTHER("battery_mfr_date", APC_KIND_DATE),
+    [APC_FIELD_INPUT_VOLTAGE]                 = NUMBER("input_voltage", "V", 1),
+    [APC_FIELD_INPUT_VOLTAGE_NOMINAL]         = NUMBER("input_voltage_nominal", "V", 0),
+    [APC_FIELD_INPUT_FREQUENCY]               = NUMBER("input_frequency", "Hz", 1),
+    [APC_FIELD_OUTPUT_VOLTAGE]                = NUMBER("output_voltage", "V", 1),
+    [APC_FIELD_LOAD_PERCENT]                  = NUMBER("load_percent", "%", 0),
+    [APC_FIELD_NOMINAL_POWER]                 = NUMBER("nominal_power", "W", 0),
+    [APC_FIELD_HIGH_VOLTAGE_TRANSFER]         = NUMBER("high_voltage_transfer", "V", 0),
+    [APC_FIELD_LOW_VOLTAGE_TRANSFER]          = NUMBER("low_voltage_transfer", "V", 0),
+    [APC_FIELD_INPUT_SENSITIVITY]             = ENUM("input_sensitivity", sensitivity_names),
+    [APC_FIELD_LAST_TRANSFER_REASON]          = ENUM("last_transfer_reason", transfer_reason_names),
+    [APC_FIELD_LOW_BATTERY_CHARGE_THRESHOLD]  = NUMBER("low_battery_charge_threshold", "%", 0),
+    [APC_FIELD_LOW_BATTERY_RUNTIME_THRESHOLD] = NUMBER("low_battery_runtime_threshold", "s", 0),
+    [APC_FIELD_SHUTDOWN_TIMER]                = NUMBER("shutdown_timer", "s", 0),
+    [APC_FIELD_REBOOT_TIMER]                  = NUMBER("reboot_timer", "s", 0),
+    [APC_FIELD_DELAY_BEFORE_REBOOT]           = NUMBER("delay_before_reboot", "s", 0),
+    [APC_FIELD_DELAY_BEFORE_SHUTDOWN]         = NUMBER("delay_before_shutdown", "s", 0),
+    [APC_FIELD_FIRMWARE_VERSION]              = OTHER("firmware_version", APC_KIND_VERSION),
+    [APC_FIELD_BEEPER_STATUS]                 = ENUM("beeper_status", beeper_names),
+    [APC_FIELD_SELF_TEST_RESULT]              = ENUM("self_test_result", self_test_names),
+    [APC_FIELD_STATUS]                        = OTHER("status", APC_KIND_STATUS),
+    [APC_FIELD_NOMINAL_APPARENT_POWER]        = NUMBER("nominal_apparent_power", "VA", 0),
+    [APC_FIELD_OUTPUT_POWER]                  = NUMBER("output_power", "W", 0),
+    [APC_FIELD_OUTPUT_APPARENT_POWER]         = NUMBER("output_apparent_power", "VA", 0),
+    [APC_FIELD_POWER_HEADROOM]                = NUMBER("power_headroom", "W", 0),
+};
+
+#undef NUMBER
+#undef ENUM
+#undef OTHER
+
+static const int32_t pow10_table[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+// raw * 10^exponent in integers, rounded to nearest
+static int32_t scale_fixed(int32_t raw, int exponent)
+{
+    if (exponent >= 0) {
+        int64_t v = (int64_t)raw * pow10_table[exponent > 9 ? 9 : exponent];
+        return (v > INT32_MAX) ? INT32_MAX : (v < INT32_MIN) ? INT32_MIN : (int32_t)v;
+    }
+    int32_t d = pow10_table[-exponent > 9 ? 9 : -exponent];
+    return (raw >= 0) ? (raw + d / 2) / d : -((-raw + d / 2) / d);
+}
+
+typedef enum {
+    DECODE_REJECTED = 0,
+    DECODE_UNCHANGED,
+    DECODE_CHANGED,
+} decode_result_t;
 
-bool apc_hid_parse_report(uint8_t report_id, const uint8_t *data, size_t length, ups_metrics_t *metrics)
+typedef decode_result_t (*field_decoder_t)(apc_hid_parser_t *p, const apc_hid_usage_t *u, int32_t raw);
+
+static decode_result_t store_value(apc_hid_parser_t *p, uint8_t field, int32_t value)
 {
-    if (data == NULL || length == 0) {
+    ups_metrics_t *m = &p->current;
+    if (p->raw_sample_cb != NULL) {
+        p->raw_sample_cb((apc_field_t)field, value, p->raw_sample_ctx);
+    }
+    apc_filter_result_t filtered = apc_hid_filter_apply(&p->filter, (apc_field_t)field, &value, m->value[field],
+                                                        (m->present & APC_FIELD_BIT(field)) != 0);
+    if (filtered != APC_FILTER_PASS) {
+        p->filter_active = true;
+        APC_HID_TRACE_V(TAG, "   │  filtered: %s %ld", filtered == APC_FILTER_HELD ? "held, keeping" : "stored as",
+                        (long)(filtered == APC_FILTER_HELD ? m->value[field] : value));
+        if (filtered == APC_FILTER_HELD) {
+            // Nothing stored yet (median window still filling): not decoded
+            return (m->present & APC_FIELD_BIT(field)) ? DECODE_UNCHANGED : DECODE_REJECTED;
+        }
+    }
+    if (m->value[field] == value) {
+        return DECODE_UNCHANGED;
+    }
+    m->value[field] = value;
+    return DECODE_CHANGED;
+}
+
+// Scale to the field's fixed-point representation
+static decode_result_t decode_number(apc_hid_parser_t *p, const apc_hid_usage_t *u, int32_t raw)
+{
+    int32_t value = scale_fixed(raw, u->unit_exponent + field_info[u->field].decimals);
+    APC_HID_TRACE_V(TAG, "   ├─ %s = %ld e-%d (raw %ld, exp %d)", field_info[u->field].name,
+                    (long)value, field_info[u->field].decimals, (long)raw, u->unit_exponent);
+    return store_value(p, u->field, value);
+}
+
+static decode_result_t decode_enum(apc_hid_parser_t *p, const apc_hid_usage_t *u, int32_t raw)
+{
+    const apc_field_info_t *info = &field_info[u->field];
+    if (raw < 0 || raw >= info->num_names) {
+        APC_HID_TRACE_V(TAG, "   ├─ %s: unknown code %ld", info->name, (long)raw);
+        return DECODE_REJECTED;
+    }
+    APC_HID_TRACE_V(TAG, "   ├─ %s = %s (code %ld)", info->name, info->names[raw], (long)raw);
+    return store_value(p, u->field, raw);
+}
+
+// Dates and versions are kept raw and only unpacked when formatted
+static decode_result_t decode_raw(apc_hid_parser_t *p, const apc_hid_usage_t *u, int32_t raw)
+{
+    APC_HID_TRACE_V(TAG, "   ├─ %s = 0x%04lX", field_info[u->field].name, (unsigned long)raw);
+    return store_value(p, u->field, raw);
+}
+
+static decode_result_t decode_status_bit(apc_hid_parser_t *p, const apc_hid_usage_t *u, int32_t raw)
+{
+    ups_metrics_t *m = &p->current;
+    if (u->arg > APC_STATUS_TRIM) {
+        return DECODE_REJECTED;
+    }
+    uint8_t status = (raw != 0) ? (m->status | APC_STATUS_BIT(u->arg)) : (m->status & ~APC_STATUS_BIT(u->arg));
+    if (status == m->status) {
+        return DECODE_UNCHANGED;
+    }
+    m->status = status;
+    return DECODE_CHANGED;
+}
+
+static const field_decoder_t kind_decoders[] = {
+    [APC_KIND_NUMBER]  = decode_number,
+    [APC_KIND_ENUM]    = decode_enum,
+    [APC_KIND_DATE]    = decode_raw,
+    [APC_KIND_VERSION] = decode_raw,
+    [APC_KIND_STATUS]  = decode_status_bit,
+};
+
+const char* apc_hid_field_name(apc_field_t field)
+{
+    return (field < APC_FIELD_COUNT && field_info[field].name) ? field_info[field].name : "unknown";
+}
+
+const apc_field_info_t* apc_hid_field_info(apc_field_t field)
+{
+    return (field < APC_FIELD_COUNT) ? &field_info[field] : NULL;
+}
+
+// Extract a little-endian bit field from the report payload
+static bool extract_raw(const uint8_t *payload, size_t payload_len, const apc_hid_usage_t *u, int32_t *out)
+{
+    uint32_t end = (uint32_t)u->bit_offset + u->bit_size;
+    if (u->bit_size == 0 || u->bit_size > 32 || end > payload_len * 8) {
         return false;
     }
 
-    // Log raw HID report
-    ESP_LOGI(TAG, "═══════════════════════════════════════════");
-    ESP_LOGI(TAG, "📦 RAW HID REPORT");
-    ESP_LOGI(TAG, "   Report ID: 0x%02X (%d)", report_id, report_id);
-    log_hex_dump("   Data", data, length);
+    size_t first = u->bit_offset / 8;
+    size_t last = (end - 1) / 8;
+    uint64_t acc = 0;
+    for (size_t i = last + 1; i-- > first;) {
+        acc = (acc << 8) | payload[i];
+    }
+    acc >>= (u->bit_offset % 8);
 
-    // Use current_metrics if metrics pointer is NULL
-    ups_metrics_t *target = (metrics != NULL) ? metrics : &current_metrics;
-    bool updated = false;
-
-    ESP_LOGI(TAG, "🔍 PARSING LOGIC:");
-    switch (report_id) {
-        case 0x0C:  // Battery charge and runtime (UPS.PowerSummary)
-            ESP_LOGI(TAG, "   Type: Battery Charge & Runtime (UPS.PowerSummary)");
-            if (length >= 4) {
-                target->battery_charge = (float)data[1];
-                uint16_t runtime_seconds = data[2] | (data[3] << 8);
-                target->battery_runtime = (float)runtime_seconds;
-
-                ESP_LOGI(TAG, "   ├─ Byte[1]: Battery charge = %d%%", data[1]);
-                ESP_LOGI(TAG, "   ├─ Byte[2-3]: Runtime = %d seconds (%.1f min)", runtime_seconds, runtime_seconds / 60.0f);
-                ESP_LOGI(TAG, "   └─ Result: Battery %.0f%%, Runtime %.0fs",
-                         target->battery_charge, target->battery_runtime);
-                updated = true;
-            }
-            break;
-
-        case 0x06:  // Status flags
-            ESP_LOGI(TAG, "   Type: Status Flags");
-            if (length >= 4) {
-                uint8_t status_byte = data[3];
-                target->status.online = (status_byte & 0x08) != 0;
-                target->status.discharging = (status_byte & 0x01) != 0;
-                target->status.charging = (status_byte & 0x02) != 0;
-                target->status.low_battery = (status_byte & 0x04) != 0;
-
-                ESP_LOGI(TAG, "   └─ Status byte 0x%02X: %s", status_byte,
-                         target->status.online ? "ONLINE" : "ON_BATTERY");
-                updated = true;
-            }
-            break;
-
-        case 0x08:  // Battery nominal voltage (UPS.PowerSummary.ConfigVoltage)
-            ESP_LOGI(TAG, "   Type: Battery Nominal Voltage");
-            if (length >= 3) {
-                // 16-bit value with Exponent = -2, so divide by 100
-                // Raw data example: 08 B0 04 = 0x04B0 = 1200 / 100 = 12V
-                uint16_t voltage_raw = data[1] | (data[2] << 8);
-                target->battery_nominal_voltage = (float)voltage_raw / 100.0f;
-                ESP_LOGI(TAG, "   └─ Raw: 0x%04X → %.1fV", voltage_raw, target->battery_nominal_voltage);
-                updated = true;
-            }
-            break;
-
-        case 0x09:  // Battery voltage (UPS.PowerSummary.Voltage) - Feature Report
-            ESP_LOGI(TAG, "   Type: Battery Voltage");
-            if (length >= 3) {
-                // From NUT: 16-bit value, Exponent = -2, so divide by 100
-                uint16_t voltage_raw = data[1] | (data[2] << 8);
-                target->battery_voltage = (float)voltage_raw / 100.0f;
-                ESP_LOGI(TAG, "   └─ Raw: 0x%04X → %.2fV", voltage_raw, target->battery_voltage);
-                updated = true;
-            }
-            break;
-
-        case 0x0B:  // Battery nominal voltage
-            ESP_LOGI(TAG, "   Type: Battery Nominal Voltage");
-            if (length >= 2) {
-                target->battery_nominal_voltage = (float)data[1];
-                ESP_LOGI(TAG, "   └─ Nominal: %.0fV", target->battery_nominal_voltage);
-                updated = true;
-            }
-            break;
-
-        case 0x0D:  // Battery voltage
-            ESP_LOGI(TAG, "   Type: Battery Voltage");
-            if (length >= 2) {
-                target->battery_voltage = (float)data[1] / 10.0f;
-                ESP_LOGI(TAG, "   └─ Battery: %.1fV", target->battery_voltage);
-                updated = true;
-            }
-            break;
-
-        case 0x0E:  // Full charge capacity (NOT low battery threshold!)
-            ESP_LOGI(TAG, "   Type: Full Charge Capacity");
-            if (length >= 2) {
-                // This is FullChargeCapacity = 100%, not the low battery threshold
-                // Don't store this as low_battery_charge_threshold
-                ESP_LOGI(TAG, "   └─ Full Capacity: %.0f%% (not low threshold)", (float)data[1]);
-                // Do NOT set updated = true, we don't want to store this
-            }
-            break;
-
-        case 0x0F:  // Battery warning threshold
-            ESP_LOGI(TAG, "   Type: Battery Warning Threshold");
-            if (length >= 2) {
-                target->battery_warning_threshold = (float)data[1];
-                ESP_LOGI(TAG, "   └─ Threshold: %.0f%%", target->battery_warning_threshold);
-                updated = true;
-            }
-            break;
-
-        case 0x10:  // Beeper status
-            ESP_LOGI(TAG, "   Type: Beeper Status");
-            if (length >= 2) {
-                const char *beeper_state[] = {"disabled", "enabled", "muted"};
-                uint8_t beeper_val = data[1];
-                if (beeper_val < 3) {
-                    strncpy(target->beeper_status, beeper_state[beeper_val], sizeof(target->beeper_status) - 1);
-                    ESP_LOGI(TAG, "   └─ Beeper: %s", target->beeper_status);
-                    updated = true;
-                }
-            }
-            break;
-
-        case 0x11:  // Battery low charge threshold (UPS.PowerSummary.RemainingCapacityLimit)
-            ESP_LOGI(TAG, "   Type: Battery Low Charge Threshold");
-            if (length >= 2) {
-                target->low_battery_charge_threshold = (float)data[1];
-                ESP_LOGI(TAG, "   └─ Threshold: %.0f%%", target->low_battery_charge_threshold);
-                updated = true;
-            }
-            break;
-
-        case 0x12:  // Low battery runtime threshold
-            ESP_LOGI(TAG, "   Type: Low Battery Runtime Threshold");
-            if (length >= 3) {
-                uint16_t runtime = data[1] | (data[2] << 8);
-                target->low_battery_runtime_threshold = (float)runtime;
-                ESP_LOGI(TAG, "   └─ Threshold: %.0fs", target->low_battery_runtime_threshold);
-                updated = true;
-            }
-            break;
-
-        case 0x15:  // Shutdown timer
-            ESP_LOGI(TAG, "   Type: Shutdown Timer");
-            if (length >= 3) {
-                int16_t timer = (int16_t)(data[1] | (data[2] << 8));
-                target->shutdown_timer = (float)timer;
-                ESP_LOGI(TAG, "   └─ Timer: %.0fs", target->shutdown_timer);
-                updated = true;
-            }
-            break;
-
-        case 0x16:  // Status bits (PresentStatus)
-            ESP_LOGI(TAG, "   Type: Present Status Bits");
-            if (length >= 2) {
-                uint8_t present_status = data[1];
-                target->status.online = (present_status & 0x01) != 0;
-                target->status.discharging = (present_status & 0x02) != 0;
-                target->status.charging = (present_status & 0x04) != 0;
-                target->status.low_battery = (present_status & 0x08) != 0;
-                target->status.overload = (present_status & 0x10) != 0;
-                target->status.replace_battery = (present_status & 0x20) != 0;
-                target->status.boost = (present_status & 0x40) != 0;
-                target->status.trim = (present_status & 0x80) != 0;
-
-                ESP_LOGI(TAG, "   └─ Status: 0x%02X [%s%s%s%s%s%s%s%s]", present_status,
-                         target->status.online ? "OL " : "",
-                         target->status.discharging ? "DISCHRG " : "",
-                         target->status.charging ? "CHRG " : "",
-                         target->status.low_battery ? "LB " : "",
-                         target->status.overload ? "OVER " : "",
-                         target->status.replace_battery ? "RB " : "",
-                         target->status.boost ? "BOOST " : "",
-                         target->status.trim ? "TRIM" : "");
-                updated = true;
-            }
-            break;
-
-        case 0x17:  // Reboot timer
-            ESP_LOGI(TAG, "   Type: Reboot Timer");
-            if (length >= 3) {
-                uint16_t timer = data[1] | (data[2] << 8);
-                target->reboot_timer = (float)timer;
-                ESP_LOGI(TAG, "   └─ Timer: %.0fs", target->reboot_timer);
-                updated = true;
-            }
-            break;
-
-        case 0x18:  // Self-test result
-            ESP_LOGI(TAG, "   Type: Self-Test Result");
-            if (length >= 2) {
-                const char *test_results[] = {
-                    "No test initiated",
-                    "Test passed",
-                    "Test in progress",
-                    "General test failed",
-                    "Battery failed",
-                    "Deep battery test failed",
-                    "Test aborted"
-                };
-                uint8_t test_val = data[1];
-                if (test_val < 7) {
-                    strncpy(target->self_test_result, test_results[test_val], sizeof(target->self_test_result) - 1);
-                    ESP_LOGI(TAG, "   └─ Result: %s", target->self_test_result);
-                    updated = true;
-                }
-            }
-            break;
-
-        case 0x1C:  // Battery manufacture date
-            ESP_LOGI(TAG, "   Type: Battery Manufacture Date");
-            if (length >= 4) {
-                // Date stored as 3 bytes: Year (2 bytes), Month, Day
-                uint16_t year = data[1] | (data[2] << 8);
-                uint8_t month = (length > 3) ? data[3] : 1;
-                uint8_t day = (length > 4) ? data[4] : 1;
-                snprintf(target->battery_mfr_date, sizeof(target->battery_mfr_date),
-                         "%04d/%02d/%02d", year, month, day);
-                ESP_LOGI(TAG, "   └─ Date: %s", target->battery_mfr_date);
-                updated = true;
-            }
-            break;
-
-        case 0x20:  // Battery manufacture date (UPS.Battery.ManufacturerDate)
-            ESP_LOGI(TAG, "   Type: Battery Manufacture Date");
-            if (length >= 3) {
-                // 16-bit value = days since reference date (likely 1970-01-01)
-                // Example: 21690 days ≈ 59 years from 1970 = year 2029
-                uint16_t days = data[1] | (data[2] << 8);
-                snprintf(target->battery_mfr_date, sizeof(target->battery_mfr_date),
-                         "%d days", days);
-                ESP_LOGI(TAG, "   └─ Date: %d days since reference (raw data)", days);
-                updated = true;
-            }
-            break;
-
-        case 0x13:  // Delay before reboot (APCDelayBeforeReboot)
-            ESP_LOGI(TAG, "   Type: Delay Before Reboot");
-            if (length >= 2) {
-                target->delay_before_reboot = (float)data[1];
-                ESP_LOGI(TAG, "   └─ Delay: %.0f seconds", target->delay_before_reboot);
-                updated = true;
-            }
-            break;
-
-        case 0x14:  // Delay before shutdown (APCDelayBeforeShutdown)
-            ESP_LOGI(TAG, "   Type: Delay Before Shutdown");
-            if (length >= 2) {
-                target->delay_before_shutdown = (float)data[1];
-                ESP_LOGI(TAG, "   └─ Delay: %.0f seconds", target->delay_before_shutdown);
-                updated = true;
-            }
-            break;
-
-        case 0x24:  // Battery runtime low threshold (UPS.Battery.RemainingTimeLimit)
-            ESP_LOGI(TAG, "   Type: Battery Runtime Low Threshold");
-            if (length >= 3) {
-                uint16_t runtime = data[1] | (data[2] << 8);
-                target->low_battery_runtime_threshold = (float)runtime;
-                ESP_LOGI(TAG, "   └─ Threshold: %d seconds (%.1f min)", runtime, (float)runtime / 60.0f);
-                updated = true;
-            }
-            break;
-
-        case 0x21:  // Last transfer reason
-            ESP_LOGI(TAG, "   Type: Last Transfer Reason");
-            if (length >= 2) {
-                const char *reasons[] = {
-                    "No transfer",
-                    "High line voltage",
-                    "Brownout",
-                    "Blackout",
-                    "Small momentary sag",
-                    "Deep momentary sag",
-                    "Small momentary spike",
-                    "Large momentary spike",
-                    "Self test",
-                    "Input frequency out of range",
-                    "Input voltage out of range"
-                };
-                uint8_t reason = data[1];
-                if (reason < 11) {
-                    strncpy(target->last_transfer_reason, reasons[reason], sizeof(target->last_transfer_reason) - 1);
-                    ESP_LOGI(TAG, "   └─ Reason code %d: %s", reason, target->last_transfer_reason);
-                    updated = true;
-                } else {
-                    ESP_LOGI(TAG, "   └─ Unknown reason code: %d", reason);
-                }
-            }
-            break;
-
-        case 0x25:  // Nominal power
-            ESP_LOGI(TAG, "   Type: Nominal Power");
-            if (length >= 3) {
-                uint16_t power = data[1] | (data[2] << 8);
-                target->nominal_power = (float)power;
-                ESP_LOGI(TAG, "   └─ Power: %.0fW", target->nominal_power);
-                updated = true;
-            }
-            break;
-
-        case 0x30:  // Input nominal voltage (UPS.Input.ConfigVoltage) - Feature Report
-            ESP_LOGI(TAG, "   Type: Input Nominal Voltage");
-            if (length >= 2) {
-                target->input_voltage_nominal = (float)data[1];
-                ESP_LOGI(TAG, "   └─ Nominal: %.0fV", target->input_voltage_nominal);
-                updated = true;
-            }
-            break;
-
-        case 0x31:  // Input voltage (UPS.Input.Voltage) - Feature Report
-            ESP_LOGI(TAG, "   Type: Input Voltage");
-            if (length >= 3) {
-                uint16_t voltage_raw = data[1] | (data[2] << 8);
-                target->input_voltage = (float)voltage_raw;
-                ESP_LOGI(TAG, "   └─ Raw: 0x%04X → %.0fV", voltage_raw, target->input_voltage);
-                updated = true;
-            }
-            break;
-
-        case 0x32:  // Low voltage transfer (UPS.Input.LowVoltageTransfer) - Feature Report
-            ESP_LOGI(TAG, "   Type: Low Voltage Transfer");
-            if (length >= 3) {
-                uint16_t voltage_raw = data[1] | (data[2] << 8);
-                target->low_voltage_transfer = (float)voltage_raw;
-                ESP_LOGI(TAG, "   └─ Transfer point: %.0fV", target->low_voltage_transfer);
-                updated = true;
-            }
-            break;
-
-        case 0x33:  // High voltage transfer (UPS.Input.HighVoltageTransfer) - Feature Report
-            ESP_LOGI(TAG, "   Type: High Voltage Transfer");
-            if (length >= 3) {
-                uint16_t voltage_raw = data[1] | (data[2] << 8);
-                target->high_voltage_transfer = (float)voltage_raw;
-                ESP_LOGI(TAG, "   └─ Transfer point: %.0fV", target->high_voltage_transfer);
-                updated = true;
-            }
-            break;
-
-        case 0x50:  // Load percentage (UPS.PowerConverter.PercentLoad) - Feature Report
-            ESP_LOGI(TAG, "   Type: Load Percentage");
-            if (length >= 2) {
-                target->load_percent = (float)data[1];
-                ESP_LOGI(TAG, "   └─ Load: %.0f%%", target->load_percent);
-                updated = true;
-            }
-            break;
-
-        case 0x35:  // Input sensitivity
-            ESP_LOGI(TAG, "   Type: Input Sensitivity");
-            if (length >= 2) {
-                const char *sensitivity[] = {"low", "medium", "high"};
-                uint8_t sens_val = data[1];
-                if (sens_val < 3) {
-                    strncpy(target->input_sensitivity, sensitivity[sens_val], sizeof(target->input_sensitivity) - 1);
-                    ESP_LOGI(TAG, "   └─ Sensitivity: %s", target->input_sensitivity);
-                    updated = true;
-                }
-            }
-            break;
-
-        case 0x36:  // Input frequency (UPS.Input.Frequency) - Feature Report
-            ESP_LOGI(TAG, "   Type: Input Frequency");
-            if (length >= 2) {
-                // Frequency is typically 50 or 60 Hz
-                // NOTE: This UPS reports 0 Hz - frequency might not be available
-                // or encoded differently. Only update if non-zero.
-                if (data[1] > 0) {
-                    target->input_frequency = (float)data[1];
-                    ESP_LOGI(TAG, "   └─ Frequency: %.0fHz", target->input_frequency);
-                    updated = true;
-                } else {
-                    ESP_LOGI(TAG, "   └─ Frequency: Not available (0 Hz reported)");
-                }
-            }
-            break;
-
-        case 0x03:  // Battery chemistry/type (UPS.PowerSummary.iDeviceChemistry)
-            ESP_LOGI(TAG, "   Type: Battery Chemistry");
-            if (length >= 2) {
-                // Common values: 1=PbAc (Lead Acid), 2=Li-ion, 3=NiCd, 4=NiMH
-                // NOTE: APC typically uses PbAc but this UPS reports code 4 (NiMH)
-                // Mapping might be vendor-specific. Reporting as-is.
-                const char *chemistry[] = {"Unknown", "PbAc", "Li-ion", "NiCd", "NiMH"};
-                uint8_t chem_val = data[1];
-                if (chem_val < 5) {
-                    strncpy(target->battery_type, chemistry[chem_val], sizeof(target->battery_type) - 1);
-                    ESP_LOGI(TAG, "   └─ Chemistry code: %d → %s", chem_val, target->battery_type);
-                    updated = true;
-                } else {
-                    ESP_LOGW(TAG, "   └─ Unknown chemistry code: %d", chem_val);
-                }
-            }
-            break;
-
-        case 0x07:  // UPS manufacture date (or unknown field)
-            ESP_LOGI(TAG, "   Type: UPS Manufacture Date");
-            // NOTE: This report returns only 3 bytes: 07 D6 54
-            // Interpreting as date gives nonsensical year 21718
-            // Likely this is NOT a date field or uses different encoding
-            // Same data as Report 0x20 - both appear to be unidentified fields
-            if (length >= 3) {
-                ESP_LOGI(TAG, "   └─ Raw data: 0x%02X%02X%02X (unimplemented)",
-                         data[1], data[2], (length > 2) ? data[3] : 0);
-                ESP_LOGW(TAG, "   └─ Date parsing not implemented (insufficient data or wrong field)");
-            }
-            break;
+    uint32_t value = (u->bit_size == 32) ? (uint32_t)acc : (uint32_t)(acc & ((1ULL << u->bit_size) - 1));
+    if (u->logical_min < 0 && u->bit_size < 32 && (value & (1u << (u->bit_size - 1)))) {
+        value |= ~((1u << u->bit_size) - 1);   // Sign-extend
+    }
+    *out = (int32_t)value;
 
-        case 0x34:  // Input sensitivity adjustment (writable setting)
-            ESP_LOGI(TAG, "   Type: Input Sensitivity Adjustment");
-            if (length >= 2) {
-                ESP_LOGI(TAG, "   └─ Adjustment value: %d", data[1]);
-                updated = true;
-            }
-            break;
-
-        case 0x52:  // Nominal real power (UPS.PowerSummary.ConfigActivePower)
-            ESP_LOGI(TAG, "   Type: Nominal Real Power");
-            if (length >= 3) {
-                uint16_t power = data[1] | (data[2] << 8);
-                target->nominal_power = (float)power;
-                ESP_LOGI(TAG, "   └─ Real Power: %.0fW", target->nominal_power);
-                updated = true;
-            }
-            break;
-
-        case 0x60:  // Firmware version (part of string)
-            ESP_LOGI(TAG, "   Type: Firmware Version");
-            if (length >= 2) {
-                // Firmware version is often split across multiple reports or encoded
-                snprintf(target->firmware_version, sizeof(target->firmware_version), "%d.%d", data[1], data[2]);
-                ESP_LOGI(TAG, "   └─ Version: %s", target->firmware_version);
-                updated = true;
+    if (u->logical_min <= u->logical_max && (*out < u->logical_min || *out > u->logical_max)) {
+        return false;   // Out of logical range means "no data"
+    }
+    return true;
+}
+
+//══════════════════════════════════════════════════════════════════════════════
+// REPORT CACHE
+//══════════════════════════════════════════════════════════════════════════════
+// Last raw bytes of every report ID decoded into the live metrics. Most
+// reports repeat byte for byte between polls; an identical one only refreshes
+// the time stamps of its fields and skips decoding, tracing and change tracking.
+
+static void report_cache_reset(apc_hid_parser_t *p)
+{
+    memset(p->report_cache_slot, APC_HID_NO_USAGE, sizeof(p->report_cache_slot));
+    p->report_cache_count = 0;
+}
+
+static report_cache_entry_t* report_cache_lookup(apc_hid_parser_t *p, uint8_t report_id, const uint8_t *data, size_t length)
+{
+    uint8_t slot = p->report_cache_slot[report_id];
+    if (slot == APC_HID_NO_USAGE) {
+        return NULL;
+    }
+    report_cache_entry_t *e = &p->report_cache[slot];
+    if (e->length != length || memcmp(e->data, data, length) != 0) {
+        return NULL;
+    }
+    return e;
+}
+
+// The ID's last bytes no longer match what is stored: no hit until it is
+// decoded and cached again
+static void report_cache_forget(apc_hid_parser_t *p, uint8_t report_id)
+{
+    uint8_t slot = p->report_cache_slot[report_id];
+    if (slot != APC_HID_NO_USAGE) {
+        p->report_cache[slot].length = 0;
+    }
+}
+
+static void report_cache_store(apc_hid_parser_t *p, uint8_t report_id, const uint8_t *data, size_t length, apc_field_mask_t fields)
+{
+    if (length > REPORT_CACHE_BYTES) {
+        report_cache_forget(p, report_id);
+        return;
+    }
+    uint8_t slot = p->report_cache_slot[report_id];
+    if (slot == APC_HID_NO_USAGE) {
+        if (p->report_cache_count >= APC_HID_MAX_USAGES) {
+            return;
+        }
+        slot = p->report_cache_count++;
+        p->report_cache_slot[report_id] = slot;
+    }
+    report_cache_entry_t *e = &p->report_cache[slot];
+    e->length = length;
+    memcpy(e->data, data, length);
+    e->fields = fields;
+}
+
+void apc_hid_get_cache_stats(const apc_hid_parser_t *p, apc_hid_cache_stats_t *stats)
+{
+    *stats = p->cache_stats;
+}
+
+void apc_hid_parser_set_filter(apc_hid_parser_t *p, apc_field_t field, const apc_hid_filter_config_t *config)
+{
+    apc_hid_filter_configure(&p->filter, field, config);
+}
+
+void apc_hid_get_filter_stats(const apc_hid_parser_t *p, apc_hid_filter_stats_t *stats)
+{
+    *stats = p->filter.stats;
+}
+
+//══════════════════════════════════════════════════════════════════════════════
+// USAGE TABLE MANAGEMENT
+//══════════════════════════════════════════════════════════════════════════════
+
+static void log_usage_table(const apc_hid_parser_t *p, const char *source)
+{
+    const apc_hid_usage_table_t *t = &p->usage_table;
+    ESP_LOGI(TAG, "📋 Usage table (%s): %d usages, polling %d reports", source, t->count, p->poll_count);
+    for (int i = 0; i < t->count; i++) {
+        const apc_hid_usage_t *u = &t->usages[i];
+        ESP_LOGI(TAG, "   0x%02X %s bit %u+%u → %s%s exp %d [%ld..%ld]",
+                 u->report_id, u->report_type == APC_HID_REPORT_INPUT ? "IN  " : "FEAT",
+                 u->bit_offset, u->bit_size, field_info[u->field].name,
+                 u->field == APC_FIELD_STATUS ? "*" : "", u->unit_exponent,
+                 (long)u->logical_min, (long)u->logical_max);
+    }
+}
+
+static void build_poll_list(apc_hid_parser_t *p)
+{
+    p->poll_count = 0;
+
+    if (p->profile->poll_reports != NULL) {
+        for (int i = 0; i < p->profile->num_poll_reports; i++) {
+            uint8_t id = p->profile->poll_reports[i];
+            if (p->usage_table.num[id] > 0 && p->poll_count < APC_HID_MAX_USAGES) {
+                p->poll_list[p->poll_count++] = id;
             }
-            break;
+        }
+        return;
+    }
 
-        default:
-            ESP_LOGI(TAG, "   Type: ❓ UNKNOWN Report ID (0x%02X)", report_id);
-            ESP_LOGI(TAG, "   └─ This report ID is not yet handled");
-            break;
+    // No verified list: poll every Feature report the table can decode
+    for (int i = 0; i < p->usage_table.count; i++) {
+        const apc_hid_usage_t *u = &p->usage_table.usages[i];
+        if (u->report_type == APC_HID_REPORT_FEATURE &&
+            (p->poll_count == 0 || p->poll_list[p->poll_count - 1] != u->report_id)) {
+            p->poll_list[p->poll_count++] = u->report_id;
+        }
     }
+}
 
-    if (updated) {
-        target->last_update_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
-        target->valid = true;
+void apc_hid_parser_select_profile(apc_hid_parser_t *p, const apc_hid_profile_t *profile)
+{
+    p->profile = (profile != NULL) ? profile : apc_hid_default_profile();
+    ESP_LOGI(TAG, "🏷️ Decoder profile: %s (PID %04X)", p->profile->name, p->profile->pid);
+    apc_hid_parser_use_default_table(p);
+}
 
-        // Update status string
-        apc_hid_format_status(&target->status, target->status_string,
-                             sizeof(target->status_string));
+const apc_hid_profile_t* apc_hid_parser_get_profile(const apc_hid_parser_t *p)
+{
+    return p->profile;
+}
 
-        ESP_LOGI(TAG, "✅ METRICS UPDATED");
-        ESP_LOGI(TAG, "   Status: %s", target->status_string);
-        ESP_LOGI(TAG, "═══════════════════════════════════════════");
+void apc_hid_parser_use_default_table(apc_hid_parser_t *p)
+{
+    if (p->profile->num_usages == 0) {
+        ESP_LOGW(TAG, "⚠️ %s has no built-in layout; nothing is decoded without its report descriptor",
+                 p->profile->name);
+    }
+    apc_hid_usage_table_clear(&p->usage_table);
+    for (int i = 0; i < p->profile->num_usages; i++) {
+        apc_hid_usage_table_add(&p->usage_table, &p->profile->usages[i]);
+    }
+    apc_hid_usage_table_index(&p->usage_table);
+    build_poll_list(p);
+    report_cache_reset(p);
+}
+
+bool apc_hid_parser_load_descriptor(apc_hid_parser_t *p, const uint8_t *desc, size_t length)
+{
+    apc_hid_usage_table_t *compiled = malloc(sizeof(apc_hid_usage_table_t));
+    if (compiled == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate usage table");
+        return false;
+    }
 
-        // If we updated current_metrics, copy to output if provided
-        if (target == &current_metrics && metrics != NULL) {
-            memcpy(metrics, &current_metrics, sizeof(ups_metrics_t));
+    int count = apc_hid_usage_compile(desc, length, compiled);
+    if (count <= 0) {
+        ESP_LOGW(TAG, "⚠️ Report descriptor unusable (%d usages), keeping built-in table", count);
+        free(compiled);
+        return false;
+    }
+
+    // Vendor-page values (sensitivity, transfer reason, APC delays) have no
+    // standard usage, so fill any field the descriptor didn't provide from
+    // the profile's built-in layout, but only where the descriptor declares
+    // that report and leaves those bits unmapped.
+    int filled = 0;
+    for (int i = 0; i < p->profile->num_usages; i++) {
+        const apc_hid_usage_t *u = &p->profile->usages[i];
+        if (!apc_hid_usage_table_has_field(compiled, (apc_field_t)u->field, u->arg) &&
+            apc_hid_usage_table_fits(compiled, u)) {
+            apc_hid_usage_table_add(compiled, u);
+            filled++;
+        }
+    }
+    ESP_LOGI(TAG, "Filled %d usages from the %s layout", filled, p->profile->name);
+    apc_hid_usage_table_index(compiled);
+
+    memcpy(&p->usage_table, compiled, sizeof(p->usage_table));
+    free(compiled);
+    build_poll_list(p);
+    report_cache_reset(p);
+    log_usage_table(p, "descriptor");
+    return true;
+}
+
+const apc_hid_usage_table_t* apc_hid_parser_get_table(const apc_hid_parser_t *p)
+{
+    return &p->usage_table;
+}
+
+int apc_hid_parser_get_poll_list(const apc_hid_parser_t *p, const uint8_t **report_ids)
+{
+    *report_ids = p->poll_list;
+    return p->poll_count;
+}
+
+int apc_hid_parser_poll_report_for(const apc_hid_parser_t *p, apc_field_t field)
+{
+    const apc_hid_usage_table_t *t = &p->usage_table;
+    for (int i = 0; i < p->poll_count; i++) {
+        uint8_t report_id = p->poll_list[i];
+        if (t->first[report_id] == APC_HID_NO_USAGE) {
+            continue;
+        }
+        for (int u = t->first[report_id]; u < t->first[report_id] + t->num[report_id]; u++) {
+            if (t->usages[u].field == field) {
+                return report_id;
+            }
         }
+    }
+    return -1;
+}
+
+//══════════════════════════════════════════════════════════════════════════════
+// REPORT DECODING
+//══════════════════════════════════════════════════════════════════════════════
+
+// Decode one report into the working metrics, without publishing. Returns true if any
+// usage decoded.
+static apc_field_mask_t decode_report(apc_hid_parser_t *p, uint8_t report_id, const uint8_t *data, size_t length, int64_t now_us)
+{
+    ups_metrics_t *target = &p->current;
+    APC_HID_TRACE_V(TAG, "═══════════════════════════════════════════");
+    APC_HID_TRACE_V(TAG, "📦 RAW HID REPORT");
+    APC_HID_TRACE_V(TAG, "   Report ID: 0x%02X (%d)", report_id, report_id);
+#if CONFIG_APC_HID_TRACE_LEVEL >= APC_HID_TRACE_VERBOSE
+    log_hex_dump("   Data", data, length);
+#endif
+    apc_hid_trace_begin(report_id, data, length);
+
+    apc_field_mask_t decoded = 0;
+
+    // Walk the usages declared for this report ID
+    const uint8_t *payload = data + 1;
+    size_t payload_len = length - 1;
+    uint8_t first = p->usage_table.first[report_id];
+    uint8_t num = p->usage_table.num[report_id];
+
+    APC_HID_TRACE_V(TAG, "🔍 DECODING %d USAGES:", num);
+    for (uint8_t i = 0; first != APC_HID_NO_USAGE && i < num; i++) {
+        const apc_hid_usage_t *u = &p->usage_table.usages[first + i];
+        int32_t raw;
+        if (!extract_raw(payload, payload_len, u, &raw)) {
+            continue;
+        }
+        if (u->field == APC_FIELD_NONE || u->field >= APC_FIELD_COUNT) {
+            continue;
+        }
+        decode_result_t result = kind_decoders[field_info[u->field].kind](p, u, raw);
+        if (result == DECODE_REJECTED) {
+            continue;
+        }
+        apc_hid_trace_field(u->field, u->arg, raw);
+        decoded |= APC_FIELD_BIT(u->field);
+        p->field_time_us[u->field] = now_us;
+        if (!(target->present & APC_FIELD_BIT(u->field))) {
+            target->present |= APC_FIELD_BIT(u->field);
+            result = DECODE_CHANGED;
+        }
+        if (result == DECODE_CHANGED) {
+            p->dirty |= APC_FIELD_BIT(u->field);
+        }
+    }
+    apc_hid_trace_end();
+
+    if (num == 0) {
+        APC_HID_TRACE_V(TAG, "   Type: ❓ UNKNOWN Report ID (0x%02X)", report_id);
+        APC_HID_TRACE_V(TAG, "   └─ This report ID is not in the usage table");
+    }
+
+    if (decoded != 0) {
+        APC_HID_TRACE_V(TAG, "✅ METRICS UPDATED");
+        APC_HID_TRACE_V(TAG, "   Status: %s", apc_hid_status_string(target->status));
     } else {
-        ESP_LOGI(TAG, "⚠️  NO UPDATE (insufficient data or parsing issue)");
-        ESP_LOGI(TAG, "═══════════════════════════════════════════");
+        APC_HID_TRACE_V(TAG, "⚠️  NO UPDATE (insufficient data or parsing issue)");
     }
+    APC_HID_TRACE_V(TAG, "═══════════════════════════════════════════");
+
+    APC_HID_TRACE_S(TAG, "📦 0x%02X [%u bytes] %s → %s", report_id, (unsigned)length,
+                    decoded != 0 ? "updated" : "no update", apc_hid_status_string(target->status));
+
+    return decoded;
+}
 
+bool apc_hid_parse_report(apc_hid_parser_t *p, uint8_t report_id, const uint8_t *data, size_t length)
+{
+    // A report on its own is a batch of one
+    if (p->batch_open) {
+        return apc_hid_batch_apply(p, report_id, data, length);
+    }
+    apc_hid_batch_begin(p);
+    bool updated = apc_hid_batch_apply(p, report_id, data, length);
+    apc_hid_batch_commit(p);
     return updated;
 }
 
-const ups_metrics_t* apc_hid_get_metrics(void)
+//══════════════════════════════════════════════════════════════════════════════
+// BATCHES
+//══════════════════════════════════════════════════════════════════════════════
+
+// A cache hit confirms the fields of the report without decoding them
+static void stamp_fields(apc_hid_parser_t *p, apc_field_mask_t fields, int64_t now_us)
+{
+    for (int f = 0; f < APC_FIELD_COUNT; f++) {
+        if (fields & APC_FIELD_BIT(f)) {
+            p->field_time_us[f] = now_us;
+        }
+    }
+}
+
+void apc_hid_parser_set_sample_callback(apc_hid_parser_t *p, apc_hid_sample_cb_t callback, void *ctx)
+{
+    p->sample_cb = callback;
+    p->sample_ctx = ctx;
+}
+
+void apc_hid_parser_set_raw_sample_callback(apc_hid_parser_t *p, apc_hid_sample_cb_t callback, void *ctx)
 {
-    return &current_metrics;
+    p->raw_sample_cb = callback;
+    p->raw_sample_ctx = ctx;
 }
 
-void apc_hid_format_status(const ups_status_t *status, char *buffer, size_t buffer_size)
+void apc_hid_batch_begin(apc_hid_parser_t *p)
 {
-    buffer[0] = '\0';
+    p->batch_open = true;
+    p->batch_updated = false;
+    p->batch_received = 0;
+}
 
-    if (status->online) {
-        strncat(buffer, "OL", buffer_size - strlen(buffer) - 1);  // Online
-    } else if (status->discharging) {
-        strncat(buffer, "OB", buffer_size - strlen(buffer) - 1);  // On Battery
+bool apc_hid_batch_apply(apc_hid_parser_t *p, uint8_t report_id, const uint8_t *data, size_t length)
+{
+    if (data == NULL || length == 0) {
+        return false;
     }
 
-    if (status->charging) {
-        if (strlen(buffer) > 0) strncat(buffer, " ", buffer_size - strlen(buffer) - 1);
-        strncat(buffer, "CHRG", buffer_size - strlen(buffer) - 1);
+    int64_t now_us = esp_timer_get_time();
+
+    report_cache_entry_t *cached = report_cache_lookup(p, report_id, data, length);
+    if (cached != NULL) {
+        p->cache_stats.hits++;
+        stamp_fields(p, cached->fields, now_us);
+        for (int f = 0; f < APC_FIELD_COUNT; f++) {
+            if (cached->fields & APC_FIELD_BIT(f)) {
+                apc_hid_filter_repeat(&p->filter, (apc_field_t)f, p->current.value[f]);
+            }
+        }
+        p->batch_received |= cached->fields;
+        p->batch_updated = true;
+        APC_HID_TRACE_V(TAG, "♻️ 0x%02X unchanged (cache hit)", report_id);
+        return true;
+    }
+    p->cache_stats.misses++;
+
+    p->filter_active = false;
+    apc_field_mask_t decoded = decode_report(p, report_id, data, length, now_us);
+    if (decoded == 0) {
+        return false;
+    }
+    // A hit repeats the stored values into the filter, so bytes whose
+    // samples were held or replaced must not stay cached either: a later hit
+    // on the previous bytes would confirm the filtered value
+    if (p->filter_active) {
+        report_cache_forget(p, report_id);
+    } else {
+        report_cache_store(p, report_id, data, length, decoded);
+    }
+    p->batch_received |= decoded;
+    p->batch_updated = true;
+    return true;
+}
+
+uint32_t apc_hid_batch_commit(apc_hid_parser_t *p)
+{
+    if (p->batch_updated) {
+        int64_t now_us = esp_timer_get_time();
+        p->current.update_time_us = now_us;
+        p->current.valid = true;
+        p->dirty |= apc_hid_derive(&p->current, p->field_time_us, p->dirty);
+
+        // A derived field is received whenever one of its inputs is (field
+        // order puts derived fields after their inputs)
+        for (int f = 0; f < APC_FIELD_COUNT; f++) {
+            if ((p->current.present & APC_FIELD_BIT(f)) && (apc_hid_field_inputs((apc_field_t)f) & p->batch_received)) {
+                p->batch_received |= APC_FIELD_BIT(f);
+            }
+        }
+
+        // One sample per field received in the batch
+        uint32_t seq = p->stats_seq;
+        __atomic_store_n(&p->stats_seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        for (int i = 0; i < APC_STATS_NUM_FIELDS; i++) {
+            apc_field_t field = apc_hid_stats_fields[i];
+            if (p->batch_received & APC_FIELD_BIT(field)) {
+                apc_hid_stats_add(&p->stats, i, p->current.value[field], now_us);
+            }
+        }
+        __atomic_store_n(&p->stats_seq, seq + 2, __ATOMIC_RELEASE);
+        if (p->sample_cb != NULL) {
+            for (int f = 0; f < APC_FIELD_COUNT; f++) {
+                if (p->batch_received & APC_FIELD_BIT(f)) {
+                    int32_t value = (f == APC_FIELD_STATUS) ? p->current.status : p->current.value[f];
+                    p->sample_cb((apc_field_t)f, value, p->sample_ctx);
+                }
+            }
+        }
+        publish_snapshot(p);
+    }
+    p->batch_open = false;
+    p->batch_updated = false;
+    return p->current.version;
+}
+
+//══════════════════════════════════════════════════════════════════════════════
+// SNAPSHOTS
+//══════════════════════════════════════════════════════════════════════════════
+
+uint32_t apc_hid_get_snapshot(apc_hid_parser_t *p, ups_metrics_t *out)
+{
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&p->published_seq, __ATOMIC_ACQUIRE);
+        if ((seq & 1) == 0) {
+            memcpy(out, &p->published, sizeof(*out));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&p->published_seq, __ATOMIC_RELAXED) == seq) {
+                return out->version;
+            }
+        }
+        // The writer may be preempted mid-copy by this task on the same core
+        vTaskDelay(1);
+    }
+}
+
+uint32_t apc_hid_snapshot_version(apc_hid_parser_t *p)
+{
+    return __atomic_load_n(&p->published_version, __ATOMIC_ACQUIRE);
+}
+
+apc_field_mask_t apc_hid_changed_since(const ups_metrics_t *snapshot, uint32_t since)
+{
+    if (since == 0) {
+        return APC_FIELD_MASK_ALL;
+    }
+    apc_field_mask_t changed = 0;
+    if (snapshot->version > since) {
+        for (int f = 0; f < APC_FIELD_COUNT; f++) {
+            if (snapshot->field_version[f] > since) {
+                changed |= APC_FIELD_BIT(f);
+            }
+        }
     }
+    return changed;
+}
 
-    if (status->low_battery) {
-        if (strlen(buffer) > 0) strncat(buffer, " ", buffer_size - strlen(buffer) - 1);
-        strncat(buffer, "LB", buffer_size - strlen(buffer) - 1);
+int64_t apc_hid_field_age_us(const ups_metrics_t *snapshot, apc_field_t field, int64_t now_us)
+{
+    // Defaults set at creation (battery type) have no receive time
+    if (field <= APC_FIELD_NONE || field >= APC_FIELD_COUNT || snapshot->field_age_ms[field] == APC_FIELD_AGE_NEVER) {
+        return -1;
     }
+    return now_us - snapshot->update_time_us + snapshot->field_age_ms[field] * 1000LL;
+}
 
-    if (status->overload) {
-        if (strlen(buffer) > 0) strncat(buffer, " ", buffer_size - strlen(buffer) - 1);
-        strncat(buffer, "OVER", buffer_size - strlen(buffer) - 1);
+apc_field_mask_t apc_hid_stale_fields(const ups_metrics_t *snapshot, int64_t max_age_us, int64_t now_us)
+{
+    apc_field_mask_t stale = 0;
+    for (int f = 0; f < APC_FIELD_COUNT; f++) {
+        if (apc_hid_field_age_us(snapshot, (apc_field_t)f, now_us) > max_age_us) {
+            stale |= APC_FIELD_BIT(f);
+        }
     }
+    return stale;
+}
 
-    if (status->replace_battery) {
-        if (strlen(buffer) > 0) strncat(buffer, " ", buffer_size - strlen(buffer) - 1);
-        strncat(buffer, "RB", buffer_size - strlen(buffer) - 1);
+bool apc_hid_get_field_stats(apc_hid_parser_t *p, apc_field_t field, apc_stats_summary_t out[APC_STATS_WINDOW_COUNT])
+{
+    int index = apc_hid_stats_index(field);
+    if (index < 0) {
+        return false;
+    }
+    // Summarized in place: a summary read during an update is thrown away
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&p->stats_seq, __ATOMIC_ACQUIRE);
+        if ((seq & 1) == 0) {
+            apc_hid_stats_summarize(&p->stats, index, esp_timer_get_time(), out);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&p->stats_seq, __ATOMIC_RELAXED) == seq) {
+                return true;
+            }
+        }
+        // The writer may be preempted mid-update by this task on the same core
+        vTaskDelay(1);
     }
+}
+
+const char* apc_hid_stats_window_name(apc_stats_window_t window)
+{
+    static const char *const names[APC_STATS_WINDOW_COUNT] = {
+        [APC_STATS_1M] = "1m", [APC_STATS_15M] = "15m", [APC_STATS_1H] = "1h",
+    };
+    return (window < APC_STATS_WINDOW_COUNT) ? names[window] : "unknown";
+}
 
-    if (status->boost) {
-        if (strlen(buffer) > 0) strncat(buffer, " ", buffer_size - strlen(buffer) - 1);
-        strncat(buffer, "BOOST", buffer_size - strlen(buffer) - 1);
+static int format_fixed(int32_t v, uint8_t decimals, char *buffer, size_t buffer_size)
+{
+    if (decimals == 0) {
+        return snprintf(buffer, buffer_size, "%ld", (long)v);
     }
+    int32_t d = pow10_table[decimals];
+    uint32_t mag = (v < 0) ? -(uint32_t)v : (uint32_t)v;
+    return snprintf(buffer, buffer_size, "%s%lu.%0*lu", (v < 0) ? "-" : "",
+                    (unsigned long)(mag / d), decimals, (unsigned long)(mag % d));
+}
+
+int apc_hid_format_fixed(apc_field_t field, int32_t value, char *buffer, size_t buffer_size)
+{
+    uint8_t decimals = (field < APC_FIELD_COUNT) ? field_info[field].decimals : 0;
+    return format_fixed(value, decimals, buffer, buffer_size);
+}
 
-    if (status->trim) {
-        if (strlen(buffer) > 0) strncat(buffer, " ", buffer_size - strlen(buffer) - 1);
-        strncat(buffer, "TRIM", buffer_size - strlen(buffer) - 1);
+int apc_hid_format_field(const ups_metrics_t *metrics, apc_field_t field, char *buffer, size_t buffer_size)
+{
+    if (field >= APC_FIELD_COUNT) {
+        return snprintf(buffer, buffer_size, "unknown");
     }
+    const apc_field_info_t *info = &field_info[field];
+    int32_t v = metrics->value[field];
+
+    switch (info->kind) {
+    case APC_KIND_NUMBER:
+        return format_fixed(v, info->decimals, buffer, buffer_size);
+    case APC_KIND_ENUM:
+        return snprintf(buffer, buffer_size, "%s", (v >= 0 && v < info->num_names) ? info->names[v] : "unknown");
+    case APC_KIND_DATE:
+        // HID date: ((year - 1980) * 512) + (month * 32) + day
+        return snprintf(buffer, buffer_size, "%04d/%02d/%02d",
+                        1980 + (int)((v >> 9) & 0x7F), (int)((v >> 5) & 0x0F), (int)(v & 0x1F));
+    case APC_KIND_VERSION:
+        return snprintf(buffer, buffer_size, "%d.%d", (int)(v & 0xFF), (int)((v >> 8) & 0xFF));
+    case APC_KIND_STATUS:
+    default:
+        return snprintf(buffer, buffer_size, "%s", apc_hid_status_string(metrics->status));
+    }
+}
 
-    if (strlen(buffer) == 0) {
-        strncat(buffer, "UNKNOWN", buffer_size - 1);
+float apc_hid_field_float(const ups_metrics_t *metrics, apc_field_t field)
+{
+    if (field >= APC_FIELD_COUNT) {
+        return 0.0f;
     }
+    const apc_field_info_t *info = &field_info[field];
+    float v = (float)metrics->value[field];
+    return (info->kind == APC_KIND_NUMBER) ? v / (float)pow10_table[info->decimals] : v;
+}
+
+//══════════════════════════════════════════════════════════════════════════════
+// STATUS STRINGS
+//══════════════════════════════════════════════════════════════════════════════
+// All 256 PresentStatus combinations, expanded by the preprocessor. Each level
+// doubles the table on one bit (low bit varies fastest) and appends that
+// bit's token after the text of the lower bits. Tokens carry a leading space,
+// skipped on lookup; an empty entry means no flag is set.
+//   OL wins over OB: discharging is only reported when not online.
+
+#define STATUS_B01(s)  "" s, " OL" s, " OB" s, " OL" s
+#define STATUS_B2(s)   STATUS_B01(s), STATUS_B01(" CHRG" s)
+#define STATUS_B3(s)   STATUS_B2(s),  STATUS_B2(" LB" s)
+#define STATUS_B4(s)   STATUS_B3(s),  STATUS_B3(" OVER" s)
+#define STATUS_B5(s)   STATUS_B4(s),  STATUS_B4(" RB" s)
+#define STATUS_B6(s)   STATUS_B5(s),  STATUS_B5(" BOOST" s)
+#define STATUS_B7(s)   STATUS_B6(s),  STATUS_B6(" TRIM" s)
+
+static const char *const status_strings[256] = { STATUS_B7("") };
+
+#undef STATUS_B01
+#undef STATUS_B2
+#undef STATUS_B3
+#undef STATUS_B4
+#undef STATUS_B5
+#undef STATUS_B6
+#undef STATUS_B7
+
+const char* apc_hid_status_string(uint8_t status)
+{
+    const char *s = status_strings[status];
+    return s[0] ? s + 1 : "UNKNOWN";
 }
@@ -5,72 +5,309 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+//══════════════════════════════════════════════════════════════════════════════
+// FIELDS
+//══════════════════════════════════════════════════════════════════════════════
+
+// Metric a usage decodes into (also the unit of change tracking)
+typedef enum {
+    APC_FIELD_NONE = 0,
+    APC_FIELD_BATTERY_CHARGE,
+    APC_FIELD_BATTERY_VOLTAGE,
+    APC_FIELD_BATTERY_RUNTIME,
+    APC_FIELD_BATTERY_NOMINAL_VOLTAGE,
+    APC_FIELD_BATTERY_WARNING_THRESHOLD,
+    APC_FIELD_BATTERY_TYPE,
+    APC_FIELD_BATTERY_MFR_DATE,
+    APC_FIELD_INPUT_VOLTAGE,
+    APC_FIELD_INPUT_VOLTAGE_NOMINAL,
+    APC_FIELD_INPUT_FREQUENCY,
+    APC_FIELD_OUTPUT_VOLTAGE,
+    APC_FIELD_LOAD_PERCENT,
+    APC_FIELD_NOMINAL_POWER,
+    APC_FIELD_HIGH_VOLTAGE_TRANSFER,
+    APC_FIELD_LOW_VOLTAGE_TRANSFER,
+    APC_FIELD_INPUT_SENSITIVITY,
+    APC_FIELD_LAST_TRANSFER_REASON,
+    APC_FIELD_LOW_BATTERY_CHARGE_THRESHOLD,
+    APC_FIELD_LOW_BATTERY_RUNTIME_THRESHOLD,
+    APC_FIELD_SHUTDOWN_TIMER,
+    APC_FIELD_REBOOT_TIMER,
+    APC_FIELD_DELAY_BEFORE_REBOOT,
+    APC_FIELD_DELAY_BEFORE_SHUTDOWN,
+    APC_FIELD_FIRMWARE_VERSION,
+    APC_FIELD_BEEPER_STATUS,
+    APC_FIELD_SELF_TEST_RESULT,
+    APC_FIELD_STATUS,                  // One PresentStatus bit, selected by usage arg
+    APC_FIELD_NOMINAL_APPARENT_POWER,
+
+    // Derived from other fields at commit (see apc_hid_field_inputs)
+    APC_FIELD_OUTPUT_POWER,
+    APC_FIELD_OUTPUT_APPARENT_POWER,
+    APC_FIELD_POWER_HEADROOM,
+    APC_FIELD_COUNT
+} apc_field_t;
+
+// PresentStatus bits (usage arg for APC_FIELD_STATUS, bit index in ups_metrics_t.status)
+#define APC_STATUS_ONLINE           0
+#define APC_STATUS_DISCHARGING      1
+#define APC_STATUS_CHARGING         2
+#define APC_STATUS_LOW_BATTERY      3
+#define APC_STATUS_OVERLOAD         4
+#define APC_STATUS_REPLACE_BATTERY  5
+#define APC_STATUS_BOOST            6
+#define APC_STATUS_TRIM             7
+
+#define APC_STATUS_BIT(bit)         ((uint8_t)(1u << (bit)))
+
+// Set of apc_field_t values
+typedef uint64_t apc_field_mask_t;
+#define APC_FIELD_BIT(field)  ((apc_field_mask_t)1 << (field))
+#define APC_FIELD_MASK_ALL    (APC_FIELD_BIT(APC_FIELD_COUNT) - 1)
+
+// How a field's value is stored and formatted
+typedef enum {
+    APC_KIND_NUMBER = 0,       // Fixed point: real value * 10^decimals
+    APC_KIND_ENUM,             // Code, index into names[]
+    APC_KIND_DATE,             // Raw HID date, formatted YYYY/MM/DD
+    APC_KIND_VERSION,          // Low byte major, high byte minor
+    APC_KIND_STATUS,           // PresentStatus bits, kept in ups_metrics_t.status
+} apc_field_kind_t;
+
 typedef struct {
-    bool online;
-    bool discharging;
-    bool charging;
-    bool low_battery;
-    bool overload;
-    bool replace_battery;
-    bool boost;
-    bool trim;
-} ups_status_t;
+    const char *name;          // snake_case identifier
+    const char *unit;          // NULL if unitless
+    uint8_t kind;              // apc_field_kind_t
+    uint8_t decimals;          // APC_KIND_NUMBER only
+    uint8_t num_names;         // APC_KIND_ENUM only
+    const char *const *names;
+} apc_field_info_t;
 
+// Constant driver identification, published alongside the metrics
+#define APC_DRIVER_NAME           "esp32-usb-hid"
+#define APC_DRIVER_VERSION        "1.0.0"
+#define APC_DRIVER_STATE          "running"
+#define APC_POWER_FAILURE_STATUS  "OK"
+
+// Rolling statistics of a few fields over fixed windows (see apc_hid_stats.h)
+#define APC_STATS_NUM_FIELDS 3         // Input voltage, load, battery voltage
+
+typedef enum {
+    APC_STATS_1M = 0,
+    APC_STATS_15M,
+    APC_STATS_1H,
+    APC_STATS_WINDOW_COUNT
+} apc_stats_window_t;
+
+// Same fixed point as the field's value
 typedef struct {
-    // Battery metrics
-    float battery_charge;              // %
-    float battery_voltage;             // V
-    float battery_runtime;             // seconds
-    float battery_nominal_voltage;     // V
-    float battery_warning_threshold;   // %
-    char battery_type[16];             // e.g., "PbAc"
-    char battery_mfr_date[16];         // YYYY/MM/DD
-
-    // Input/Output metrics
-    float input_voltage;               // V
-    float input_voltage_nominal;       // V
-    float input_frequency;             // Hz
-    float output_voltage;              // V
-    float load_percent;                // %
-    float nominal_power;               // W
-
-    // Transfer points
-    float high_voltage_transfer;       // V
-    float low_voltage_transfer;        // V
-    char input_sensitivity[16];        // low/medium/high
-    char last_transfer_reason[64];
-
-    // Battery thresholds
-    float low_battery_charge_threshold;   // %
-    float low_battery_runtime_threshold;  // seconds
-
-    // Timers
-    float shutdown_delay;              // seconds
-    float shutdown_timer;              // seconds
-    float reboot_timer;                // seconds
-    float delay_before_reboot;         // seconds
-    float delay_before_shutdown;       // seconds
-
-    // Device info
-    char firmware_version[32];
-    char driver_name[32];
-    char driver_state[16];
-    char driver_version[16];
-    char beeper_status[16];            // enabled/disabled/muted
-    char self_test_result[64];
-    char power_failure_status[16];     // OK or reason
-
-    // Status
-    ups_status_t status;
-    char status_string[64];
-
-    uint32_t last_update_ms;
+    int32_t min;
+    int32_t max;
+    int32_t mean;
+    int32_t stddev;
+    uint32_t count;                    // Samples in the window, 0 = no data
+} apc_stats_summary_t;
+
+typedef struct {
+    // One fixed-point value per apc_field_t (see apc_field_info_t). Nothing
+    // is formatted while decoding; use apc_hid_format_field() at the output.
+    int32_t value[APC_FIELD_COUNT];
+    apc_field_mask_t present;                  // Fields decoded at least once
+
+    uint8_t status;                            // PresentStatus bits (APC_STATUS_BIT)
+
     bool valid;
+    int64_t update_time_us;                    // esp_timer time of the last report
+
+    // Milliseconds each field had last been received (changed or not) at
+    // update_time_us, APC_FIELD_AGE_NEVER if never (see apc_hid_field_age_us)
+    uint32_t field_age_ms[APC_FIELD_COUNT];
+
+    // Change tracking (see apc_hid_changed_since)
+    uint32_t version;                          // Increases whenever any field changes
+    uint32_t field_version[APC_FIELD_COUNT];   // Version in which each field last changed
 } ups_metrics_t;
 
-void apc_hid_parser_init(void);
-bool apc_hid_parse_report(uint8_t report_id, const uint8_t *data, size_t length, ups_metrics_t *metrics);
-const ups_metrics_t* apc_hid_get_metrics(void);
-void apc_hid_format_status(const ups_status_t *status, char *buffer, size_t buffer_size);
+#define APC_FIELD_AGE_NEVER UINT32_MAX
+
+//══════════════════════════════════════════════════════════════════════════════
+// USAGE TABLE
+//══════════════════════════════════════════════════════════════════════════════
+// Every report is decoded by walking a compact table of usages. The table is
+// compiled from the UPS's HID report descriptor at enumeration (see
+// apc_hid_usage.h); when no descriptor is available the built-in layout of
+// the model profile selected at enumeration is used instead.
+
+// HID report types (high byte of wValue in GET_REPORT)
+#define APC_HID_REPORT_INPUT   1
+#define APC_HID_REPORT_OUTPUT  2
+#define APC_HID_REPORT_FEATURE 3
+
+// One decodable value inside a report (16 bytes)
+typedef struct {
+    uint8_t  report_id;
+    uint8_t  report_type;        // APC_HID_REPORT_INPUT or APC_HID_REPORT_FEATURE
+    uint16_t bit_offset;         // Relative to the first byte after the report ID
+    uint8_t  bit_size;           // 1..32
+    uint8_t  field;              // apc_field_t
+    uint8_t  arg;                // Field-specific (status bit index)
+    int8_t   unit_exponent;      // Decoded value = raw * 10^unit_exponent
+    int32_t  logical_min;        // Raw values outside [min, max] mean "no data"
+    int32_t  logical_max;
+} apc_hid_usage_t;
+
+#define APC_HID_MAX_USAGES 64
+#define APC_HID_NO_USAGE   0xFF
+
+// Usages sorted by report ID, with a direct index per report ID
+typedef struct {
+    apc_hid_usage_t usages[APC_HID_MAX_USAGES];
+    uint8_t count;
+    uint8_t first[256];          // First usage for a report ID, APC_HID_NO_USAGE if none
+    uint8_t num[256];            // Number of usages for a report ID
+    uint8_t declared[256 / 8];   // Report IDs the descriptor declares, mapped or not
+} apc_hid_usage_table_t;
+
+//══════════════════════════════════════════════════════════════════════════════
+// MODEL PROFILES
+//══════════════════════════════════════════════════════════════════════════════
+// VID 0x051D = American Power Conversion
+// PID 0x0002 = Back-UPS series (Back-UPS XS 1000M, etc.)
+// PID 0x0003 = Smart-UPS series (Smart-UPS C 1500, etc.)
+#define APC_VID          0x051d
+#define APC_PID_BACKUPS  0x0002
+#define APC_PID_SMARTUPS 0x0003
+
+typedef struct {
+    uint16_t pid;
+    const char *name;
+    const apc_hid_usage_t *usages;     // Built-in layout of this model (NULL = none), also
+    uint8_t num_usages;                // fills gaps in the descriptor
+    const uint8_t *poll_reports;       // Feature reports this model answers (NULL = all in table)
+    uint8_t num_poll_reports;
+} apc_hid_profile_t;
+
+const apc_hid_profile_t* apc_hid_profile_for_pid(uint16_t pid);
+const apc_hid_profile_t* apc_hid_default_profile(void);
+
+//══════════════════════════════════════════════════════════════════════════════
+// PARSER
+//══════════════════════════════════════════════════════════════════════════════
+// A parser instance owns the live metrics of one UPS, its usage table, its
+// report cache and its snapshot versions. Instances share nothing, so a
+// bridge can run one per UPS and tests can run many side by side.
+// Decoding (parse_report, batches, table changes) belongs to one task per
+// instance; snapshots can be read from any task.
+typedef struct apc_hid_parser apc_hid_parser_t;
+
+// Returns NULL if out of memory
+apc_hid_parser_t* apc_hid_parser_create(void);
+void apc_hid_parser_destroy(apc_hid_parser_t *parser);
+
+void apc_hid_parser_select_profile(apc_hid_parser_t *parser, const apc_hid_profile_t *profile);
+const apc_hid_profile_t* apc_hid_parser_get_profile(const apc_hid_parser_t *parser);
+bool apc_hid_parser_load_descriptor(apc_hid_parser_t *parser, const uint8_t *desc, size_t length);
+void apc_hid_parser_use_default_table(apc_hid_parser_t *parser);
+const apc_hid_usage_table_t* apc_hid_parser_get_table(const apc_hid_parser_t *parser);
+int apc_hid_parser_get_poll_list(const apc_hid_parser_t *parser, const uint8_t **report_ids);
+// First report in the poll list that carries `field`, -1 if none
+int apc_hid_parser_poll_report_for(const apc_hid_parser_t *parser, apc_field_t field);
+const char* apc_hid_field_name(apc_field_t field);
+const apc_field_info_t* apc_hid_field_info(apc_field_t field);
+// Fields a derived field is computed from, 0 for fields decoded from reports
+apc_field_mask_t apc_hid_field_inputs(apc_field_t field);
+// Decode one report into the live metrics and publish it as a new snapshot
+// (or, inside a batch, at the batch commit).
+bool apc_hid_parse_report(apc_hid_parser_t *parser, uint8_t report_id, const uint8_t *data, size_t length);
+
+// Batches: reports applied between begin and commit reach readers together
+// as one snapshot version. Commit returns that version.
+void apc_hid_batch_begin(apc_hid_parser_t *parser);
+bool apc_hid_batch_apply(apc_hid_parser_t *parser, uint8_t report_id, const uint8_t *data, size_t length);
+uint32_t apc_hid_batch_commit(apc_hid_parser_t *parser);
+
+// Called at each commit, from the decoding task, once per field received in
+// the batch (changed or not), e.g. to feed longer-term statistics. A derived
+// field counts as received with any of its inputs and follows them. For
+// APC_FIELD_STATUS the value is the PresentStatus bits.
+typedef void (*apc_hid_sample_cb_t)(apc_field_t field, int32_t value, void *ctx);
+void apc_hid_parser_set_sample_callback(apc_hid_parser_t *parser, apc_hid_sample_cb_t callback, void *ctx);
+
+// Called during decoding, from the decoding task, with every decoded sample
+// before the glitch filter sees it (status bits excluded), for consumers that
+// must react to the first out-of-range reading rather than a confirmed one
+void apc_hid_parser_set_raw_sample_callback(apc_hid_parser_t *parser, apc_hid_sample_cb_t callback, void *ctx);
+
+// Raw-report dedupe cache: a hit is a report identical to the previous one
+// with the same ID, which is not decoded again
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+} apc_hid_cache_stats_t;
+
+void apc_hid_get_cache_stats(const apc_hid_parser_t *parser, apc_hid_cache_stats_t *stats);
+
+// Glitch filter between decode and store, per field. Stages run in order:
+// - median: the median of the last `median` samples is stored (1 = off);
+//   nothing is stored until that many samples have arrived
+// - max_step: a sample further than this from the stored value is held
+//   back until `confirm` consecutive samples agree on the new level (0 = off)
+// - confirm (enums): a new code is stored once seen `confirm` times in a row
+// Defaults cover the voltages, frequency, charge and settings enums (see
+// apc_hid_filter.c). Status bits are never filtered.
+#define APC_FILTER_MAX_MEDIAN 5
+
+typedef struct {
+    uint8_t median;              // Odd, 1..APC_FILTER_MAX_MEDIAN (0 = off)
+    uint8_t confirm;             // Samples to accept a step or a new code (0/1 = off)
+    int32_t max_step;            // Fixed point of the field, 0 = off
+} apc_hid_filter_config_t;
+
+// Samples stored as something else (median) or held back, since creation
+typedef struct {
+    uint32_t smoothed;           // Replaced by the median
+    uint32_t step_held;          // Held by the step limit
+    uint32_t enum_held;          // Held by enum confirmation
+    uint32_t field[APC_FIELD_COUNT];
+} apc_hid_filter_stats_t;
+
+// NULL config turns filtering of `field` off
+void apc_hid_parser_set_filter(apc_hid_parser_t *parser, apc_field_t field, const apc_hid_filter_config_t *config);
+void apc_hid_get_filter_stats(const apc_hid_parser_t *parser, apc_hid_filter_stats_t *stats);
+
+// Copy a consistent snapshot of the live metrics; returns its version.
+// Safe from any task, never blocks the decoding task.
+uint32_t apc_hid_get_snapshot(apc_hid_parser_t *parser, ups_metrics_t *out);
+uint32_t apc_hid_snapshot_version(apc_hid_parser_t *parser);
+
+// Fields of a snapshot that changed after version `since` (all fields for 0).
+// Cost is fixed, however many versions the caller is behind.
+apc_field_mask_t apc_hid_changed_since(const ups_metrics_t *snapshot, uint32_t since);
+
+// Age of a field at `now_us` (esp_timer_get_time() time), -1 if never received
+int64_t apc_hid_field_age_us(const ups_metrics_t *snapshot, apc_field_t field, int64_t now_us);
+
+// Fields last received more than `max_age_us` before `now_us`. Defaults
+// that were never received are not stale.
+apc_field_mask_t apc_hid_stale_fields(const ups_metrics_t *snapshot, int64_t max_age_us, int64_t now_us);
+
+// Rolling statistics of `field` over every window as of now; false if the
+// field has none. Safe from any task, never blocks the decoding task.
+bool apc_hid_get_field_stats(apc_hid_parser_t *parser, apc_field_t field, apc_stats_summary_t out[APC_STATS_WINDOW_COUNT]);
+const char* apc_hid_stats_window_name(apc_stats_window_t window);
+
+// Output edge: format a field as text (number with its decimals, enum
+// name, date...). Returns the length written, like snprintf.
+int apc_hid_format_field(const ups_metrics_t *metrics, apc_field_t field, char *buffer, size_t buffer_size);
+// Format a fixed-point value with the decimals of `field` (e.g. a statistic)
+int apc_hid_format_fixed(apc_field_t field, int32_t value, char *buffer, size_t buffer_size);
+float apc_hid_field_float(const ups_metrics_t *metrics, apc_field_t field);
+static inline bool apc_hid_field_present(const ups_metrics_t *metrics, apc_field_t field)
+{
+    return (metrics->present & APC_FIELD_BIT(field)) != 0;
+}
+
+// NUT-style status text ("OL CHRG", "OB LB", ...) for PresentStatus bits
+const char* apc_hid_status_string(uint8_t status);
 
 #endif // APC_HID_PARSER_H
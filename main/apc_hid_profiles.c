@@ -0,0 +1,160 @@
+/*
+ * Per-model decoder profiles
+ *
+ * Each supported UPS model (by USB PID) gets a const profile with its own
+ * built-in report layout, used when the report descriptor can't be read,
+ * and the list of Feature reports the model actually answers. A model whose
+ * report IDs aren't known has no layout and relies on its descriptor. The profile
+ * is chosen once at enumeration; nothing here is touched per report.
+ */
+
+#include "apc_hid_parser.h"
+#include <stddef.h>
+
+//══════════════════════════════════════════════════════════════════════════════
+// BACK-UPS LAYOUT (used when no descriptor is available)
+//══════════════════════════════════════════════════════════════════════════════
+// Byte offsets count from the first byte after the report ID, so Byte[1] of a
+// raw report is offset 0 here. Verified against NUT explore output.
+#define U8(id, type, byte, field, exp)   { (id), (type), (byte) * 8, 8,  (field), 0, (exp), 0, 255 }
+#define U16(id, type, byte, field, exp)  { (id), (type), (byte) * 8, 16, (field), 0, (exp), 0, 65535 }
+#define S16(id, type, byte, field)       { (id), (type), (byte) * 8, 16, (field), 0, 0, -32768, 32767 }
+#define BIT(id, bit, status)             { (id), APC_HID_REPORT_INPUT, (bit), 1, APC_FIELD_STATUS, (status), 0, 0, 1 }
+
+#define IN   APC_HID_REPORT_INPUT
+#define FEAT APC_HID_REPORT_FEATURE
+
+static const apc_hid_usage_t backups_layout[] = {
+    // Interrupt reports
+    U8 (0x0C, IN,   0, APC_FIELD_BATTERY_CHARGE, 0),                   // UPS.PowerSummary.RemainingCapacity
+    U16(0x0C, IN,   1, APC_FIELD_BATTERY_RUNTIME, 0),                  // UPS.PowerSummary.RunTimeToEmpty
+    BIT(0x06, 19, APC_STATUS_ONLINE),                                  // Status byte at Byte[3]
+    BIT(0x06, 16, APC_STATUS_DISCHARGING),
+    BIT(0x06, 17, APC_STATUS_CHARGING),
+    BIT(0x06, 18, APC_STATUS_LOW_BATTERY),
+    BIT(0x16, 0, APC_STATUS_ONLINE),                                   // UPS.PowerSummary.PresentStatus
+    BIT(0x16, 1, APC_STATUS_DISCHARGING),
+    BIT(0x16, 2, APC_STATUS_CHARGING),
+    BIT(0x16, 3, APC_STATUS_LOW_BATTERY),
+    BIT(0x16, 4, APC_STATUS_OVERLOAD),
+    BIT(0x16, 5, APC_STATUS_REPLACE_BATTERY),
+    BIT(0x16, 6, APC_STATUS_BOOST),
+    BIT(0x16, 7, APC_STATUS_TRIM),
+
+    // Battery
+    U8 (0x03, FEAT, 0, APC_FIELD_BATTERY_TYPE, 0),                     // UPS.PowerSummary.iDeviceChemistry
+    U16(0x08, FEAT, 0, APC_FIELD_BATTERY_NOMINAL_VOLTAGE, -2),         // UPS.PowerSummary.ConfigVoltage
+    U16(0x09, FEAT, 0, APC_FIELD_BATTERY_VOLTAGE, -2),                 // UPS.PowerSummary.Voltage
+    U8 (0x0B, FEAT, 0, APC_FIELD_BATTERY_NOMINAL_VOLTAGE, 0),
+    U8 (0x0D, FEAT, 0, APC_FIELD_BATTERY_VOLTAGE, -1),
+    U8 (0x0F, FEAT, 0, APC_FIELD_BATTERY_WARNING_THRESHOLD, 0),        // UPS.PowerSummary.WarningCapacityLimit
+    U8 (0x11, FEAT, 0, APC_FIELD_LOW_BATTERY_CHARGE_THRESHOLD, 0),     // UPS.PowerSummary.RemainingCapacityLimit
+    U16(0x12, FEAT, 0, APC_FIELD_LOW_BATTERY_RUNTIME_THRESHOLD, 0),
+    U16(0x24, FEAT, 0, APC_FIELD_LOW_BATTERY_RUNTIME_THRESHOLD, 0),    // UPS.Battery.RemainingTimeLimit
+    U16(0x20, FEAT, 0, APC_FIELD_BATTERY_MFR_DATE, 0),                 // UPS.Battery.ManufacturerDate
+
+    // Input / output
+    U8 (0x30, FEAT, 0, APC_FIELD_INPUT_VOLTAGE_NOMINAL, 0),            // UPS.Input.ConfigVoltage
+    U16(0x31, FEAT, 0, APC_FIELD_INPUT_VOLTAGE, 0),                    // UPS.Input.Voltage
+    U16(0x32, FEAT, 0, APC_FIELD_LOW_VOLTAGE_TRANSFER, 0),             // UPS.Input.LowVoltageTransfer
+    U16(0x33, FEAT, 0, APC_FIELD_HIGH_VOLTAGE_TRANSFER, 0),            // UPS.Input.HighVoltageTransfer
+    U8 (0x35, FEAT, 0, APC_FIELD_INPUT_SENSITIVITY, 0),
+    { 0x36, FEAT, 0, 8, APC_FIELD_INPUT_FREQUENCY, 0, 0, 1, 255 },     // UPS.Input.Frequency (0 Hz = not available)
+    U8 (0x21, FEAT, 0, APC_FIELD_LAST_TRANSFER_REASON, 0),
+    U8 (0x50, FEAT, 0, APC_FIELD_LOAD_PERCENT, 0),                     // UPS.PowerConverter.PercentLoad
+    U16(0x25, FEAT, 0, APC_FIELD_NOMINAL_POWER, 0),
+    U16(0x52, FEAT, 0, APC_FIELD_NOMINAL_POWER, 0),                    // UPS.PowerSummary.ConfigActivePower
+
+    // Timers and settings
+    U8 (0x10, FEAT, 0, APC_FIELD_BEEPER_STATUS, 0),
+    U8 (0x13, FEAT, 0, APC_FIELD_DELAY_BEFORE_REBOOT, 0),              // APCDelayBeforeReboot
+    U8 (0x14, FEAT, 0, APC_FIELD_DELAY_BEFORE_SHUTDOWN, 0),            // APCDelayBeforeShutdown
+    S16(0x15, FEAT, 0, APC_FIELD_SHUTDOWN_TIMER),                      // -1 = not active
+    U16(0x17, FEAT, 0, APC_FIELD_REBOOT_TIMER, 0),
+    U8 (0x18, FEAT, 0, APC_FIELD_SELF_TEST_RESULT, 0),
+    U16(0x60, FEAT, 0, APC_FIELD_FIRMWARE_VERSION, 0),
+};
+
+#undef U8
+#undef U16
+#undef S16
+#undef BIT
+#undef IN
+#undef FEAT
+
+#define COUNT(array) (sizeof(array) / sizeof(array[0]))
+
+//══════════════════════════════════════════════════════════════════════════════
+// POLL LISTS
+//══════════════════════════════════════════════════════════════════════════════
+
+// Back-UPS: Feature reports verified from NUT explore output
+static const uint8_t backups_poll_reports[] = {
+    // === CRITICAL REAL-TIME METRICS ===
+    0x09,  // Battery voltage (UPS.PowerSummary.Voltage) - 16-bit, /100 for V
+    0x31,  // Input voltage (UPS.Input.Voltage) - 16-bit
+    0x50,  // Load percentage (UPS.PowerConverter.PercentLoad) - 8-bit
+
+    // === BATTERY INFORMATION ===
+    0x08,  // Battery nominal voltage (UPS.PowerSummary.ConfigVoltage) - 16-bit (12V)
+    0x0F,  // Battery charge warning threshold (50%)
+    0x11,  // Battery charge low threshold (UPS.PowerSummary.RemainingCapacityLimit = 10%)
+    0x24,  // Battery runtime low threshold (UPS.Battery.RemainingTimeLimit = 120s)
+    0x17,  // Reboot timer (120s)
+    0x03,  // Battery chemistry type (reports code 4 = NiMH)
+    0x20,  // Battery manufacture date (UPS.Battery.ManufacturerDate)
+
+    // === INPUT POWER CONFIGURATION ===
+    0x30,  // Input nominal voltage (UPS.Input.ConfigVoltage) - 8-bit (120V)
+    0x32,  // Low voltage transfer point (88V)
+    0x33,  // High voltage transfer point (139V)
+    0x35,  // Input sensitivity (low/medium/high)
+    0x36,  // Input frequency (50/60Hz)
+
+    // === UPS CONFIGURATION ===
+    0x52,  // Real power nominal (600W)
+    0x15,  // Shutdown timer (-1 = not active)
+    0x10,  // Beeper status (enabled/disabled/muted)
+    0x18,  // Self-test result
+};
+
+//══════════════════════════════════════════════════════════════════════════════
+// PROFILES
+//══════════════════════════════════════════════════════════════════════════════
+
+static const apc_hid_profile_t profiles[] = {
+    {
+        .pid = APC_PID_BACKUPS,
+        .name = "Back-UPS",
+        .usages = backups_layout,
+        .num_usages = COUNT(backups_layout),
+        .poll_reports = backups_poll_reports,
+        .num_poll_reports = COUNT(backups_poll_reports),
+    },
+    {
+        // Smart-UPS report IDs differ between firmware families, so there is
+        // no built-in layout to fall back on or fill gaps from: decode and
+        // poll exactly what the report descriptor declares
+        .pid = APC_PID_SMARTUPS,
+        .name = "Smart-UPS",
+        .usages = NULL,
+        .num_usages = 0,
+        .poll_reports = NULL,
+        .num_poll_reports = 0,
+    },
+};
+
+const apc_hid_profile_t* apc_hid_profile_for_pid(uint16_t pid)
+{
+    for (size_t i = 0; i < COUNT(profiles); i++) {
+        if (profiles[i].pid == pid) {
+            return &profiles[i];
+        }
+    }
+    return NULL;
+}
+
+const apc_hid_profile_t* apc_hid_default_profile(void)
+{
+    return &profiles[0];
+}
@@ -0,0 +1,111 @@
+/*
+ * Rolling-window statistics
+ *
+ * Each window is a ring of buckets holding the count, sum, sum of squares,
+ * min and max of the samples received during one bucket period. A sample
+ * only touches the current bucket of each window, recycling it if it still
+ * holds an older period, so adding is constant time and memory is fixed.
+ * A summary merges the buckets still inside the window: the current,
+ * partial bucket plus the previous (num_buckets - 1) periods.
+ */
+
+#include "apc_hid_stats.h"
+#include <string.h>
+#include <math.h>
+
+const apc_field_t apc_hid_stats_fields[APC_STATS_NUM_FIELDS] = {
+    APC_FIELD_INPUT_VOLTAGE,
+    APC_FIELD_LOAD_PERCENT,
+    APC_FIELD_BATTERY_VOLTAGE,
+};
+
+typedef struct {
+    int64_t bucket_us;
+    uint8_t num_buckets;
+    uint8_t first;               // Offset in apc_hid_stats_t.buckets[row]
+} stats_window_t;
+
+static const stats_window_t windows[APC_STATS_WINDOW_COUNT] = {
+    [APC_STATS_1M]  = { 10 * 1000000LL,  6,  0 },
+    [APC_STATS_15M] = { 60 * 1000000LL,  15, 6 },
+    [APC_STATS_1H]  = { 300 * 1000000LL, 12, 21 },
+};
+
+int apc_hid_stats_index(apc_field_t field)
+{
+    for (int i = 0; i < APC_STATS_NUM_FIELDS; i++) {
+        if (apc_hid_stats_fields[i] == field) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void apc_hid_stats_reset(apc_hid_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void apc_hid_stats_add(apc_hid_stats_t *stats, int index, int32_t value, int64_t now_us)
+{
+    for (int w = 0; w < APC_STATS_WINDOW_COUNT; w++) {
+        const stats_window_t *win = &windows[w];
+        uint32_t epoch = (uint32_t)(now_us / win->bucket_us) + 1;
+        apc_stats_bucket_t *b = &stats->buckets[index][win->first + epoch % win->num_buckets];
+
+        if (b->epoch != epoch) {
+            b->epoch = epoch;
+            b->sum = 0;
+            b->sum_sq = 0;
+            b->min = value;
+            b->max = value;
+            b->count = 0;
+        }
+        b->sum += value;
+        b->sum_sq += (int64_t)value * value;
+        if (value < b->min) {
+            b->min = value;
+        }
+        if (value > b->max) {
+            b->max = value;
+        }
+        b->count++;
+    }
+}
+
+void apc_hid_stats_summarize(const apc_hid_stats_t *stats, int index, int64_t now_us,
+                             apc_stats_summary_t out[APC_STATS_WINDOW_COUNT])
+{
+    for (int w = 0; w < APC_STATS_WINDOW_COUNT; w++) {
+        const stats_window_t *win = &windows[w];
+        uint32_t epoch = (uint32_t)(now_us / win->bucket_us) + 1;
+        apc_stats_summary_t *s = &out[w];
+        int64_t sum = 0;
+        int64_t sum_sq = 0;
+
+        memset(s, 0, sizeof(*s));
+        for (int i = 0; i < win->num_buckets; i++) {
+            const apc_stats_bucket_t *b = &stats->buckets[index][win->first + i];
+            if (b->count == 0 || b->epoch > epoch || epoch - b->epoch >= win->num_buckets) {
+                continue;
+            }
+            if (s->count == 0 || b->min < s->min) {
+                s->min = b->min;
+            }
+            if (s->count == 0 || b->max > s->max) {
+                s->max = b->max;
+            }
+            s->count += b->count;
+            sum += b->sum;
+            sum_sq += b->sum_sq;
+        }
+
+        if (s->count > 0) {
+            // n^2 * variance = n * sum(x^2) - sum(x)^2, exact in integers
+            int64_t n = s->count;
+            int64_t spread = n * sum_sq - sum * sum;
+            s->mean = (int32_t)llround((double)sum / n);
+            s->stddev = (int32_t)llround(sqrt((double)(spread > 0 ? spread : 0)) / n);
+        }
+    }
+}
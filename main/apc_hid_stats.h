@@ -0,0 +1,38 @@
+#ifndef APC_HID_STATS_H
+#define APC_HID_STATS_H
+
+#include "apc_hid_parser.h"
+
+// Fields with rolling statistics; the index is the row in apc_hid_stats_t
+extern const apc_field_t apc_hid_stats_fields[APC_STATS_NUM_FIELDS];
+
+// Row of `field` in apc_hid_stats_t, -1 if it has no statistics
+int apc_hid_stats_index(apc_field_t field);
+
+// Partial aggregate of the samples received during one bucket period
+typedef struct {
+    int64_t sum;
+    int64_t sum_sq;
+    int32_t min;
+    int32_t max;
+    uint32_t count;
+    uint32_t epoch;              // Bucket period + 1 (0 = empty)
+} apc_stats_bucket_t;
+
+// Buckets of all windows of one field: 6 x 10 s, 15 x 1 min, 12 x 5 min
+#define APC_STATS_NUM_BUCKETS (6 + 15 + 12)
+
+typedef struct {
+    apc_stats_bucket_t buckets[APC_STATS_NUM_FIELDS][APC_STATS_NUM_BUCKETS];
+} apc_hid_stats_t;
+
+void apc_hid_stats_reset(apc_hid_stats_t *stats);
+
+// Add one sample of row `index` at `now_us` (esp_timer time). Constant time.
+void apc_hid_stats_add(apc_hid_stats_t *stats, int index, int32_t value, int64_t now_us);
+
+// Summarize every window of row `index` as seen at `now_us`
+void apc_hid_stats_summarize(const apc_hid_stats_t *stats, int index, int64_t now_us,
+                             apc_stats_summary_t out[APC_STATS_WINDOW_COUNT]);
+
+#endif // APC_HID_STATS_H
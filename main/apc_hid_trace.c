@@ -0,0 +1,80 @@
+#include "apc_hid_trace.h"
+
+#if CONFIG_APC_HID_BINARY_TRACE
+
+#include <string.h>
+#include "esp_timer.h"
+
+#define TRACE_DEPTH CONFIG_APC_HID_BINARY_TRACE_DEPTH
+
+// Single writer (the USB task). A record is filled in place and only becomes
+// visible to readers once `head` is advanced past it.
+static apc_hid_trace_record_t ring[TRACE_DEPTH];
+static uint32_t head = 0;
+static apc_hid_trace_record_t *current = NULL;
+
+void apc_hid_trace_begin(uint8_t report_id, const uint8_t *data, size_t length)
+{
+    uint32_t seq = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    current = &ring[seq % TRACE_DEPTH];
+
+    current->seq = seq;
+    current->time_us = esp_timer_get_time();
+    current->report_id = report_id;
+    current->length = (length > 0xFF) ? 0xFF : (uint8_t)length;
+    current->num_fields = 0;
+    current->flags = 0;
+
+    size_t n = (length < APC_HID_TRACE_RAW_BYTES) ? length : APC_HID_TRACE_RAW_BYTES;
+    memcpy(current->raw, data, n);
+    memset(current->raw + n, 0, APC_HID_TRACE_RAW_BYTES - n);
+}
+
+void apc_hid_trace_field(uint8_t field, uint8_t arg, int32_t value)
+{
+    if (current == NULL || current->num_fields >= APC_HID_TRACE_MAX_FIELDS) {
+        return;
+    }
+    apc_hid_trace_field_t *f = &current->fields[current->num_fields++];
+    f->field = field;
+    f->arg = arg;
+    f->value = value;
+}
+
+void apc_hid_trace_end(void)
+{
+    if (current == NULL) {
+        return;
+    }
+    current = NULL;
+    __atomic_add_fetch(&head, 1, __ATOMIC_RELEASE);
+}
+
+size_t apc_hid_trace_copy(apc_hid_trace_record_t *out, size_t max_records)
+{
+    uint32_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    uint32_t count = (end < TRACE_DEPTH) ? end : TRACE_DEPTH;
+    if (count > max_records) {
+        count = max_records;
+    }
+    uint32_t start = end - count;
+
+    for (uint32_t i = 0; i < count; i++) {
+        out[i] = ring[(start + i) % TRACE_DEPTH];
+    }
+
+    // Drop records the writer may have overwritten while we were copying
+    // (it fills slot `head` before publishing it, hence the extra slot).
+    uint32_t now = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    uint32_t oldest_intact = (now + 1 > TRACE_DEPTH) ? now + 1 - TRACE_DEPTH : 0;
+    size_t skip = (oldest_intact > start) ? oldest_intact - start : 0;
+    if (skip >= count) {
+        return 0;
+    }
+    if (skip > 0) {
+        memmove(out, out + skip, (count - skip) * sizeof(*out));
+    }
+    return count - skip;
+}
+
+#endif // CONFIG_APC_HID_BINARY_TRACE
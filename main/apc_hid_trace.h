@@ -0,0 +1,90 @@
+#ifndef APC_HID_TRACE_H
+#define APC_HID_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+//══════════════════════════════════════════════════════════════════════════════
+// TEXT TRACE (compile-time level, Kconfig: APC_HID_TRACE_LEVEL)
+//══════════════════════════════════════════════════════════════════════════════
+// 0 = none:    no per-report text at all, the macros compile to nothing
+// 1 = summary: one line per report
+// 2 = verbose: hex dump plus one line per decoded usage
+#define APC_HID_TRACE_NONE    0
+#define APC_HID_TRACE_SUMMARY 1
+#define APC_HID_TRACE_VERBOSE 2
+
+#ifndef CONFIG_APC_HID_TRACE_LEVEL
+#define CONFIG_APC_HID_TRACE_LEVEL APC_HID_TRACE_NONE
+#endif
+
+#if CONFIG_APC_HID_TRACE_LEVEL >= APC_HID_TRACE_SUMMARY
+#define APC_HID_TRACE_S(tag, fmt, ...) ESP_LOGI(tag, fmt, ##__VA_ARGS__)
+#else
+#define APC_HID_TRACE_S(tag, fmt, ...) do { } while (0)
+#endif
+
+#if CONFIG_APC_HID_TRACE_LEVEL >= APC_HID_TRACE_VERBOSE
+#define APC_HID_TRACE_V(tag, fmt, ...) ESP_LOGI(tag, fmt, ##__VA_ARGS__)
+#else
+#define APC_HID_TRACE_V(tag, fmt, ...) do { } while (0)
+#endif
+
+//══════════════════════════════════════════════════════════════════════════════
+// BINARY TRACE (Kconfig: APC_HID_BINARY_TRACE)
+//══════════════════════════════════════════════════════════════════════════════
+// Records the report ID, raw bytes and decoded raw values of each report in a
+// RAM ring without formatting any text. Download from GET /hidtrace.
+
+#define APC_HID_TRACE_RAW_BYTES  16
+#define APC_HID_TRACE_MAX_FIELDS 8
+
+typedef struct {
+    uint8_t field;               // apc_field_t
+    uint8_t arg;
+    uint16_t reserved;
+    int32_t value;               // Raw logical value, before the unit exponent
+} apc_hid_trace_field_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t reserved;
+    int64_t time_us;
+    uint8_t report_id;
+    uint8_t length;              // Full report length; raw[] keeps the first 16 bytes
+    uint8_t num_fields;
+    uint8_t flags;
+    uint8_t raw[APC_HID_TRACE_RAW_BYTES];
+    apc_hid_trace_field_t fields[APC_HID_TRACE_MAX_FIELDS];
+} apc_hid_trace_record_t;
+
+#if CONFIG_APC_HID_BINARY_TRACE
+
+void apc_hid_trace_begin(uint8_t report_id, const uint8_t *data, size_t length);
+void apc_hid_trace_field(uint8_t field, uint8_t arg, int32_t value);
+void apc_hid_trace_end(void);
+
+// Copy the newest records (oldest first). Returns the number copied.
+size_t apc_hid_trace_copy(apc_hid_trace_record_t *out, size_t max_records);
+
+#else
+
+static inline void apc_hid_trace_begin(uint8_t report_id, const uint8_t *data, size_t length)
+{
+    (void)report_id;
+    (void)data;
+    (void)length;
+}
+static inline void apc_hid_trace_field(uint8_t field, uint8_t arg, int32_t value)
+{
+    (void)field;
+    (void)arg;
+    (void)value;
+}
+static inline void apc_hid_trace_end(void) { }
+
+#endif // CONFIG_APC_HID_BINARY_TRACE
+
+#endif // APC_HID_TRACE_H
@@ -0,0 +1,468 @@
+/*
+ * HID report descriptor compiler
+ *
+ * Walks the short items of a HID report descriptor (HID 1.11 §6.2.2), tracks
+ * the global/local item state and the collection stack, and emits one
+ * apc_hid_usage_t for every Input or Feature field whose usage we know how to
+ * store. The result is a flat table the parser can walk per report without
+ * any knowledge of report IDs, offsets or scale factors.
+ *
+ * Usage names follow the USB HID Power Device spec (pages 0x84 and 0x85).
+ */
+
+#include "apc_hid_usage.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "apc_hid_usage";
+
+// Item types and tags (HID 1.11 §6.2.2.4 - §6.2.2.8)
+#define ITEM_TYPE_MAIN   0
+#define ITEM_TYPE_GLOBAL 1
+#define ITEM_TYPE_LOCAL  2
+
+#define MAIN_INPUT           0x8
+#define MAIN_OUTPUT          0x9
+#define MAIN_COLLECTION      0xA
+#define MAIN_FEATURE         0xB
+#define MAIN_END_COLLECTION  0xC
+
+#define GLOBAL_USAGE_PAGE    0x0
+#define GLOBAL_LOGICAL_MIN   0x1
+#define GLOBAL_LOGICAL_MAX   0x2
+#define GLOBAL_UNIT_EXPONENT 0x5
+#define GLOBAL_UNIT          0x6
+#define GLOBAL_REPORT_SIZE   0x7
+#define GLOBAL_REPORT_ID     0x8
+#define GLOBAL_REPORT_COUNT  0x9
+#define GLOBAL_PUSH          0xA
+#define GLOBAL_POP           0xB
+
+#define LOCAL_USAGE          0x0
+#define LOCAL_USAGE_MIN      0x1
+#define LOCAL_USAGE_MAX      0x2
+
+#define LONG_ITEM_PREFIX     0xFE
+
+// Main item data bits
+#define MAIN_FLAG_CONSTANT   0x01
+#define MAIN_FLAG_VARIABLE   0x02
+
+// SI linear units that carry a hidden 10^7 factor (g·cm² instead of kg·m²)
+#define HID_UNIT_VOLT        0x00F0D121
+#define HID_UNIT_WATT        0x0000D121
+
+// Extended usages: (page << 16) | id
+#define PD(id)  (0x00840000u | (id))    // Power Device page
+#define BS(id)  (0x00850000u | (id))    // Battery System page
+
+#define USAGE_PRESENT_STATUS   PD(0x02)
+#define USAGE_CHANGED_STATUS   PD(0x03)
+#define USAGE_BATTERY          PD(0x12)
+#define USAGE_POWER_CONVERTER  PD(0x16)
+#define USAGE_INPUT            PD(0x1A)
+#define USAGE_OUTPUT           PD(0x1C)
+#define USAGE_POWER_SUMMARY    PD(0x24)
+
+#define MAX_LOCAL_USAGES  16
+#define MAX_COLLECTIONS   8
+#define MAX_GLOBAL_STACK  4
+#define MAX_REPORTS       48
+
+// Usage → field mapping. context = innermost enclosing collection that must
+// match (0 = any collection).
+typedef struct {
+    uint32_t usage;
+    uint32_t context;
+    uint8_t  field;
+    uint8_t  arg;
+} usage_map_t;
+
+static const usage_map_t usage_map[] = {
+    // Battery
+    { BS(0x66), 0,                    APC_FIELD_BATTERY_CHARGE,                0 },  // RemainingCapacity
+    { BS(0x68), 0,                    APC_FIELD_BATTERY_RUNTIME,               0 },  // RunTimeToEmpty
+    { PD(0x30), USAGE_POWER_SUMMARY,  APC_FIELD_BATTERY_VOLTAGE,               0 },  // Voltage
+    { PD(0x30), USAGE_BATTERY,        APC_FIELD_BATTERY_VOLTAGE,               0 },
+    { PD(0x40), USAGE_POWER_SUMMARY,  APC_FIELD_BATTERY_NOMINAL_VOLTAGE,       0 },  // ConfigVoltage
+    { PD(0x40), USAGE_BATTERY,        APC_FIELD_BATTERY_NOMINAL_VOLTAGE,       0 },
+    { BS(0x8C), 0,                    APC_FIELD_BATTERY_WARNING_THRESHOLD,     0 },  // WarningCapacityLimit
+    { BS(0x29), 0,                    APC_FIELD_LOW_BATTERY_CHARGE_THRESHOLD,  0 },  // RemainingCapacityLimit
+    { BS(0x2A), 0,                    APC_FIELD_LOW_BATTERY_RUNTIME_THRESHOLD, 0 },  // RemainingTimeLimit
+    { BS(0x85), 0,                    APC_FIELD_BATTERY_MFR_DATE,              0 },  // ManufacturerDate
+    { BS(0x89), 0,                    APC_FIELD_BATTERY_TYPE,                  0 },  // iDeviceChemistry
+
+    // Input / output
+    { PD(0x30), USAGE_INPUT,          APC_FIELD_INPUT_VOLTAGE,                 0 },  // Voltage
+    { PD(0x40), USAGE_INPUT,          APC_FIELD_INPUT_VOLTAGE_NOMINAL,         0 },  // ConfigVoltage
+    { PD(0x32), USAGE_INPUT,          APC_FIELD_INPUT_FREQUENCY,               0 },  // Frequency
+    { PD(0x53), 0,                    APC_FIELD_LOW_VOLTAGE_TRANSFER,          0 },  // LowVoltageTransfer
+    { PD(0x54), 0,                    APC_FIELD_HIGH_VOLTAGE_TRANSFER,         0 },  // HighVoltageTransfer
+    { PD(0x30), USAGE_OUTPUT,         APC_FIELD_OUTPUT_VOLTAGE,                0 },  // Voltage
+    { PD(0x35), 0,                    APC_FIELD_LOAD_PERCENT,                  0 },  // PercentLoad
+    { PD(0x44), 0,                    APC_FIELD_NOMINAL_POWER,                 0 },  // ConfigActivePower
+    { PD(0x43), 0,                    APC_FIELD_NOMINAL_APPARENT_POWER,        0 },  // ConfigApparentPower
+
+    // Timers and settings
+    { PD(0x57), 0,                    APC_FIELD_SHUTDOWN_TIMER,                0 },  // DelayBeforeShutdown
+    { PD(0x55), 0,                    APC_FIELD_REBOOT_TIMER,                  0 },  // DelayBeforeReboot
+    { PD(0x5A), 0,                    APC_FIELD_BEEPER_STATUS,                 0 },  // AudibleAlarmControl
+    { PD(0x58), 0,                    APC_FIELD_SELF_TEST_RESULT,              0 },  // Test
+
+    // PresentStatus bits (ChangedStatus carries the same usages, so match the collection)
+    { BS(0xD0), USAGE_PRESENT_STATUS, APC_FIELD_STATUS, APC_STATUS_ONLINE          },  // ACPresent
+    { BS(0x45), USAGE_PRESENT_STATUS, APC_FIELD_STATUS, APC_STATUS_DISCHARGING     },  // Discharging
+    { BS(0x44), USAGE_PRESENT_STATUS, APC_FIELD_STATUS, APC_STATUS_CHARGING        },  // Charging
+    { BS(0x42), USAGE_PRESENT_STATUS, APC_FIELD_STATUS, APC_STATUS_LOW_BATTERY     },  // BelowRemainingCapacityLimit
+    { PD(0x65), USAGE_PRESENT_STATUS, APC_FIELD_STATUS, APC_STATUS_OVERLOAD        },  // Overload
+    { BS(0x4B), USAGE_PRESENT_STATUS, APC_FIELD_STATUS, APC_STATUS_REPLACE_BATTERY },  // NeedReplacement
+    { PD(0x6E), USAGE_PRESENT_STATUS, APC_FIELD_STATUS, APC_STATUS_BOOST           },  // Boost
+    { PD(0x6F), USAGE_PRESENT_STATUS, APC_FIELD_STATUS, APC_STATUS_TRIM            },  // Buck
+};
+
+// Collections that give a usage its meaning
+static const uint32_t context_usages[] = {
+    USAGE_PRESENT_STATUS, USAGE_CHANGED_STATUS, USAGE_BATTERY, USAGE_POWER_CONVERTER,
+    USAGE_INPUT, USAGE_OUTPUT, USAGE_POWER_SUMMARY,
+};
+
+typedef struct {
+    uint32_t usage_page;
+    int32_t logical_min;
+    int32_t logical_max;
+    uint32_t logical_max_unsigned;
+    int8_t unit_exponent;
+    uint32_t unit;
+    uint32_t report_size;
+    uint32_t report_count;
+    uint8_t report_id;
+} global_state_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t id;
+    uint16_t bits;
+} report_cursor_t;
+
+static apc_field_t map_usage(uint32_t usage, uint32_t context, uint8_t *arg)
+{
+    for (size_t i = 0; i < sizeof(usage_map) / sizeof(usage_map[0]); i++) {
+        if (usage_map[i].usage == usage &&
+            (usage_map[i].context == 0 || usage_map[i].context == context)) {
+            *arg = usage_map[i].arg;
+            return (apc_field_t)usage_map[i].field;
+        }
+    }
+    return APC_FIELD_NONE;
+}
+
+static uint32_t innermost_context(const uint32_t *collections, int depth)
+{
+    for (int d = depth - 1; d >= 0; d--) {
+        for (size_t i = 0; i < sizeof(context_usages) / sizeof(context_usages[0]); i++) {
+            if (collections[d] == context_usages[i]) {
+                return collections[d];
+            }
+        }
+    }
+    return 0;
+}
+
+static uint16_t *report_cursor(report_cursor_t *cursors, int *num_cursors, uint8_t type, uint8_t id)
+{
+    for (int i = 0; i < *num_cursors; i++) {
+        if (cursors[i].type == type && cursors[i].id == id) {
+            return &cursors[i].bits;
+        }
+    }
+    if (*num_cursors >= MAX_REPORTS) {
+        return NULL;
+    }
+    cursors[*num_cursors] = (report_cursor_t){ .type = type, .id = id, .bits = 0 };
+    return &cursors[(*num_cursors)++].bits;
+}
+
+// Unit exponent is a 4-bit two's complement nibble, but some devices send a full signed byte
+static int8_t decode_unit_exponent(uint32_t udata, int32_t sdata, size_t size)
+{
+    if (size == 1 && udata <= 0x0F) {
+        return (int8_t)((udata & 0x08) ? (int32_t)udata - 16 : (int32_t)udata);
+    }
+    return (int8_t)sdata;
+}
+
+// Correct the exponent for SI units that hide a 10^7 factor. Devices that
+// follow the spec send 7 (volts) or 5 (centivolts); ones that already send a
+// plain decimal exponent are left alone.
+static int8_t effective_exponent(const global_state_t *g)
+{
+    if ((g->unit == HID_UNIT_VOLT || g->unit == HID_UNIT_WATT) && g->unit_exponent >= 4) {
+        return (int8_t)(g->unit_exponent - 7);
+    }
+    return g->unit_exponent;
+}
+
+int apc_hid_usage_compile(const uint8_t *desc, size_t length, apc_hid_usage_table_t *table)
+{
+    global_state_t global = {0};
+    global_state_t global_stack[MAX_GLOBAL_STACK];
+    int global_depth = 0;
+
+    uint32_t usages[MAX_LOCAL_USAGES];
+    int num_usages = 0;
+    uint32_t usage_min = 0, usage_max = 0;
+    bool have_range = false;
+
+    uint32_t collections[MAX_COLLECTIONS];
+    int collection_depth = 0;
+
+    report_cursor_t cursors[MAX_REPORTS];
+    int num_cursors = 0;
+
+    apc_hid_usage_table_clear(table);
+
+    size_t pos = 0;
+    while (pos < length) {
+        uint8_t prefix = desc[pos++];
+
+        if (prefix == LONG_ITEM_PREFIX) {
+            if (pos + 2 > length) {
+                return -1;
+            }
+            pos += 2 + desc[pos];
+            continue;
+        }
+
+        size_t size = prefix & 0x03;
+        if (size == 3) {
+            size = 4;
+        }
+        if (pos + size > length) {
+            ESP_LOGW(TAG, "Truncated item at offset %u", (unsigned)(pos - 1));
+            return -1;
+        }
+
+        uint32_t udata = 0;
+        for (size_t i = 0; i < size; i++) {
+            udata |= (uint32_t)desc[pos + i] << (8 * i);
+        }
+        int32_t sdata = (int32_t)udata;
+        if (size == 1) {
+            sdata = (int8_t)udata;
+        } else if (size == 2) {
+            sdata = (int16_t)udata;
+        }
+        pos += size;
+
+        uint8_t type = (prefix >> 2) & 0x03;
+        uint8_t tag = prefix >> 4;
+
+        if (type == ITEM_TYPE_GLOBAL) {
+            switch (tag) {
+                case GLOBAL_USAGE_PAGE:    global.usage_page = udata; break;
+                case GLOBAL_LOGICAL_MIN:   global.logical_min = sdata; break;
+                case GLOBAL_LOGICAL_MAX:
+                    global.logical_max = sdata;
+                    global.logical_max_unsigned = udata;
+                    break;
+                case GLOBAL_UNIT_EXPONENT: global.unit_exponent = decode_unit_exponent(udata, sdata, size); break;
+                case GLOBAL_UNIT:          global.unit = udata; break;
+                case GLOBAL_REPORT_SIZE:   global.report_size = udata; break;
+                case GLOBAL_REPORT_ID:     global.report_id = (uint8_t)udata; break;
+                case GLOBAL_REPORT_COUNT:  global.report_count = udata; break;
+                case GLOBAL_PUSH:
+                    if (global_depth >= MAX_GLOBAL_STACK) return -1;
+                    global_stack[global_depth++] = global;
+                    break;
+                case GLOBAL_POP:
+                    if (global_depth == 0) return -1;
+                    global = global_stack[--global_depth];
+                    break;
+                default:
+                    break;
+            }
+            continue;
+        }
+
+        if (type == ITEM_TYPE_LOCAL) {
+            uint32_t usage = (size == 4) ? udata : ((global.usage_page << 16) | udata);
+            switch (tag) {
+                case LOCAL_USAGE:
+                    if (num_usages < MAX_LOCAL_USAGES) {
+                        usages[num_usages++] = usage;
+                    }
+                    break;
+                case LOCAL_USAGE_MIN: usage_min = usage; have_range = true; break;
+                case LOCAL_USAGE_MAX: usage_max = usage; have_range = true; break;
+                default: break;
+            }
+            continue;
+        }
+
+        if (type != ITEM_TYPE_MAIN) {
+            continue;
+        }
+
+        switch (tag) {
+            case MAIN_COLLECTION:
+                if (collection_depth >= MAX_COLLECTIONS) return -1;
+                collections[collection_depth++] = (num_usages > 0) ? usages[0] : 0;
+                break;
+
+            case MAIN_END_COLLECTION:
+                if (collection_depth > 0) collection_depth--;
+                break;
+
+            case MAIN_INPUT:
+            case MAIN_OUTPUT:
+            case MAIN_FEATURE: {
+                uint8_t report_type = (tag == MAIN_INPUT) ? APC_HID_REPORT_INPUT :
+                                      (tag == MAIN_OUTPUT) ? APC_HID_REPORT_OUTPUT :
+                                                             APC_HID_REPORT_FEATURE;
+                uint16_t *cursor = report_cursor(cursors, &num_cursors, report_type, global.report_id);
+                if (cursor == NULL) {
+                    ESP_LOGW(TAG, "Too many reports in descriptor");
+                    return -1;
+                }
+                table->declared[global.report_id / 8] |= (uint8_t)(1u << (global.report_id % 8));
+
+                bool mappable = report_type != APC_HID_REPORT_OUTPUT &&
+                                !(udata & MAIN_FLAG_CONSTANT) &&
+                                (udata & MAIN_FLAG_VARIABLE) &&
+                                global.report_size > 0 && global.report_size <= 32;
+
+                if (mappable) {
+                    uint32_t context = innermost_context(collections, collection_depth);
+                    int32_t logical_max = (global.logical_min >= 0 && global.logical_max < 0)
+                                          ? (int32_t)(global.logical_max_unsigned & 0x7FFFFFFF)
+                                          : global.logical_max;
+
+                    for (uint32_t i = 0; i < global.report_count; i++) {
+                        uint32_t usage;
+                        if (have_range && usage_min + i <= usage_max) {
+                            usage = usage_min + i;
+                        } else if (num_usages > 0) {
+                            usage = usages[(i < (uint32_t)num_usages) ? i : (uint32_t)num_usages - 1];
+                        } else {
+                            break;
+                        }
+
+                        uint8_t arg = 0;
+                        apc_field_t field = map_usage(usage, context, &arg);
+                        if (field == APC_FIELD_NONE) {
+                            continue;
+                        }
+
+                        apc_hid_usage_t entry = {
+                            .report_id = global.report_id,
+                            .report_type = report_type,
+                            .bit_offset = (uint16_t)(*cursor + i * global.report_size),
+                            .bit_size = (uint8_t)global.report_size,
+                            .field = (uint8_t)field,
+                            .arg = arg,
+                            .unit_exponent = effective_exponent(&global),
+                            .logical_min = global.logical_min,
+                            .logical_max = logical_max,
+                        };
+                        if (!apc_hid_usage_table_add(table, &entry)) {
+                            ESP_LOGW(TAG, "Usage table full, dropping %s in report 0x%02X",
+                                     apc_hid_field_name(field), global.report_id);
+                        }
+                    }
+                }
+
+                *cursor += (uint16_t)(global.report_size * global.report_count);
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        // Local items only apply to the main item that follows them
+        num_usages = 0;
+        have_range = false;
+    }
+
+    apc_hid_usage_table_index(table);
+    return table->count;
+}
+
+void apc_hid_usage_table_clear(apc_hid_usage_table_t *table)
+{
+    table->count = 0;
+    memset(table->first, APC_HID_NO_USAGE, sizeof(table->first));
+    memset(table->num, 0, sizeof(table->num));
+    memset(table->declared, 0, sizeof(table->declared));
+}
+
+bool apc_hid_usage_table_add(apc_hid_usage_table_t *table, const apc_hid_usage_t *usage)
+{
+    // The same value is often declared both as an Input and a Feature item
+    for (int i = 0; i < table->count; i++) {
+        const apc_hid_usage_t *u = &table->usages[i];
+        if (u->report_id == usage->report_id && u->field == usage->field && u->arg == usage->arg) {
+            return true;
+        }
+    }
+    if (table->count >= APC_HID_MAX_USAGES) {
+        return false;
+    }
+    table->usages[table->count++] = *usage;
+    return true;
+}
+
+bool apc_hid_usage_table_has_field(const apc_hid_usage_table_t *table, apc_field_t field, uint8_t arg)
+{
+    for (int i = 0; i < table->count; i++) {
+        if (table->usages[i].field == field && table->usages[i].arg == arg) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool apc_hid_usage_table_declares(const apc_hid_usage_table_t *table, uint8_t report_id)
+{
+    return (table->declared[report_id / 8] >> (report_id % 8)) & 1;
+}
+
+bool apc_hid_usage_table_fits(const apc_hid_usage_table_t *table, const apc_hid_usage_t *usage)
+{
+    if (!apc_hid_usage_table_declares(table, usage->report_id)) {
+        return false;
+    }
+    for (int i = 0; i < table->count; i++) {
+        const apc_hid_usage_t *u = &table->usages[i];
+        if (u->report_id == usage->report_id &&
+            u->bit_offset < usage->bit_offset + usage->bit_size &&
+            usage->bit_offset < u->bit_offset + u->bit_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void apc_hid_usage_table_index(apc_hid_usage_table_t *table)
+{
+    // Stable insertion sort by report ID keeps descriptor order within a report
+    for (int i = 1; i < table->count; i++) {
+        apc_hid_usage_t key = table->usages[i];
+        int j = i - 1;
+        while (j >= 0 && table->usages[j].report_id > key.report_id) {
+            table->usages[j + 1] = table->usages[j];
+            j--;
+        }
+        table->usages[j + 1] = key;
+    }
+
+    memset(table->first, APC_HID_NO_USAGE, sizeof(table->first));
+    memset(table->num, 0, sizeof(table->num));
+    for (int i = 0; i < table->count; i++) {
+        uint8_t id = table->usages[i].report_id;
+        if (table->first[id] == APC_HID_NO_USAGE) {
+            table->first[id] = (uint8_t)i;
+        }
+        table->num[id]++;
+    }
+}
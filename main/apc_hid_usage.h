@@ -0,0 +1,23 @@
+#ifndef APC_HID_USAGE_H
+#define APC_HID_USAGE_H
+
+#include "apc_hid_parser.h"
+
+// Compile a HID report descriptor into a usage table.
+// Only Input and Feature items with a known HID Power Device usage are kept.
+// Returns the number of usages compiled, or -1 if the descriptor is malformed.
+int apc_hid_usage_compile(const uint8_t *desc, size_t length, apc_hid_usage_table_t *table);
+
+// Table helpers
+void apc_hid_usage_table_clear(apc_hid_usage_table_t *table);
+bool apc_hid_usage_table_add(apc_hid_usage_table_t *table, const apc_hid_usage_t *usage);
+bool apc_hid_usage_table_has_field(const apc_hid_usage_table_t *table, apc_field_t field, uint8_t arg);
+// True if the compiled descriptor declares `report_id` (Input, Output or
+// Feature), whether or not any of its values are mapped
+bool apc_hid_usage_table_declares(const apc_hid_usage_table_t *table, uint8_t report_id);
+// True if `usage` lands in a report the compiled descriptor declares without
+// overlapping a value it already maps there
+bool apc_hid_usage_table_fits(const apc_hid_usage_table_t *table, const apc_hid_usage_t *usage);
+void apc_hid_usage_table_index(apc_hid_usage_table_t *table);
+
+#endif // APC_HID_USAGE_H
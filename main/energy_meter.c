@@ -0,0 +1,181 @@
+/*
+ * Output energy accumulator
+ *
+ * Between two output power samples (APC_FIELD_OUTPUT_POWER, derived from
+ * load% x nominal W whenever either arrives) the UPS load is taken as
+ * constant, so each sample closes an interval of W x elapsed time. Intervals
+ * longer than the stale limit or two poll intervals, whichever is longer
+ * (USB unplugged, UPS silent), are not counted. On models where load is a
+ * Feature report (Back-UPS 0x50) it arrives once per UPS Poll Interval, not
+ * at the interrupt report rate, and the gap limit must allow for that.
+ * Energy is kept as an integer count of mWh plus a sub-mWh remainder, so
+ * nothing drifts however long the bridge runs.
+ *
+ * Checkpoints: NVS appends a new entry for every write and erases a 4 KB
+ * page only once it is full, so wear scales with the number of writes. A
+ * checkpoint is written only when at least CHECKPOINT_MWH have accumulated
+ * AND CHECKPOINT_INTERVAL_US have passed (at most ~144 writes a day, a few
+ * page erases a week), plus once when the UPS goes on battery (the bridge
+ * may lose power next) and on esp_restart(). A crash loses at most the
+ * energy since the last checkpoint; the total never goes backwards.
+ */
+
+#include "energy_meter.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+
+static const char *TAG = "energy";
+
+#define NVS_NAMESPACE          "energy"
+#define NVS_KEY_TOTAL          "total_mwh"
+
+#define CHECKPOINT_MWH         10000                    // 10 Wh
+#define CHECKPOINT_INTERVAL_US (10 * 60 * 1000000LL)    // 10 min
+
+// 1 mWh = 3.6 W·s = 3.6e6 W·µs
+#define W_US_PER_MWH           3600000LL
+
+#define STALE_US               (CONFIG_UPS_STALE_AFTER_MS * 1000LL)
+#define POLL_GAP_US            (2 * CONFIG_UPS_POLL_INTERVAL_MS * 1000LL)
+#define MAX_INTERVAL_US        (STALE_US > POLL_GAP_US ? STALE_US : POLL_GAP_US)
+
+static SemaphoreHandle_t energy_mutex = NULL;
+
+static uint64_t total_mwh = 0;
+static int64_t remainder_w_us = 0;
+
+static int32_t output_watts = -1;                       // Held since load_time_us
+static int64_t load_time_us = 0;
+static bool on_battery = false;
+
+static uint64_t saved_mwh = 0;
+static int64_t saved_time_us = 0;
+
+// Caller holds energy_mutex
+static esp_err_t write_checkpoint(void)
+{
+    if (total_mwh == saved_mwh) {
+        return ESP_OK;
+    }
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_u64(nvs, NVS_KEY_TOTAL, total_mwh);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+
+    if (err == ESP_OK) {
+        saved_mwh = total_mwh;
+        saved_time_us = esp_timer_get_time();
+        ESP_LOGD(TAG, "Checkpoint: %llu mWh", total_mwh);
+    } else {
+        ESP_LOGW(TAG, "Checkpoint failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+static void energy_shutdown_handler(void)
+{
+    energy_meter_checkpoint();
+}
+
+esp_err_t energy_meter_init(void)
+{
+    energy_mutex = xSemaphoreCreateMutex();
+    if (energy_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create energy mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        nvs_get_u64(nvs, NVS_KEY_TOTAL, &total_mwh);
+        nvs_close(nvs);
+    }
+    saved_mwh = total_mwh;
+    saved_time_us = esp_timer_get_time();
+
+    esp_register_shutdown_handler(energy_shutdown_handler);
+    ESP_LOGI(TAG, "⚡ Output energy: %llu.%03llu kWh (from NVS)",
+             total_mwh / 1000000, (total_mwh / 1000) % 1000);
+    return ESP_OK;
+}
+
+void energy_meter_sample(apc_field_t field, int32_t value)
+{
+    if (energy_mutex == NULL) {
+        return;
+    }
+
+    switch (field) {
+    case APC_FIELD_STATUS: {
+        // Status samples carry the PresentStatus bits
+        bool was_on_battery = on_battery;
+        on_battery = !(value & APC_STATUS_BIT(APC_STATUS_ONLINE));
+        if (on_battery && !was_on_battery) {
+            energy_meter_checkpoint();
+        }
+        return;
+    }
+
+    case APC_FIELD_OUTPUT_POWER:
+        break;
+
+    default:
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+
+    xSemaphoreTake(energy_mutex, portMAX_DELAY);
+    int64_t elapsed_us = now_us - load_time_us;
+    if (output_watts > 0 && load_time_us != 0 && elapsed_us <= MAX_INTERVAL_US) {
+        remainder_w_us += (int64_t)output_watts * elapsed_us;
+        total_mwh += remainder_w_us / W_US_PER_MWH;
+        remainder_w_us %= W_US_PER_MWH;
+    }
+    output_watts = value;
+    load_time_us = now_us;
+
+    if (total_mwh - saved_mwh >= CHECKPOINT_MWH && now_us - saved_time_us >= CHECKPOINT_INTERVAL_US) {
+        write_checkpoint();
+    }
+    xSemaphoreGive(energy_mutex);
+}
+
+uint64_t energy_meter_total_mwh(void)
+{
+    if (energy_mutex == NULL) {
+        return 0;
+    }
+    xSemaphoreTake(energy_mutex, portMAX_DELAY);
+    uint64_t total = total_mwh;
+    xSemaphoreGive(energy_mutex);
+    return total;
+}
+
+int energy_meter_format_kwh(char *buffer, size_t buffer_size)
+{
+    uint64_t total = energy_meter_total_mwh();
+    return snprintf(buffer, buffer_size, "%llu.%03llu", total / 1000000, (total / 1000) % 1000);
+}
+
+esp_err_t energy_meter_checkpoint(void)
+{
+    if (energy_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(energy_mutex, portMAX_DELAY);
+    esp_err_t err = write_checkpoint();
+    xSemaphoreGive(energy_mutex);
+    return err;
+}
@@ -0,0 +1,28 @@
+#ifndef ENERGY_METER_H
+#define ENERGY_METER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "apc_hid_parser.h"
+
+// Cumulative output energy, integrated on the device from every load report
+// and checkpointed to NVS so it keeps counting across reboots.
+
+// Load the last checkpoint (call after nvs_flash_init)
+esp_err_t energy_meter_init(void);
+
+// Parser sample hook: output power and status samples drive the
+// integration; other fields are ignored
+void energy_meter_sample(apc_field_t field, int32_t value);
+
+// Total output energy in mWh, never decreasing
+uint64_t energy_meter_total_mwh(void);
+
+// Format the total as kWh with Wh resolution ("12.345")
+int energy_meter_format_kwh(char *buffer, size_t buffer_size);
+
+// Write the total to NVS now
+esp_err_t energy_meter_checkpoint(void);
+
+#endif // ENERGY_METER_H
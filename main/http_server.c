@@ -1,10 +1,20 @@
 #include "http_server.h"
 #include "apc_hid_parser.h"
+#include "apc_hid_trace.h"
+#include "usb_trace.h"
 #include "usb_host_manager.h"
+#include "telemetry.h"
+#include "energy_meter.h"
+#include "runtime_learner.h"
+#include "soh_estimator.h"
+#include "power_quality.h"
+#include "report_scheduler.h"
 #include "wifi_manager.h"
 #include "esp_http_server.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_system.h"
+#include "esp_heap_caps.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "freertos/FreeRTOS.h"
@@ -12,6 +22,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/time.h>
 
 static const char *TAG = "http_server";
 
@@ -26,6 +37,7 @@ static SemaphoreHandle_t log_mutex = NULL;
 static vprintf_like_t    original_vprintf_fn = NULL;
 
 static app_config_t *current_config = NULL;
+static apc_hid_parser_t *ups_parser = NULL;
 
 static int capture_vprintf(const char *fmt, va_list args)
 {
@@ -265,48 +277,116 @@ static esp_err_t status_handler(httpd_req_t *req)
     send_page_header(req, "APC UPS Status", true);
 
     /* UPS Metrics */
-    const ups_metrics_t *m = apc_hid_get_metrics();
+    ups_metrics_t snapshot;
+    apc_hid_get_snapshot(ups_parser, &snapshot);
+    const ups_metrics_t *m = &snapshot;
 
     httpd_resp_sendstr_chunk(req,
         "<div class='card'><h2>UPS Metrics</h2><table>");
 
     if (m->valid) {
+        char charge[16], volts[16], runtime[16], input[16], load[16];
+        apc_hid_format_field(m, APC_FIELD_BATTERY_CHARGE, charge, sizeof(charge));
+        apc_hid_format_field(m, APC_FIELD_BATTERY_VOLTAGE, volts, sizeof(volts));
+        apc_hid_format_field(m, APC_FIELD_BATTERY_RUNTIME, runtime, sizeof(runtime));
+        apc_hid_format_field(m, APC_FIELD_INPUT_VOLTAGE, input, sizeof(input));
+        apc_hid_format_field(m, APC_FIELD_LOAD_PERCENT, load, sizeof(load));
+
         snprintf(buf, sizeof(buf),
             "<tr><th>Status</th><td class='val %s'>%s</td></tr>"
-            "<tr><th>Battery Charge</th><td class='val'>%.0f%%</td></tr>"
-            "<tr><th>Battery Voltage</th><td class='val'>%.1f V</td></tr>"
-            "<tr><th>Battery Runtime</th><td class='val'>%.0f s (%.1f min)</td></tr>",
-            m->status.online ? "online" : "offline",
-            m->status_string,
-            m->battery_charge,
-            m->battery_voltage,
-            m->battery_runtime, m->battery_runtime / 60.0f);
+            "<tr><th>Battery Charge</th><td class='val'>%s%%</td></tr>"
+            "<tr><th>Battery Voltage</th><td class='val'>%s V</td></tr>"
+            "<tr><th>Battery Runtime</th><td class='val'>%s s (%.1f min)</td></tr>",
+            (m->status & APC_STATUS_BIT(APC_STATUS_ONLINE)) ? "online" : "offline",
+            apc_hid_status_string(m->status),
+            charge,
+            volts,
+            runtime, apc_hid_field_float(m, APC_FIELD_BATTERY_RUNTIME) / 60.0f);
         httpd_resp_sendstr_chunk(req, buf);
 
         snprintf(buf, sizeof(buf),
-            "<tr><th>Input Voltage</th><td class='val'>%.0f V</td></tr>"
-            "<tr><th>Load</th><td class='val'>%.0f%%</td></tr>",
-            m->input_voltage, m->load_percent);
+            "<tr><th>Input Voltage</th><td class='val'>%s V</td></tr>"
+            "<tr><th>Load</th><td class='val'>%s%%</td></tr>",
+            input, load);
+        httpd_resp_sendstr_chunk(req, buf);
+
+        /* Optional rows: label, field, unit suffix */
+        static const struct { const char *label; apc_field_t field; const char *suffix; } optional_rows[] = {
+            { "Output Power",  APC_FIELD_OUTPUT_POWER,          " W" },
+            { "Output VA",     APC_FIELD_OUTPUT_APPARENT_POWER, " VA" },
+            { "Headroom",      APC_FIELD_POWER_HEADROOM,        " W" },
+            { "Nominal Power", APC_FIELD_NOMINAL_POWER,         " W" },
+            { "Nominal Input", APC_FIELD_INPUT_VOLTAGE_NOMINAL, " V" },
+            { "Beeper",        APC_FIELD_BEEPER_STATUS,         ""   },
+        };
+        for (int i = 0; i < sizeof(optional_rows) / sizeof(optional_rows[0]); i++) {
+            apc_field_t field = optional_rows[i].field;
+            if (!apc_hid_field_present(m, field) || m->value[field] < 0 ||
+                (apc_hid_field_info(field)->kind == APC_KIND_NUMBER && m->value[field] == 0)) {
+                continue;
+            }
+            char value[32];
+            apc_hid_format_field(m, field, value, sizeof(value));
+            snprintf(buf, sizeof(buf),
+                "<tr><th>%s</th><td class='val'>%s%s</td></tr>",
+                optional_rows[i].label, value, optional_rows[i].suffix);
+            httpd_resp_sendstr_chunk(req, buf);
+        }
+
+        char energy[24];
+        energy_meter_format_kwh(energy, sizeof(energy));
+        snprintf(buf, sizeof(buf), "<tr><th>Output Energy</th><td class='val'>%s kWh</td></tr>", energy);
         httpd_resp_sendstr_chunk(req, buf);
 
-        if (m->nominal_power > 0) {
+        int32_t predicted = runtime_learner_predicted_runtime();
+        if (predicted >= 0) {
             snprintf(buf, sizeof(buf),
-                "<tr><th>Nominal Power</th><td class='val'>%.0f W</td></tr>",
-                m->nominal_power);
+                "<tr><th>Predicted Runtime</th><td class='val'>%ld s (%.1f min)</td></tr>",
+                (long)predicted, predicted / 60.0f);
             httpd_resp_sendstr_chunk(req, buf);
         }
-        if (m->input_voltage_nominal > 0) {
+
+        uint32_t pq_counts[POWER_EVENT_TYPE_COUNT];
+        power_quality_get_counts(pq_counts);
+        power_event_t pq_last;
+        if (power_quality_last_event(&pq_last)) {
+            char extreme[16];
+            apc_hid_format_fixed(APC_FIELD_INPUT_VOLTAGE, pq_last.extreme, extreme, sizeof(extreme));
             snprintf(buf, sizeof(buf),
-                "<tr><th>Nominal Input</th><td class='val'>%.0f V</td></tr>",
-                m->input_voltage_nominal);
+                "<tr><th>Power Events</th><td class='val'>%lu sag, %lu brownout, %lu swell, %lu outage "
+                "(last: %s, %lu ms, %s V)</td></tr>",
+                (unsigned long)pq_counts[POWER_EVENT_SAG], (unsigned long)pq_counts[POWER_EVENT_BROWNOUT],
+                (unsigned long)pq_counts[POWER_EVENT_SWELL], (unsigned long)pq_counts[POWER_EVENT_OUTAGE],
+                power_quality_type_name((power_event_type_t)pq_last.type),
+                (unsigned long)pq_last.duration_ms, extreme);
             httpd_resp_sendstr_chunk(req, buf);
         }
-        if (strlen(m->beeper_status) > 0) {
+
+        int32_t health = soh_estimator_health();
+        if (health >= 0) {
+            char replace[16];
+            bool projected = soh_estimator_replace_date(replace, sizeof(replace));
             snprintf(buf, sizeof(buf),
-                "<tr><th>Beeper</th><td class='val'>%s</td></tr>",
-                m->beeper_status);
+                "<tr><th>Battery Health</th><td class='val'>%ld%%%s%s</td></tr>",
+                (long)health, projected ? ", replace by " : "", projected ? replace : "");
             httpd_resp_sendstr_chunk(req, buf);
         }
+
+        /* Data age: the oldest field, and how many are past the stale limit */
+        int64_t now_us = esp_timer_get_time();
+        int64_t oldest_us = 0;
+        for (int f = 0; f < APC_FIELD_COUNT; f++) {
+            int64_t age_us = apc_hid_field_age_us(m, (apc_field_t)f, now_us);
+            if (age_us > oldest_us) {
+                oldest_us = age_us;
+            }
+        }
+        apc_field_mask_t stale = report_scheduler_stale_fields(m, CONFIG_UPS_STALE_AFTER_MS * 1000LL, now_us);
+        int num_stale = __builtin_popcountll(stale);
+        snprintf(buf, sizeof(buf),
+            "<tr><th>Oldest Value</th><td class='val %s'>%lld s (%d stale)</td></tr>",
+            num_stale > 0 ? "offline" : "", oldest_us / 1000000, num_stale);
+        httpd_resp_sendstr_chunk(req, buf);
     } else {
         httpd_resp_sendstr_chunk(req,
             "<tr><td colspan='2'>No valid UPS data available</td></tr>");
@@ -314,19 +394,126 @@ static esp_err_t status_handler(httpd_req_t *req)
 
     httpd_resp_sendstr_chunk(req, "</table></div>");
 
+    /* Rolling statistics */
+    if (m->valid) {
+        static const struct { const char *label; apc_field_t field; } stats_rows[] = {
+            { "Input Voltage",   APC_FIELD_INPUT_VOLTAGE   },
+            { "Load",            APC_FIELD_LOAD_PERCENT    },
+            { "Battery Voltage", APC_FIELD_BATTERY_VOLTAGE },
+        };
+        httpd_resp_sendstr_chunk(req,
+            "<div class='card'><h2>Statistics</h2><table>"
+            "<tr><th></th><th>Window</th><th>Mean</th><th>Std Dev</th><th>Min</th><th>Max</th></tr>");
+        for (int i = 0; i < sizeof(stats_rows) / sizeof(stats_rows[0]); i++) {
+            apc_stats_summary_t summary[APC_STATS_WINDOW_COUNT];
+            if (!apc_hid_get_field_stats(ups_parser, stats_rows[i].field, summary)) {
+                continue;
+            }
+            for (int w = 0; w < APC_STATS_WINDOW_COUNT; w++) {
+                const apc_stats_summary_t *st = &summary[w];
+                if (st->count == 0) {
+                    continue;
+                }
+                char mean[16], stddev[16], min[16], max[16];
+                apc_hid_format_fixed(stats_rows[i].field, st->mean, mean, sizeof(mean));
+                apc_hid_format_fixed(stats_rows[i].field, st->stddev, stddev, sizeof(stddev));
+                apc_hid_format_fixed(stats_rows[i].field, st->min, min, sizeof(min));
+                apc_hid_format_fixed(stats_rows[i].field, st->max, max, sizeof(max));
+                snprintf(buf, sizeof(buf),
+                    "<tr><th>%s</th><td>%s</td><td class='val'>%s</td><td>%s</td><td>%s</td><td>%s</td></tr>",
+                    w == 0 ? stats_rows[i].label : "", apc_hid_stats_window_name((apc_stats_window_t)w),
+                    mean, stddev, min, max);
+                httpd_resp_sendstr_chunk(req, buf);
+            }
+        }
+        httpd_resp_sendstr_chunk(req, "</table></div>");
+    }
+
+    /* Day-long distributions */
+    static const struct { const char *label; telemetry_metric_t metric; } dist_rows[] = {
+        { "Input Voltage",        TELEMETRY_INPUT_VOLTAGE   },
+        { "USB Round Trip",       TELEMETRY_USB_RTT         },
+        { "MQTT Publish Latency", TELEMETRY_PUBLISH_LATENCY },
+    };
+    static const float dist_q[] = { 0.50f, 0.95f, 0.99f };
+    httpd_resp_sendstr_chunk(req,
+        "<div class='card'><h2>Distributions (24 h)</h2><table>"
+        "<tr><th></th><th>p50</th><th>p95</th><th>p99</th><th>Samples</th></tr>");
+    for (int i = 0; i < sizeof(dist_rows) / sizeof(dist_rows[0]); i++) {
+        int32_t q[3];
+        uint32_t count = telemetry_quantiles(dist_rows[i].metric, dist_q, 3, q);
+        if (count == 0) {
+            continue;
+        }
+        char p50[16], p95[16], p99[16];
+        telemetry_format(dist_rows[i].metric, q[0], p50, sizeof(p50));
+        telemetry_format(dist_rows[i].metric, q[1], p95, sizeof(p95));
+        telemetry_format(dist_rows[i].metric, q[2], p99, sizeof(p99));
+        const char *unit = telemetry_unit(dist_rows[i].metric);
+        snprintf(buf, sizeof(buf),
+            "<tr><th>%s</th><td class='val'>%s %s</td><td>%s %s</td><td>%s %s</td><td>%lu</td></tr>",
+            dist_rows[i].label, p50, unit, p95, unit, p99, unit, (unsigned long)count);
+        httpd_resp_sendstr_chunk(req, buf);
+    }
+    httpd_resp_sendstr_chunk(req, "</table></div>");
+
     /* Connection Info */
+    apc_hid_cache_stats_t cache;
+    apc_hid_get_cache_stats(ups_parser, &cache);
+    uint32_t reports = cache.hits + cache.misses;
+    apc_hid_filter_stats_t filter;
+    apc_hid_get_filter_stats(ups_parser, &filter);
+    usb_transfer_stats_t transfers;
+    usb_host_get_transfer_stats(&transfers);
+    report_scheduler_stats_t sched;
+    report_scheduler_get_stats(&sched);
+    char skipped[128];
+    report_scheduler_format_skipped(skipped, sizeof(skipped));
+
+    // SSID (up to 63) and broker URL (up to 127) get a chunk of their own,
+    // so the counters that follow never push the HTML out of `buf`
     snprintf(buf, sizeof(buf),
         "<div class='card'><h2>Connection</h2><table>"
         "<tr><th>WiFi</th><td class='val'>%s</td></tr>"
-        "<tr><th>MQTT Broker</th><td class='val'>%s</td></tr>"
+        "<tr><th>MQTT Broker</th><td class='val'>%s</td></tr>",
+        current_config->wifi_ssid,
+        current_config->mqtt_url);
+    httpd_resp_sendstr_chunk(req, buf);
+
+    snprintf(buf, sizeof(buf),
         "<tr><th>USB UPS</th><td class='val %s'>%s</td></tr>"
         "<tr><th>Publish Interval</th><td class='val'>%lu s</td></tr>"
-        "</table></div>",
-        current_config->wifi_ssid,
-        current_config->mqtt_url,
+        "<tr><th>Unchanged Reports</th><td class='val'>%lu / %lu (%lu%%)</td></tr>"
+        "<tr><th>Filtered Samples</th><td class='val'>%lu median, %lu step, %lu enum</td></tr>",
         usb_ups_is_connected() ? "online" : "offline",
         usb_ups_is_connected() ? "Connected" : "Disconnected",
-        (unsigned long)(current_config->publish_interval_ms / 1000));
+        (unsigned long)(current_config->publish_interval_ms / 1000),
+        (unsigned long)cache.hits, (unsigned long)reports,
+        (unsigned long)(reports ? (uint64_t)cache.hits * 100 / reports : 0),
+        (unsigned long)filter.smoothed, (unsigned long)filter.step_held, (unsigned long)filter.enum_held);
+    httpd_resp_sendstr_chunk(req, buf);
+
+    snprintf(buf, sizeof(buf),
+        "<tr><th>Report Reads</th><td class='val'>%lu live (%u), %lu state (%u), %lu static (%u), %lu expedited</td></tr>"
+        "<tr><th>Skipped Reports</th><td class='val'>%s</td></tr>",
+        (unsigned long)sched.reads[REPORT_CLASS_LIVE], sched.reports[REPORT_CLASS_LIVE],
+        (unsigned long)sched.reads[REPORT_CLASS_STATE], sched.reports[REPORT_CLASS_STATE],
+        (unsigned long)sched.reads[REPORT_CLASS_STATIC], sched.reports[REPORT_CLASS_STATIC],
+        (unsigned long)sched.expedited,
+        skipped);
+    httpd_resp_sendstr_chunk(req, buf);
+
+    // Largest free block against free size shows DMA heap fragmentation
+    snprintf(buf, sizeof(buf),
+        "<tr><th>USB Transfers</th><td class='val'>%lu control, %lu timed out, %lu device faults (%lu resets), %lu one-off, %lu reports dropped, %lu stalls cleared</td></tr>"
+        "<tr><th>DMA Heap</th><td class='val'>%u free, %u largest block</td></tr>"
+        "</table></div>",
+        (unsigned long)transfers.control, (unsigned long)transfers.timeouts,
+        (unsigned long)transfers.device_faults, (unsigned long)transfers.resets,
+        (unsigned long)transfers.oversize, (unsigned long)transfers.intr_dropped,
+        (unsigned long)transfers.intr_stalls,
+        (unsigned)heap_caps_get_free_size(MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL),
+        (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL));
     httpd_resp_sendstr_chunk(req, buf);
 
     /* Serial Logs */
@@ -413,13 +600,122 @@ static esp_err_t save_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+/* ═══════════════ GET /hidtrace — Binary HID Trace ═══════════════ */
+
+#if CONFIG_APC_HID_BINARY_TRACE
+static esp_err_t hidtrace_handler(httpd_req_t *req)
+{
+    size_t max = CONFIG_APC_HID_BINARY_TRACE_DEPTH;
+    apc_hid_trace_record_t *records = malloc(max * sizeof(apc_hid_trace_record_t));
+    if (records == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    size_t count = apc_hid_trace_copy(records, max);
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"hidtrace.bin\"");
+    esp_err_t err = httpd_resp_send(req, (const char *)records, count * sizeof(apc_hid_trace_record_t));
+    free(records);
+    return err;
+}
+#endif
+
+/* ═══════════════ GET /usbtrace — USB Capture (pcapng) ═══════════════ */
+
+#if CONFIG_USB_TRACE
+static esp_err_t usbtrace_handler(httpd_req_t *req)
+{
+    size_t max = CONFIG_USB_TRACE_DEPTH;
+    usb_trace_record_t *records = malloc(max * sizeof(usb_trace_record_t));
+    if (records == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    size_t count = usb_trace_copy(records, max);
+
+    // Record times are esp_timer; shift them to Unix time once SNTP has set the clock
+    int64_t wall_offset_us = 0;
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    if (tv.tv_sec >= 1600000000) {
+        wall_offset_us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec - esp_timer_get_time();
+    }
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"usbtrace.pcapng\"");
+
+    // Blocks are gathered into one buffer per chunk
+    uint8_t chunk[1024];
+    size_t used = usb_trace_pcapng_header(chunk);
+    esp_err_t err = ESP_OK;
+    for (size_t i = 0; i < count && err == ESP_OK; i++) {
+        if (used + USB_TRACE_PCAPNG_PACKET_MAX > sizeof(chunk)) {
+            err = httpd_resp_send_chunk(req, (const char *)chunk, used);
+            used = 0;
+        }
+        used += usb_trace_pcapng_packet(&records[i], wall_offset_us, chunk + used);
+    }
+    if (err == ESP_OK && used > 0) {
+        err = httpd_resp_send_chunk(req, (const char *)chunk, used);
+    }
+    free(records);
+    if (err == ESP_OK) {
+        err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return err;
+}
+#endif
+
+/* ═══════════════ GET /runtime?watts=N — What-if Runtime ═══════════════ */
+
+static esp_err_t runtime_handler(httpd_req_t *req)
+{
+    int32_t watts = runtime_learner_watts();
+
+    char query[64];
+    char value[16];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "watts", value, sizeof(value)) == ESP_OK) {
+        watts = atoi(value);
+        if (watts <= 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "watts must be a positive integer");
+            return ESP_FAIL;
+        }
+    }
+
+    runtime_model_info_t info;
+    runtime_learner_get_info(&info);
+    int32_t runtime = runtime_learner_predict(watts);
+
+    char runtime_str[16];
+    if (runtime >= 0) {
+        snprintf(runtime_str, sizeof(runtime_str), "%ld", (long)runtime);
+    } else {
+        strlcpy(runtime_str, "null", sizeof(runtime_str));
+    }
+
+    char buf[192];
+    snprintf(buf, sizeof(buf),
+        "{\"watts\":%ld,\"charge\":%ld,\"runtime_s\":%s,"
+        "\"episodes\":%lu,\"peukert_exponent\":%.2f}",
+        (long)watts, (long)runtime_learner_charge(), runtime_str,
+        (unsigned long)info.episodes, info.exponent);
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, buf);
+}
+
 /* ═══════════════ Server Start ═══════════════ */
 
 static httpd_handle_t server = NULL;
 
-esp_err_t http_server_start(app_config_t *config)
+esp_err_t http_server_start(app_config_t *config, apc_hid_parser_t *parser)
 {
     current_config = config;
+    ups_parser = parser;
 
     /* Start log capture */
     log_mutex = xSemaphoreCreateMutex();
@@ -430,7 +726,7 @@ esp_err_t http_server_start(app_config_t *config)
 
     httpd_config_t httpd_config = HTTPD_DEFAULT_CONFIG();
     httpd_config.stack_size = 8192;
-    httpd_config.max_uri_handlers = 4;
+    httpd_config.max_uri_handlers = 7;
 
     esp_err_t err = httpd_start(&server, &httpd_config);
     if (err != ESP_OK) {
@@ -441,10 +737,21 @@ esp_err_t http_server_start(app_config_t *config)
     const httpd_uri_t root_uri   = { .uri = "/",       .method = HTTP_GET,  .handler = root_handler   };
     const httpd_uri_t status_uri = { .uri = "/status",  .method = HTTP_GET,  .handler = status_handler };
     const httpd_uri_t save_uri   = { .uri = "/save",    .method = HTTP_POST, .handler = save_handler   };
+    const httpd_uri_t runtime_uri = { .uri = "/runtime", .method = HTTP_GET, .handler = runtime_handler };
 
     httpd_register_uri_handler(server, &root_uri);
     httpd_register_uri_handler(server, &status_uri);
     httpd_register_uri_handler(server, &save_uri);
+    httpd_register_uri_handler(server, &runtime_uri);
+
+#if CONFIG_APC_HID_BINARY_TRACE
+    const httpd_uri_t hidtrace_uri = { .uri = "/hidtrace", .method = HTTP_GET, .handler = hidtrace_handler };
+    httpd_register_uri_handler(server, &hidtrace_uri);
+#endif
+#if CONFIG_USB_TRACE
+    const httpd_uri_t usbtrace_uri = { .uri = "/usbtrace", .method = HTTP_GET, .handler = usbtrace_handler };
+    httpd_register_uri_handler(server, &usbtrace_uri);
+#endif
 
     ESP_LOGI(TAG, "HTTP server started on port %d", httpd_config.server_port);
     return ESP_OK;
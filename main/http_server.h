@@ -3,6 +3,7 @@
 
 #include "esp_err.h"
 #include <stdint.h>
+#include "apc_hid_parser.h"
 
 typedef struct {
     char wifi_ssid[64];
@@ -14,6 +15,7 @@ typedef struct {
 } app_config_t;
 
 esp_err_t config_load(app_config_t *config);
-esp_err_t http_server_start(app_config_t *config);
+// /status shows snapshots of `parser`
+esp_err_t http_server_start(app_config_t *config, apc_hid_parser_t *parser);
 
 #endif // HTTP_SERVER_H
@@ -5,6 +5,7 @@
 #include "freertos/event_groups.h"
 #include "esp_system.h"
 #include "esp_random.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
@@ -17,13 +18,132 @@
 #include "apc_hid_parser.h"
 #include "usb_host_manager.h"
 #include "http_server.h"
+#include "telemetry.h"
+#include "energy_meter.h"
+#include "runtime_learner.h"
+#include "soh_estimator.h"
+#include "power_quality.h"
+#include "report_scheduler.h"
+#include "esp_netif_sntp.h"
 
 static const char *TAG = "main";
+
+// Republish every metric (not just changed ones) every N publish cycles
+#define FULL_PUBLISH_CYCLES 10
 static app_config_t app_config;
 
+// Home Assistant sensors published from parser fields. Units come from the
+// parser's field table; values are formatted only here, at publish time.
+typedef struct {
+    apc_field_t field;
+    const char *sensor;            // MQTT sensor name
+    const char *friendly_name;
+    const char *device_class;
+    bool skip_zero;                // Not reported by every model, 0 means absent
+} ha_sensor_t;
+
+static const ha_sensor_t ha_sensors[] = {
+    // Battery metrics
+    { APC_FIELD_BATTERY_CHARGE,                "battery_charge",          "Battery Charge",           "battery",      false },
+    { APC_FIELD_BATTERY_VOLTAGE,               "battery_voltage",         "Battery Voltage",          "voltage",      false },
+    { APC_FIELD_BATTERY_NOMINAL_VOLTAGE,       "battery_voltage_nominal", "Battery Nominal Voltage",  "voltage",      true  },
+    { APC_FIELD_BATTERY_RUNTIME,               "battery_runtime",         "Battery Runtime",          "duration",     false },
+    { APC_FIELD_LOW_BATTERY_RUNTIME_THRESHOLD, "battery_runtime_low",     "Battery Low Runtime",      "duration",     true  },
+    { APC_FIELD_LOW_BATTERY_CHARGE_THRESHOLD,  "battery_charge_low",      "Battery Low Charge",       "battery",      true  },
+    { APC_FIELD_BATTERY_WARNING_THRESHOLD,     "battery_charge_warning",  "Battery Warning Charge",   "battery",      true  },
+    { APC_FIELD_BATTERY_TYPE,                  "battery_type",            "Battery Type",             NULL,           false },
+    { APC_FIELD_BATTERY_MFR_DATE,              "battery_mfr_date",        "Battery Manufacture Date", NULL,           false },
+
+    // Input power metrics
+    // NOTE: input_frequency not available - UPS reports 0 Hz (hardware limitation)
+    { APC_FIELD_INPUT_VOLTAGE,                 "input_voltage",           "Input Voltage",            "voltage",      false },
+    { APC_FIELD_INPUT_VOLTAGE_NOMINAL,         "input_voltage_nominal",   "Input Nominal Voltage",    "voltage",      true  },
+    { APC_FIELD_LOW_VOLTAGE_TRANSFER,          "input_transfer_low",      "Low Voltage Transfer",     "voltage",      true  },
+    { APC_FIELD_HIGH_VOLTAGE_TRANSFER,         "input_transfer_high",     "High Voltage Transfer",    "voltage",      true  },
+    { APC_FIELD_INPUT_SENSITIVITY,             "input_sensitivity",       "Input Sensitivity",        NULL,           false },
+    { APC_FIELD_LAST_TRANSFER_REASON,          "input_transfer_reason",   "Last Transfer Reason",     NULL,           false },
+
+    // Output/Load metrics
+    // NOTE: output_voltage not available - line-interactive UPS doesn't measure output (hardware limitation)
+    { APC_FIELD_LOAD_PERCENT,                  "load_percent",            "Load",                     "power_factor", false },
+    { APC_FIELD_NOMINAL_POWER,                 "nominal_power",           "Nominal Power",            "power",        true  },
+    { APC_FIELD_NOMINAL_APPARENT_POWER,        "nominal_apparent_power",  "Nominal Apparent Power",   "apparent_power", true },
+
+    // Derived from load and ratings
+    { APC_FIELD_OUTPUT_POWER,                  "output_power",            "Output Power",             "power",        false },
+    { APC_FIELD_OUTPUT_APPARENT_POWER,         "output_apparent_power",   "Output Apparent Power",    "apparent_power", false },
+    { APC_FIELD_POWER_HEADROOM,                "power_headroom",          "Power Headroom",           "power",        false },
+
+    // UPS status and timers
+    // Note: delay_shutdown not available in HID reports
+    // Active timers (Report 0x17 = reboot, Report 0x15 = shutdown) can be negative (-1 = not active)
+    { APC_FIELD_STATUS,                        "status",                  "UPS Status",               NULL,           false },
+    { APC_FIELD_BEEPER_STATUS,                 "beeper_status",           "Beeper Status",            NULL,           false },
+    { APC_FIELD_DELAY_BEFORE_REBOOT,           "delay_reboot",            "Reboot Delay",             "duration",     true  },
+    { APC_FIELD_REBOOT_TIMER,                  "reboot_timer",            "Reboot Timer",             "duration",     false },
+    { APC_FIELD_SHUTDOWN_TIMER,                "shutdown_timer",          "Shutdown Timer",           "duration",     false },
+    { APC_FIELD_SELF_TEST_RESULT,              "self_test_result",        "Self-Test Result",         NULL,           false },
+};
+
+// Constant device information, published on full cycles only
+// Note: firmware_version not available - requires USB string descriptors
+static const struct {
+    const char *sensor;
+    const char *friendly_name;
+    const char *value;
+} ha_device_info[] = {
+    { "driver_name",    "Driver Name",    APC_DRIVER_NAME },
+    { "driver_version", "Driver Version", APC_DRIVER_VERSION },
+    { "driver_state",   "Driver State",   APC_DRIVER_STATE },
+    { "power_failure",  "Power Failure",  APC_POWER_FAILURE_STATUS },
+};
+
+// Day-long distributions (see telemetry.h), published on full cycles only
+static const struct {
+    telemetry_metric_t metric;
+    float q;
+    const char *sensor;
+    const char *friendly_name;
+    const char *device_class;
+} ha_quantiles[] = {
+    { TELEMETRY_INPUT_VOLTAGE,   0.50f, "input_voltage_p50",   "Input Voltage p50 (24h)",        "voltage"  },
+    { TELEMETRY_INPUT_VOLTAGE,   0.95f, "input_voltage_p95",   "Input Voltage p95 (24h)",        "voltage"  },
+    { TELEMETRY_INPUT_VOLTAGE,   0.99f, "input_voltage_p99",   "Input Voltage p99 (24h)",        "voltage"  },
+    { TELEMETRY_USB_RTT,         0.50f, "usb_rtt_p50",         "USB Round Trip p50 (24h)",       "duration" },
+    { TELEMETRY_USB_RTT,         0.99f, "usb_rtt_p99",         "USB Round Trip p99 (24h)",       "duration" },
+    { TELEMETRY_PUBLISH_LATENCY, 0.50f, "publish_latency_p50", "MQTT Publish Latency p50 (24h)", "duration" },
+    { TELEMETRY_PUBLISH_LATENCY, 0.99f, "publish_latency_p99", "MQTT Publish Latency p99 (24h)", "duration" },
+};
+
+#define NUM_HA_SENSORS     (sizeof(ha_sensors) / sizeof(ha_sensors[0]))
+#define NUM_HA_DEVICE_INFO (sizeof(ha_device_info) / sizeof(ha_device_info[0]))
+#define NUM_HA_QUANTILES   (sizeof(ha_quantiles) / sizeof(ha_quantiles[0]))
+
+// Parser sample hook: feeds the input voltage distribution, the energy
+// meter, the runtime learner, the battery health estimator and the
+// power-quality detector
+static void on_ups_sample(apc_field_t field, int32_t value, void *ctx)
+{
+    if (field == APC_FIELD_INPUT_VOLTAGE) {
+        telemetry_record(TELEMETRY_INPUT_VOLTAGE, value);
+    }
+    energy_meter_sample(field, value);
+    runtime_learner_sample(field, value);
+    soh_estimator_sample(field, value);
+    power_quality_sample(field, value);
+    report_scheduler_sample(field, value);
+}
+
+// Decoded samples before the glitch filter
+static void on_ups_raw_sample(apc_field_t field, int32_t value, void *ctx)
+{
+    power_quality_raw_sample(field, value);
+}
+
 // Task to publish UPS metrics periodically
 static void mqtt_publish_task(void *arg)
 {
+    apc_hid_parser_t *parser = (apc_hid_parser_t *)arg;
     ESP_LOGI(TAG, "📊 MQTT publish task started");
 
     // Wait for MQTT connection
@@ -36,187 +156,175 @@ static void mqtt_publish_task(void *arg)
     ESP_LOGI(TAG, "📡 Publishing MQTT discovery configs...");
     ESP_LOGI(TAG, "💡 Each UPS bridge has unique device ID based on MAC address");
 
-    // Battery metrics
-    mqtt_publish_discovery("battery_charge", "Battery Charge", "%", "battery");
-    mqtt_publish_discovery("battery_voltage", "Battery Voltage", "V", "voltage");
-    mqtt_publish_discovery("battery_voltage_nominal", "Battery Nominal Voltage", "V", "voltage");
-    mqtt_publish_discovery("battery_runtime", "Battery Runtime", "s", "duration");
-    mqtt_publish_discovery("battery_runtime_low", "Battery Low Runtime", "s", "duration");
-    mqtt_publish_discovery("battery_charge_low", "Battery Low Charge", "%", "battery");
-    mqtt_publish_discovery("battery_charge_warning", "Battery Warning Charge", "%", "battery");
-    mqtt_publish_discovery("battery_type", "Battery Type", NULL, NULL);
-    mqtt_publish_discovery("battery_mfr_date", "Battery Manufacture Date", NULL, NULL);
-
-    // Input power metrics
-    mqtt_publish_discovery("input_voltage", "Input Voltage", "V", "voltage");
-    mqtt_publish_discovery("input_voltage_nominal", "Input Nominal Voltage", "V", "voltage");
-    // NOTE: input_frequency not available - UPS reports 0 Hz (hardware limitation)
-    // mqtt_publish_discovery("input_frequency", "Input Frequency", "Hz", "frequency");
-    mqtt_publish_discovery("input_transfer_low", "Low Voltage Transfer", "V", "voltage");
-    mqtt_publish_discovery("input_transfer_high", "High Voltage Transfer", "V", "voltage");
-    mqtt_publish_discovery("input_sensitivity", "Input Sensitivity", NULL, NULL);
-    mqtt_publish_discovery("input_transfer_reason", "Last Transfer Reason", NULL, NULL);
-
-    // Output/Load metrics
-    // NOTE: output_voltage not available - line-interactive UPS doesn't measure output (hardware limitation)
-    // mqtt_publish_discovery("output_voltage", "Output Voltage", "V", "voltage");
-    mqtt_publish_discovery("load_percent", "Load", "%", "power_factor");
-    mqtt_publish_discovery("nominal_power", "Nominal Power", "W", "power");
-
-    // UPS status and timers
-    mqtt_publish_discovery("status", "UPS Status", NULL, NULL);
-    mqtt_publish_discovery("beeper_status", "Beeper Status", NULL, NULL);
-    // Note: delay_shutdown removed - not available in HID reports
-    // mqtt_publish_discovery("delay_shutdown", "Shutdown Delay", "s", "duration");
-    mqtt_publish_discovery("delay_reboot", "Reboot Delay", "s", "duration");
-    mqtt_publish_discovery("reboot_timer", "Reboot Timer", "s", "duration");
-    mqtt_publish_discovery("shutdown_timer", "Shutdown Timer", "s", "duration");
-    mqtt_publish_discovery("self_test_result", "Self-Test Result", NULL, NULL);
-
-    // Device information
-    // Note: firmware_version not available - requires USB string descriptors
-    // mqtt_publish_discovery("firmware_version", "Firmware Version", NULL, NULL);
-    mqtt_publish_discovery("driver_name", "Driver Name", NULL, NULL);
-    mqtt_publish_discovery("driver_version", "Driver Version", NULL, NULL);
-    mqtt_publish_discovery("driver_state", "Driver State", NULL, NULL);
-    mqtt_publish_discovery("power_failure", "Power Failure", NULL, NULL);
+    for (int i = 0; i < NUM_HA_SENSORS; i++) {
+        const ha_sensor_t *s = &ha_sensors[i];
+        mqtt_publish_discovery(s->sensor, s->friendly_name, apc_hid_field_info(s->field)->unit, s->device_class, NULL);
+    }
+    for (int i = 0; i < NUM_HA_DEVICE_INFO; i++) {
+        mqtt_publish_discovery(ha_device_info[i].sensor, ha_device_info[i].friendly_name, NULL, NULL, NULL);
+    }
+    for (int i = 0; i < NUM_HA_QUANTILES; i++) {
+        mqtt_publish_discovery(ha_quantiles[i].sensor, ha_quantiles[i].friendly_name,
+                               telemetry_unit(ha_quantiles[i].metric), ha_quantiles[i].device_class, NULL);
+    }
+    mqtt_publish_discovery("output_energy", "Output Energy", "kWh", "energy", "total_increasing");
+    mqtt_publish_discovery("predicted_runtime", "Predicted Runtime", "s", "duration", NULL);
+    mqtt_publish_discovery("battery_health", "Battery Health", "%", NULL, "measurement");
+    mqtt_publish_discovery("battery_replace_date", "Battery Replacement Due", NULL, "date", NULL);
+    mqtt_publish_event_discovery("power_event", "Power Event");
 
     vTaskDelay(pdMS_TO_TICKS(2000));
 
+    uint32_t published_version = 0;
+    apc_field_mask_t owed = 0;           // Changed but held back as stale or failed to publish
+    uint64_t published_energy_wh = UINT64_MAX;
+    int32_t published_runtime = -1;
+    int32_t published_health = -1;
+    char published_replace[16] = "";
+    int cycle = 0;
+    bool was_connected = true;
+
     while (1) {
         if (mqtt_is_connected()) {
-            const ups_metrics_t *metrics = apc_hid_get_metrics();
-            
-            if (metrics->valid) {
-                ESP_LOGI(TAG, "═══════════════════════════════════════════");
-                ESP_LOGI(TAG, "📤 PUBLISHING TO MQTT");
-                ESP_LOGI(TAG, "   Broker: %s", app_config.mqtt_url);
-                ESP_LOGI(TAG, "   Base Topic: homeassistant/sensor/apc_ups");
-                ESP_LOGI(TAG, "");
-
-                // Publish key metrics with detailed logging
-                ESP_LOGI(TAG, "   📊 battery_charge → %.1f%%", metrics->battery_charge);
-                mqtt_publish_metric("battery_charge", metrics->battery_charge, "%");
-
-                ESP_LOGI(TAG, "   ⏱️  battery_runtime → %.0f seconds (%.1f min)",
-                         metrics->battery_runtime, metrics->battery_runtime / 60.0f);
-                mqtt_publish_metric("battery_runtime", metrics->battery_runtime, "s");
-
-                ESP_LOGI(TAG, "   🔋 battery_voltage → %.1fV", metrics->battery_voltage);
-                mqtt_publish_metric("battery_voltage", metrics->battery_voltage, "V");
-
-                // Battery additional metrics
-                if (metrics->battery_nominal_voltage > 0) {
-                    mqtt_publish_metric("battery_voltage_nominal", metrics->battery_nominal_voltage, "V");
-                }
-                if (metrics->low_battery_runtime_threshold > 0) {
-                    mqtt_publish_metric("battery_runtime_low", metrics->low_battery_runtime_threshold, "s");
-                }
-                if (metrics->low_battery_charge_threshold > 0) {
-                    mqtt_publish_metric("battery_charge_low", metrics->low_battery_charge_threshold, "%");
+            static ups_metrics_t snapshot;
+            apc_hid_get_snapshot(parser, &snapshot);
+            const ups_metrics_t *metrics = &snapshot;
+
+            // Only fields that changed since the last publish are sent; every
+            // FULL_PUBLISH_CYCLES cycles and after a reconnect, everything is
+            // (states are not retained, so a restarted HA needs them again).
+            bool full = !was_connected || (cycle++ % FULL_PUBLISH_CYCLES) == 0;
+            apc_field_mask_t changed = apc_hid_changed_since(metrics, full ? 0 : published_version) | owed;
+            was_connected = true;
+
+            // Values the UPS stopped reporting are held back rather than
+            // republished as if current
+            int64_t now_us = esp_timer_get_time();
+            apc_field_mask_t stale = report_scheduler_stale_fields(metrics, CONFIG_UPS_STALE_AFTER_MS * 1000LL, now_us);
+
+            // Energy keeps growing while every field stays the same, so it
+            // has its own change check (at Wh resolution)
+            uint64_t energy_wh = energy_meter_total_mwh() / 1000;
+            if (full || energy_wh != published_energy_wh) {
+                char energy[24];
+                energy_meter_format_kwh(energy, sizeof(energy));
+                if (mqtt_publish_string("output_energy", energy) == ESP_OK) {
+                    published_energy_wh = energy_wh;
                 }
-                if (metrics->battery_warning_threshold > 0) {
-                    mqtt_publish_metric("battery_charge_warning", metrics->battery_warning_threshold, "%");
-                }
-                if (strlen(metrics->battery_type) > 0) {
-                    mqtt_publish_string("battery_type", metrics->battery_type);
-                }
-                if (strlen(metrics->battery_mfr_date) > 0) {
-                    mqtt_publish_string("battery_mfr_date", metrics->battery_mfr_date);
-                }
-
-                ESP_LOGI(TAG, "   ⚡ input_voltage → %.1fV", metrics->input_voltage);
-                mqtt_publish_metric("input_voltage", metrics->input_voltage, "V");
+            }
 
-                // Input power additional metrics
-                if (metrics->input_voltage_nominal > 0) {
-                    mqtt_publish_metric("input_voltage_nominal", metrics->input_voltage_nominal, "V");
-                }
-                // input_frequency removed - hardware doesn't support
-                // if (metrics->input_frequency > 0) {
-                //     ESP_LOGI(TAG, "   〰️ input_frequency → %.1fHz", metrics->input_frequency);
-                //     mqtt_publish_metric("input_frequency", metrics->input_frequency, "Hz");
-                // }
-                if (metrics->low_voltage_transfer > 0) {
-                    mqtt_publish_metric("input_transfer_low", metrics->low_voltage_transfer, "V");
-                }
-                if (metrics->high_voltage_transfer > 0) {
-                    mqtt_publish_metric("input_transfer_high", metrics->high_voltage_transfer, "V");
-                }
-                if (strlen(metrics->input_sensitivity) > 0) {
-                    mqtt_publish_string("input_sensitivity", metrics->input_sensitivity);
-                }
-                if (strlen(metrics->last_transfer_reason) > 0) {
-                    mqtt_publish_string("input_transfer_reason", metrics->last_transfer_reason);
+            // Learned runtime, once a discharge has been seen
+            int32_t runtime = runtime_learner_predicted_runtime();
+            if (runtime >= 0 && (full || runtime != published_runtime)) {
+                char runtime_str[16];
+                snprintf(runtime_str, sizeof(runtime_str), "%ld", (long)runtime);
+                if (mqtt_publish_string("predicted_runtime", runtime_str) == ESP_OK) {
+                    published_runtime = runtime;
                 }
+            }
 
-                ESP_LOGI(TAG, "   📈 load_percent → %.1f%%", metrics->load_percent);
-                mqtt_publish_metric("load_percent", metrics->load_percent, "%");
-
-                // Output/Load additional metrics
-                // output_voltage removed - hardware doesn't support
-                // if (metrics->output_voltage > 0) {
-                //     ESP_LOGI(TAG, "   ⚡ output_voltage → %.1fV", metrics->output_voltage);
-                //     mqtt_publish_metric("output_voltage", metrics->output_voltage, "V");
-                // }
-                if (metrics->nominal_power > 0) {
-                    ESP_LOGI(TAG, "   ⚡ nominal_power → %.0fW", metrics->nominal_power);
-                    mqtt_publish_metric("nominal_power", metrics->nominal_power, "W");
+            // Power-quality events, oldest first; one that fails to publish
+            // stays queued for the next cycle
+            power_event_t event;
+            while (power_quality_peek_event(&event)) {
+                char record[160];
+                power_quality_format_event(&event, record, sizeof(record));
+                if (mqtt_publish_string("power_event", record) != ESP_OK) {
+                    break;
                 }
+                ESP_LOGI(TAG, "⚡ power_event → %s", record);
+                power_quality_pop_event();
+            }
 
-                ESP_LOGI(TAG, "   🚦 status → %s", metrics->status_string);
-                mqtt_publish_string("status", metrics->status_string);
-
-                // UPS configuration and timers
-                if (strlen(metrics->beeper_status) > 0) {
-                    mqtt_publish_string("beeper_status", metrics->beeper_status);
+            // Battery health and its projected replacement, once measured
+            int32_t health = soh_estimator_health();
+            if (health >= 0 && (full || health != published_health)) {
+                char health_str[16];
+                snprintf(health_str, sizeof(health_str), "%ld", (long)health);
+                if (mqtt_publish_string("battery_health", health_str) == ESP_OK) {
+                    published_health = health;
                 }
-                // Note: Report 0x11 is battery_charge_low, not shutdown_delay
-                // Shutdown delay configuration not available in HID reports
-                // (NUT gets it from different source or doesn't expose it)
-
-                // Publish delay_before_reboot (Report 0x13) - configuration value
-                if (metrics->delay_before_reboot > 0) {
-                    mqtt_publish_metric("delay_reboot", metrics->delay_before_reboot, "s");
+            }
+            char replace[16];
+            if (soh_estimator_replace_date(replace, sizeof(replace)) &&
+                (full || strcmp(replace, published_replace) != 0)) {
+                if (mqtt_publish_string("battery_replace_date", replace) == ESP_OK) {
+                    strlcpy(published_replace, replace, sizeof(published_replace));
                 }
+            }
 
-                // Active timers (Report 0x17 = reboot, Report 0x15 = shutdown)
-                // These can be negative (-1 = not active)
-                mqtt_publish_metric("reboot_timer", metrics->reboot_timer, "s");
-                mqtt_publish_metric("shutdown_timer", metrics->shutdown_timer, "s");
+            if (metrics->valid && changed != 0) {
+                ESP_LOGI(TAG, "═══════════════════════════════════════════");
+                ESP_LOGI(TAG, "📤 PUBLISHING TO MQTT (%s, version %lu)",
+                         full ? "full" : "changes", (unsigned long)metrics->version);
+                ESP_LOGI(TAG, "   Broker: %s", app_config.mqtt_url);
+                ESP_LOGI(TAG, "   Base Topic: homeassistant/sensor/apc_ups");
+                ESP_LOGI(TAG, "");
 
-                // Self-test result
-                if (strlen(metrics->self_test_result) > 0) {
-                    mqtt_publish_string("self_test_result", metrics->self_test_result);
+                char value[64];
+                int64_t oldest_us = 0;
+                int num_stale = 0;
+                for (int i = 0; i < NUM_HA_SENSORS; i++) {
+                    const ha_sensor_t *s = &ha_sensors[i];
+                    if (!(changed & APC_FIELD_BIT(s->field)) ||
+                        !apc_hid_field_present(metrics, s->field) ||
+                        (s->skip_zero && metrics->value[s->field] <= 0)) {
+                        owed &= ~APC_FIELD_BIT(s->field);
+                        continue;
+                    }
+                    if (stale & APC_FIELD_BIT(s->field)) {
+                        ESP_LOGW(TAG, "   %s → stale (%lld s old), not published", s->sensor,
+                                 apc_hid_field_age_us(metrics, s->field, now_us) / 1000000);
+                        owed |= APC_FIELD_BIT(s->field);
+                        num_stale++;
+                        continue;
+                    }
+                    int64_t age_us = apc_hid_field_age_us(metrics, s->field, now_us);
+                    if (age_us > oldest_us) {
+                        oldest_us = age_us;
+                    }
+                    apc_hid_format_field(metrics, s->field, value, sizeof(value));
+                    ESP_LOGI(TAG, "   %s → %s", s->sensor, value);
+                    if (mqtt_publish_string(s->sensor, value) == ESP_OK) {
+                        owed &= ~APC_FIELD_BIT(s->field);
+                    } else {
+                        owed |= APC_FIELD_BIT(s->field);
+                    }
                 }
 
-                // Device information
-                // firmware_version removed - not available in HID reports
-                if (strlen(metrics->driver_name) > 0) {
-                    mqtt_publish_string("driver_name", metrics->driver_name);
-                }
-                if (strlen(metrics->driver_version) > 0) {
-                    mqtt_publish_string("driver_version", metrics->driver_version);
-                }
-                if (strlen(metrics->driver_state) > 0) {
-                    mqtt_publish_string("driver_state", metrics->driver_state);
-                }
-                if (strlen(metrics->power_failure_status) > 0) {
-                    mqtt_publish_string("power_failure", metrics->power_failure_status);
+                if (full) {
+                    for (int i = 0; i < NUM_HA_DEVICE_INFO; i++) {
+                        mqtt_publish_string(ha_device_info[i].sensor, ha_device_info[i].value);
+                    }
+                    for (int i = 0; i < NUM_HA_QUANTILES; i++) {
+                        int32_t q;
+                        if (telemetry_quantiles(ha_quantiles[i].metric, &ha_quantiles[i].q, 1, &q) > 0) {
+                            telemetry_format(ha_quantiles[i].metric, q, value, sizeof(value));
+                            mqtt_publish_string(ha_quantiles[i].sensor, value);
+                        }
+                    }
                 }
 
+                // Fields still owed are retried through `owed`, not the version
+                published_version = metrics->version;
+
                 ESP_LOGI(TAG, "");
                 ESP_LOGI(TAG, "✅ MQTT PUBLISH COMPLETE");
-                ESP_LOGI(TAG, "🔋 Summary: %s | Battery: %.0f%% | Load: %.0f%%",
-                         metrics->status_string,
-                         metrics->battery_charge,
-                         metrics->load_percent);
+                ESP_LOGI(TAG, "⏱️ Oldest value published: %lld ms, %d stale skipped",
+                         oldest_us / 1000, num_stale);
+                ESP_LOGI(TAG, "🔋 Summary: %s | Battery: %ld%% | Load: %ld%%",
+                         apc_hid_status_string(metrics->status),
+                         (long)metrics->value[APC_FIELD_BATTERY_CHARGE],
+                         (long)metrics->value[APC_FIELD_LOAD_PERCENT]);
                 ESP_LOGI(TAG, "═══════════════════════════════════════════");
+            } else if (metrics->valid) {
+                ESP_LOGD(TAG, "No metric changes since version %lu", (unsigned long)published_version);
             } else {
                 ESP_LOGW(TAG, "⚠️ No valid UPS metrics available");
             }
         } else {
             ESP_LOGW(TAG, "⚠️ MQTT not connected, skipping publish");
+            was_connected = false;
         }
         
         vTaskDelay(pdMS_TO_TICKS(app_config.publish_interval_ms));
@@ -228,32 +336,28 @@ static void simulate_ups_data_task(void *arg)
 {
     ESP_LOGI(TAG, "🧪 Simulated UPS data task started (for testing)");
     
-    ups_metrics_t test_metrics = {
-        .battery_charge = 100.0f,
-        .battery_voltage = 13.7f,
-        .battery_runtime = 2420.0f,
-        .input_voltage = 121.0f,
-        .load_percent = 14.0f,
-        .status = {
-            .online = true,
-            .discharging = false,
-            .charging = false,
-            .low_battery = false,
-        },
-        .valid = true,
-    };
-    
-    apc_hid_format_status(&test_metrics.status, test_metrics.status_string, 
-                         sizeof(test_metrics.status_string));
+    // Decoded by a private parser, the published metrics are not touched
+    apc_hid_parser_t *test_parser = apc_hid_parser_create();
+    if (test_parser == NULL) {
+        vTaskDelete(NULL);
+        return;
+    }
+
+    uint8_t status_report[] = {0x16, 0x01, 0x00, 0x00, 0x00};         // Online
+    apc_hid_parse_report(test_parser, 0x16, status_report, sizeof(status_report));
     
     while (1) {
         // Simulate slight variations
-        test_metrics.battery_charge = 95.0f + (esp_random() % 6);
-        test_metrics.load_percent = 10.0f + (esp_random() % 10);
-        test_metrics.input_voltage = 118.0f + ((esp_random() % 5) * 0.5f);
+        uint16_t runtime = 2420;
+        uint16_t input_voltage = 118 + (esp_random() % 5);
+        uint8_t battery_report[] = {0x0C, 95 + (esp_random() % 6), runtime & 0xFF, runtime >> 8};
+        uint8_t input_report[] = {0x31, input_voltage & 0xFF, input_voltage >> 8};
+        uint8_t load_report[] = {0x50, 10 + (esp_random() % 10)};
         
         // Update metrics
-        apc_hid_parse_report(0x0C, (uint8_t*)&test_metrics, sizeof(test_metrics), &test_metrics);
+        apc_hid_parse_report(test_parser, 0x0C, battery_report, sizeof(battery_report));
+        apc_hid_parse_report(test_parser, 0x31, input_report, sizeof(input_report));
+        apc_hid_parse_report(test_parser, 0x50, load_report, sizeof(load_report));
         
         vTaskDelay(pdMS_TO_TICKS(CONFIG_UPS_POLL_INTERVAL_MS));
     }
@@ -293,8 +397,22 @@ void app_main(void)
              app_config.wifi_ssid, app_config.mqtt_url,
              (unsigned long)app_config.publish_interval_ms);
 
-    // Initialize HID parser
-    apc_hid_parser_init();
+    // Create the HID parser for the attached UPS
+    apc_hid_parser_t *ups_parser = apc_hid_parser_create();
+    if (ups_parser == NULL) {
+        ESP_LOGE(TAG, "❌ Failed to create HID parser, restarting...");
+        esp_restart();
+    }
+
+    // Day-long distributions, fed by the parser, USB transfers and MQTT acks
+    telemetry_init();
+    energy_meter_init();
+    runtime_learner_init();
+    soh_estimator_init();
+    power_quality_init();
+    runtime_learner_set_episode_callback(soh_estimator_discharge);
+    apc_hid_parser_set_sample_callback(ups_parser, on_ups_sample, NULL);
+    apc_hid_parser_set_raw_sample_callback(ups_parser, on_ups_raw_sample, NULL);
 
     // Initialize WiFi
     ESP_LOGI(TAG, "📶 Initializing WiFi...");
@@ -306,9 +424,13 @@ void app_main(void)
         esp_restart();
     }
 
+    // Wall-clock time dates the battery health history
+    esp_sntp_config_t sntp_config = ESP_NETIF_SNTP_DEFAULT_CONFIG(CONFIG_UPS_NTP_SERVER);
+    esp_netif_sntp_init(&sntp_config);
+
     // Start HTTP server (config UI + status/logs)
     ESP_LOGI(TAG, "🌐 Starting HTTP server...");
-    http_server_start(&app_config);
+    http_server_start(&app_config, ups_parser);
 
     // Initialize MQTT
     ESP_LOGI(TAG, "📡 Initializing MQTT...");
@@ -318,12 +440,14 @@ void app_main(void)
     // Initialize USB Host
     ESP_LOGI(TAG, "DEBUG: About to init USB Host");
     ESP_LOGI(TAG, "🔌 Initializing USB Host on GPIO19/20...");
-    esp_err_t usb_err = usb_host_init();
+    esp_err_t usb_err = usb_host_init(ups_parser);
     ESP_LOGI(TAG, "DEBUG: usb_host_init returned: 0x%x (%s)", usb_err, esp_err_to_name(usb_err));
 
     if (usb_err == ESP_OK) {
         ESP_LOGI(TAG, "✅ USB Host initialized, creating USB task");
-        xTaskCreate(usb_host_task, "usb_host", 4096, NULL, 5, NULL);
+        // Decoding runs the sample hooks, whose energy, runtime, SoH and
+        // report skip list checkpoints write NVS from this task
+        xTaskCreate(usb_host_task, "usb_host", 8192, NULL, 5, NULL);
     } else {
         ESP_LOGW(TAG, "⚠️ USB Host init failed: %s, falling back to simulated data", esp_err_to_name(usb_err));
         xTaskCreate(simulate_ups_data_task, "simulate_ups", 2048, NULL, 3, NULL);
@@ -331,7 +455,7 @@ void app_main(void)
 
     ESP_LOGI(TAG, "DEBUG: USB setup complete, creating MQTT publish task");
     // Create MQTT publish task
-    xTaskCreate(mqtt_publish_task, "mqtt_publish", 4096, NULL, 4, NULL);
+    xTaskCreate(mqtt_publish_task, "mqtt_publish", 4096, ups_parser, 4, NULL);
 
     ESP_LOGI(TAG, "=== ✅ APC USB-MQTT Bridge Running ===");
     ESP_LOGI(TAG, "WiFi: Connected to %s", app_config.wifi_ssid);
@@ -2,6 +2,8 @@
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "mqtt_client.h"
+#include "telemetry.h"
+#include "esp_timer.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -14,6 +16,33 @@ static char device_id[32] = {0};
 static char mqtt_base_topic[64] = {0};
 static uint8_t device_mac[6] = {0};
 
+// QoS 1 state messages awaiting the broker's PUBACK, for publish latency.
+// An ack that beats the entry being stored is simply not measured.
+#define PENDING_ACKS 16
+
+typedef struct {
+    int msg_id;                  // 0 = free
+    int64_t sent_us;
+} pending_ack_t;
+
+static pending_ack_t pending_acks[PENDING_ACKS];
+
+static void pending_ack_add(int msg_id, int64_t sent_us)
+{
+    pending_ack_t *slot = &pending_acks[msg_id % PENDING_ACKS];
+    slot->sent_us = sent_us;
+    __atomic_store_n(&slot->msg_id, msg_id, __ATOMIC_RELEASE);
+}
+
+static void pending_ack_done(int msg_id)
+{
+    pending_ack_t *slot = &pending_acks[msg_id % PENDING_ACKS];
+    if (msg_id > 0 && __atomic_load_n(&slot->msg_id, __ATOMIC_ACQUIRE) == msg_id) {
+        telemetry_record(TELEMETRY_PUBLISH_LATENCY, (int32_t)(esp_timer_get_time() - slot->sent_us));
+        __atomic_store_n(&slot->msg_id, 0, __ATOMIC_RELAXED);
+    }
+}
+
 // Generate unique device ID from MAC address
 static void generate_device_id(void)
 {
@@ -51,6 +80,9 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     case MQTT_EVENT_ERROR:
         ESP_LOGE(TAG, "❌ MQTT error");
         break;
+    case MQTT_EVENT_PUBLISHED:
+        pending_ack_done(event->msg_id);
+        break;
     default:
         break;
     }
@@ -116,17 +148,23 @@ esp_err_t mqtt_publish_string(const char *sensor_name, const char *value)
     char topic[128];
     snprintf(topic, sizeof(topic), "%s/%s/state", mqtt_base_topic, sensor_name);
 
+    int64_t sent_us = esp_timer_get_time();
     int msg_id = esp_mqtt_client_publish(mqtt_client, topic, value, 0, 1, 0);
 
     if (msg_id < 0) {
         ESP_LOGE(TAG, "Failed to publish to %s", topic);
         return ESP_FAIL;
     }
+    if (msg_id > 0) {
+        pending_ack_add(msg_id, sent_us);
+    }
 
     return ESP_OK;
 }
 
-esp_err_t mqtt_publish_discovery(const char *sensor_name, const char *friendly_name, const char *unit, const char *device_class)
+// `extra` is appended to the payload as is (NULL for none)
+static esp_err_t publish_discovery(const char *sensor_name, const char *friendly_name, const char *unit,
+                                   const char *device_class, const char *state_class, const char *extra)
 {
     if (!mqtt_connected || mqtt_client == NULL) {
         return ESP_ERR_INVALID_STATE;
@@ -168,6 +206,16 @@ esp_err_t mqtt_publish_discovery(const char *sensor_name, const char *friendly_n
         strcat(payload, class_field);
     }
 
+    if (state_class != NULL && strlen(state_class) > 0) {
+        char state_class_field[64];
+        snprintf(state_class_field, sizeof(state_class_field), ",\"state_class\":\"%s\"", state_class);
+        strcat(payload, state_class_field);
+    }
+
+    if (extra != NULL) {
+        strcat(payload, extra);
+    }
+
     strcat(payload, "}");
 
     int msg_id = esp_mqtt_client_publish(mqtt_client, topic, payload, 0, 1, 1);
@@ -181,6 +229,22 @@ esp_err_t mqtt_publish_discovery(const char *sensor_name, const char *friendly_n
     return ESP_OK;
 }
 
+esp_err_t mqtt_publish_discovery(const char *sensor_name, const char *friendly_name, const char *unit,
+                                 const char *device_class, const char *state_class)
+{
+    return publish_discovery(sensor_name, friendly_name, unit, device_class, state_class, NULL);
+}
+
+esp_err_t mqtt_publish_event_discovery(const char *sensor_name, const char *friendly_name)
+{
+    char extra[192];
+    snprintf(extra, sizeof(extra),
+        ",\"value_template\":\"{{ value_json.type }}\","
+        "\"json_attributes_topic\":\"%s/%s/state\"",
+        mqtt_base_topic, sensor_name);
+    return publish_discovery(sensor_name, friendly_name, NULL, NULL, NULL, extra);
+}
+
 bool mqtt_is_connected(void)
 {
     return mqtt_connected;
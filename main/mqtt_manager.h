@@ -7,7 +7,12 @@
 esp_err_t mqtt_init(const char *broker_url, const char *username, const char *password);
 esp_err_t mqtt_publish_metric(const char *sensor_name, float value, const char *unit);
 esp_err_t mqtt_publish_string(const char *sensor_name, const char *value);
-esp_err_t mqtt_publish_discovery(const char *sensor_name, const char *friendly_name, const char *unit, const char *device_class);
+// state_class: NULL, "measurement", "total_increasing"... (HA long-term statistics)
+esp_err_t mqtt_publish_discovery(const char *sensor_name, const char *friendly_name, const char *unit,
+                                 const char *device_class, const char *state_class);
+// Sensor whose state is a JSON record: HA shows its "type" and keeps the
+// rest as attributes
+esp_err_t mqtt_publish_event_discovery(const char *sensor_name, const char *friendly_name);
 bool mqtt_is_connected(void);
 
 #endif // MQTT_MANAGER_H
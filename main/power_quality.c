@@ -0,0 +1,304 @@
+/*
+ * Input power-quality event detector
+ *
+ * Input voltage is a feature report, normally read once per poll cycle
+ * (tens of seconds), which is far too slow to see a sag. When the UPS
+ * transfers to battery or a sample falls outside the band, a burst starts:
+ * the decoding task reads the input voltage report every BURST_PERIOD_US
+ * until BURST_HOLD_US pass without another trigger or BURST_MAX_US pass in
+ * total, then bursts are off for BURST_COOLDOWN_US. One control transfer
+ * per period leaves the interrupt reports and the poll cycle their turn.
+ *
+ * Events are measured with hysteresis (enter outside 90..110% of nominal,
+ * leave inside 92..108%) so noise at the edge of the band does not split
+ * one event into many. Finished events go to a queue the MQTT task drains.
+ */
+
+#include "power_quality.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static const char *TAG = "power_quality";
+
+#define EVENT_QUEUE_LEN     16
+
+#define SAG_ENTER_PCT       90
+#define SAG_EXIT_PCT        92
+#define SWELL_ENTER_PCT     110
+#define SWELL_EXIT_PCT      108
+#define OUTAGE_PCT          10
+#define BROWNOUT_US         (60 * 1000000LL)
+
+#define BURST_PERIOD_US     (200 * 1000LL)
+#define BURST_HOLD_US       (10 * 1000000LL)
+#define BURST_MAX_US        (60 * 1000000LL)
+#define BURST_COOLDOWN_US   (30 * 1000000LL)
+
+#define CLOCK_VALID_AFTER   1600000000 // Before SNTP, time() counts from boot
+
+// input_voltage is in tenths of a volt, input_voltage_nominal in volts
+#define NOMINAL_SCALE       10
+
+static const char *const type_names[POWER_EVENT_TYPE_COUNT] = {
+    [POWER_EVENT_SAG]      = "sag",
+    [POWER_EVENT_BROWNOUT] = "brownout",
+    [POWER_EVENT_SWELL]    = "swell",
+    [POWER_EVENT_OUTAGE]   = "outage",
+};
+
+static QueueHandle_t event_queue = NULL;
+static SemaphoreHandle_t pq_mutex = NULL;
+
+// Published to other tasks under pq_mutex
+static uint32_t event_counts[POWER_EVENT_TYPE_COUNT];
+static power_event_t last_event;
+static bool have_last_event = false;
+
+// Detector state (decoding task only)
+static int32_t nominal = 0;            // input_voltage fixed point, 0 = unknown
+static bool on_battery = false;
+
+static bool event_active = false;
+static bool event_low = false;
+static bool event_transfer = false;
+static int64_t event_start_us = 0;
+static uint32_t event_start_wall = 0;
+static int32_t event_extreme = 0;
+
+static bool burst_active = false;
+static int64_t burst_start_us = 0;
+static int64_t burst_trigger_us = 0;
+static int64_t burst_next_us = 0;
+static int64_t burst_cooldown_until_us = 0;
+static uint32_t burst_polls = 0;
+
+static void trigger_burst(int64_t now_us, const char *why)
+{
+    if (!burst_active) {
+        if (now_us < burst_cooldown_until_us) {
+            return;
+        }
+        burst_active = true;
+        burst_start_us = now_us;
+        burst_next_us = now_us;
+        burst_polls = 0;
+        ESP_LOGI(TAG, "⚡ Burst sampling on (%s)", why);
+    }
+    burst_trigger_us = now_us;
+}
+
+// Nominal from the UPS, or the mains standard a reading belongs to
+static int32_t nominal_for(int32_t voltage)
+{
+    if (nominal > 0) {
+        return nominal;
+    }
+    return (voltage > 180 * NOMINAL_SCALE) ? 230 * NOMINAL_SCALE : 120 * NOMINAL_SCALE;
+}
+
+static void start_event(bool low, int32_t voltage, int64_t now_us)
+{
+    event_active = true;
+    event_low = low;
+    event_transfer = on_battery;
+    event_start_us = now_us;
+    event_extreme = voltage;
+    time_t wall = time(NULL);
+    event_start_wall = (wall >= CLOCK_VALID_AFTER) ? (uint32_t)wall : 0;
+}
+
+static void end_event(int32_t reference, int64_t now_us)
+{
+    event_active = false;
+
+    power_event_t event = {
+        .transfer = event_transfer,
+        .start = event_start_wall,
+        .duration_ms = (uint32_t)((now_us - event_start_us) / 1000),
+        .extreme = event_extreme,
+    };
+    int32_t deviation = event_low ? reference - event_extreme : event_extreme - reference;
+    event.depth_pct = (uint8_t)((deviation * 100 + reference / 2) / reference);
+
+    if (!event_low) {
+        event.type = POWER_EVENT_SWELL;
+    } else if (event_extreme * 100 < reference * OUTAGE_PCT) {
+        event.type = POWER_EVENT_OUTAGE;
+    } else if (now_us - event_start_us >= BROWNOUT_US) {
+        event.type = POWER_EVENT_BROWNOUT;
+    } else {
+        event.type = POWER_EVENT_SAG;
+    }
+
+    xSemaphoreTake(pq_mutex, portMAX_DELAY);
+    event_counts[event.type]++;
+    last_event = event;
+    have_last_event = true;
+    xSemaphoreGive(pq_mutex);
+
+    if (xQueueSend(event_queue, &event, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Event queue full, %s not published", type_names[event.type]);
+    }
+    ESP_LOGI(TAG, "⚡ %s: %lu ms, %d%% from nominal%s", type_names[event.type],
+             (unsigned long)event.duration_ms, event.depth_pct, event.transfer ? ", on battery" : "");
+}
+
+esp_err_t power_quality_init(void)
+{
+    pq_mutex = xSemaphoreCreateMutex();
+    event_queue = xQueueCreate(EVENT_QUEUE_LEN, sizeof(power_event_t));
+    if (pq_mutex == NULL || event_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create power quality queue");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void power_quality_sample(apc_field_t field, int32_t value)
+{
+    if (event_queue == NULL) {
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+
+    switch (field) {
+    case APC_FIELD_INPUT_VOLTAGE_NOMINAL:
+        if (value > 0) {
+            nominal = value * NOMINAL_SCALE;
+        }
+        break;
+
+    case APC_FIELD_STATUS: {
+        bool was_on_battery = on_battery;
+        on_battery = !(value & APC_STATUS_BIT(APC_STATUS_ONLINE));
+        if (on_battery && !was_on_battery) {
+            if (event_active) {
+                event_transfer = true;
+            }
+            trigger_burst(now_us, "transfer");
+        }
+        break;
+    }
+
+    case APC_FIELD_INPUT_VOLTAGE: {
+        int32_t reference = nominal_for(value);
+        bool below = value * 100 < reference * SAG_ENTER_PCT;
+        bool above = value * 100 > reference * SWELL_ENTER_PCT;
+
+        if (event_active) {
+            bool recovered = event_low ? value * 100 >= reference * SAG_EXIT_PCT
+                                       : value * 100 <= reference * SWELL_EXIT_PCT;
+            if (!recovered) {
+                if (event_low ? value < event_extreme : value > event_extreme) {
+                    event_extreme = value;
+                }
+                if (on_battery) {
+                    event_transfer = true;
+                }
+            } else {
+                end_event(reference, now_us);
+            }
+        }
+        if (!event_active && (below || above)) {
+            start_event(below, value, now_us);
+        }
+        if (below || above) {
+            trigger_burst(now_us, below ? "low voltage" : "high voltage");
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void power_quality_raw_sample(apc_field_t field, int32_t value)
+{
+    if (event_queue == NULL || field != APC_FIELD_INPUT_VOLTAGE) {
+        return;
+    }
+    int32_t reference = nominal_for(value);
+    if (value * 100 < reference * SAG_ENTER_PCT || value * 100 > reference * SWELL_ENTER_PCT) {
+        trigger_burst(esp_timer_get_time(), "unfiltered sample out of band");
+    }
+}
+
+bool power_quality_burst_due(int64_t now_us)
+{
+    if (!burst_active) {
+        return false;
+    }
+    if (now_us - burst_start_us >= BURST_MAX_US || now_us - burst_trigger_us >= BURST_HOLD_US) {
+        burst_active = false;
+        burst_cooldown_until_us = now_us + BURST_COOLDOWN_US;
+        ESP_LOGI(TAG, "⚡ Burst sampling off after %lu polls in %lld ms", (unsigned long)burst_polls,
+                 (now_us - burst_start_us) / 1000);
+        return false;
+    }
+    if (now_us < burst_next_us) {
+        return false;
+    }
+    burst_next_us = now_us + BURST_PERIOD_US;
+    burst_polls++;
+    return true;
+}
+
+bool power_quality_peek_event(power_event_t *event)
+{
+    return event_queue != NULL && xQueuePeek(event_queue, event, 0) == pdTRUE;
+}
+
+void power_quality_pop_event(void)
+{
+    power_event_t event;
+    if (event_queue != NULL) {
+        xQueueReceive(event_queue, &event, 0);
+    }
+}
+
+int power_quality_format_event(const power_event_t *event, char *buffer, size_t buffer_size)
+{
+    char extreme[16];
+    apc_hid_format_fixed(APC_FIELD_INPUT_VOLTAGE, event->extreme, extreme, sizeof(extreme));
+    return snprintf(buffer, buffer_size,
+        "{\"type\":\"%s\",\"start\":%lu,\"duration_ms\":%lu,\"%s\":%s,\"depth_pct\":%u,\"transfer\":%s}",
+        power_quality_type_name((power_event_type_t)event->type),
+        (unsigned long)event->start, (unsigned long)event->duration_ms,
+        event->type == POWER_EVENT_SWELL ? "max_v" : "min_v", extreme,
+        event->depth_pct, event->transfer ? "true" : "false");
+}
+
+const char* power_quality_type_name(power_event_type_t type)
+{
+    return (type < POWER_EVENT_TYPE_COUNT) ? type_names[type] : "unknown";
+}
+
+void power_quality_get_counts(uint32_t counts[POWER_EVENT_TYPE_COUNT])
+{
+    if (pq_mutex == NULL) {
+        memset(counts, 0, sizeof(uint32_t) * POWER_EVENT_TYPE_COUNT);
+        return;
+    }
+    xSemaphoreTake(pq_mutex, portMAX_DELAY);
+    memcpy(counts, event_counts, sizeof(event_counts));
+    xSemaphoreGive(pq_mutex);
+}
+
+bool power_quality_last_event(power_event_t *event)
+{
+    if (pq_mutex == NULL) {
+        return false;
+    }
+    xSemaphoreTake(pq_mutex, portMAX_DELAY);
+    bool have = have_last_event;
+    *event = last_event;
+    xSemaphoreGive(pq_mutex);
+    return have;
+}
@@ -0,0 +1,63 @@
+#ifndef POWER_QUALITY_H
+#define POWER_QUALITY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "apc_hid_parser.h"
+
+// Input power-quality events (IEEE 1159 style), classified from input
+// voltage samples against the nominal input voltage:
+// - sag: below 90% for less than a minute
+// - brownout: below 90% for a minute or more
+// - swell: above 110%
+// - outage: below 10%
+// A transfer to battery or an out-of-band sample starts a burst of fast
+// input voltage polls so short events are measured, not just glimpsed.
+typedef enum {
+    POWER_EVENT_SAG = 0,
+    POWER_EVENT_BROWNOUT,
+    POWER_EVENT_SWELL,
+    POWER_EVENT_OUTAGE,
+    POWER_EVENT_TYPE_COUNT
+} power_event_type_t;
+
+typedef struct {
+    uint8_t type;                      // power_event_type_t
+    bool transfer;                     // UPS went to battery during the event
+    uint32_t start;                    // Unix seconds, 0 if the clock was not set
+    uint32_t duration_ms;              // First out-of-band to first in-band sample
+    int32_t extreme;                   // Lowest (highest for swells) input voltage, input_voltage fixed point
+    uint8_t depth_pct;                 // Deviation of the extreme from nominal, % of nominal
+} power_event_t;
+
+esp_err_t power_quality_init(void);
+
+// Parser sample hook: input voltage, nominal input voltage and status
+void power_quality_sample(apc_field_t field, int32_t value);
+
+// Parser raw sample hook: an out-of-band input voltage starts a burst on
+// its first, unfiltered reading; events are still classified from filtered
+// samples, so a lone glitch costs a short burst but never an event
+void power_quality_raw_sample(apc_field_t field, int32_t value);
+
+// Decoding task, every loop: true if the input voltage report should be
+// polled now. Bursts are rate limited, capped in length and followed by a
+// cooldown so the regular poll cycle and interrupt reports keep their turn.
+bool power_quality_burst_due(int64_t now_us);
+
+// Oldest unpublished event, left queued until popped (MQTT task); false if none
+bool power_quality_peek_event(power_event_t *event);
+void power_quality_pop_event(void);
+
+// Compact JSON record of an event
+int power_quality_format_event(const power_event_t *event, char *buffer, size_t buffer_size);
+
+const char* power_quality_type_name(power_event_type_t type);
+
+// Events since boot by type, and the most recent one (false if none)
+void power_quality_get_counts(uint32_t counts[POWER_EVENT_TYPE_COUNT]);
+bool power_quality_last_event(power_event_t *event);
+
+#endif // POWER_QUALITY_H
@@ -0,0 +1,94 @@
+#include "quantile_sketch.h"
+#include <string.h>
+
+#define SUB_BUCKETS (1 << QUANTILE_SKETCH_SUB_BITS)
+
+void quantile_sketch_init(quantile_sketch_t *sketch, uint8_t min_octave)
+{
+    memset(sketch, 0, sizeof(*sketch));
+    sketch->min_octave = (min_octave < QUANTILE_SKETCH_SUB_BITS) ? QUANTILE_SKETCH_SUB_BITS : min_octave;
+}
+
+static int bucket_of(const quantile_sketch_t *sketch, int32_t value)
+{
+    if (value < (1 << sketch->min_octave)) {
+        return 0;
+    }
+    int octave = 31 - __builtin_clz((uint32_t)value);
+    int sub = (value >> (octave - QUANTILE_SKETCH_SUB_BITS)) & (SUB_BUCKETS - 1);
+    int bucket = ((octave - sketch->min_octave) << QUANTILE_SKETCH_SUB_BITS) + sub;
+    return (bucket < QUANTILE_SKETCH_BUCKETS) ? bucket : QUANTILE_SKETCH_BUCKETS - 1;
+}
+
+// Value at `fraction` (0..1) of the way through a bucket
+static int32_t bucket_value(const quantile_sketch_t *sketch, int bucket, float fraction)
+{
+    int octave = sketch->min_octave + (bucket >> QUANTILE_SKETCH_SUB_BITS);
+    int sub = bucket & (SUB_BUCKETS - 1);
+    int64_t width = (int64_t)1 << (octave - QUANTILE_SKETCH_SUB_BITS);
+    int64_t low = (int64_t)(SUB_BUCKETS + sub) * width;
+    int64_t v = low + (int64_t)(fraction * (float)width);
+    return (v > INT32_MAX) ? INT32_MAX : (int32_t)v;
+}
+
+void quantile_sketch_add(quantile_sketch_t *sketch, int32_t value)
+{
+    sketch->counts[bucket_of(sketch, value)]++;
+    if (sketch->count == 0 || value < sketch->min) {
+        sketch->min = value;
+    }
+    if (sketch->count == 0 || value > sketch->max) {
+        sketch->max = value;
+    }
+    sketch->count++;
+}
+
+void quantile_sketch_merge(quantile_sketch_t *dst, const quantile_sketch_t *src)
+{
+    if (src->count == 0 || src->min_octave != dst->min_octave) {
+        return;
+    }
+    for (int i = 0; i < QUANTILE_SKETCH_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    if (dst->count == 0 || src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (dst->count == 0 || src->max > dst->max) {
+        dst->max = src->max;
+    }
+    dst->count += src->count;
+}
+
+int32_t quantile_sketch_quantile(const quantile_sketch_t *sketch, float q)
+{
+    if (sketch->count == 0) {
+        return 0;
+    }
+    if (q <= 0.0f) {
+        return sketch->min;
+    }
+    if (q >= 1.0f) {
+        return sketch->max;
+    }
+
+    uint32_t rank = (uint32_t)(q * (float)(sketch->count - 1));
+    uint32_t seen = 0;
+    for (int i = 0; i < QUANTILE_SKETCH_BUCKETS; i++) {
+        uint32_t n = sketch->counts[i];
+        if (seen + n > rank) {
+            // Assume the samples are spread evenly across the bucket
+            int32_t v = bucket_value(sketch, i, ((float)(rank - seen) + 0.5f) / (float)n);
+            // The end buckets also hold out-of-range values
+            if (v < sketch->min) {
+                v = sketch->min;
+            }
+            if (v > sketch->max) {
+                v = sketch->max;
+            }
+            return v;
+        }
+        seen += n;
+    }
+    return sketch->max;
+}
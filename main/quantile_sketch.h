@@ -0,0 +1,37 @@
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+#include <stdint.h>
+
+// Mergeable quantile sketch with a fixed memory budget.
+//
+// A log-linear histogram: every power of two is split into 32 equal
+// buckets, so a bucket is at most 1/32 as wide as its lower bound and no
+// estimate is off by more than ~3% (interpolating inside the bucket, well
+// under 1% on smooth distributions). Eight octaves are kept from
+// 2^min_octave up; smaller values share the first bucket and larger ones
+// the last (min and max stay exact). Adding is a count-leading-zeros and an
+// increment; two sketches with the same min_octave merge by adding counts.
+
+#define QUANTILE_SKETCH_SUB_BITS 5
+#define QUANTILE_SKETCH_OCTAVES  8
+#define QUANTILE_SKETCH_BUCKETS  (QUANTILE_SKETCH_OCTAVES << QUANTILE_SKETCH_SUB_BITS)
+
+typedef struct {
+    uint32_t counts[QUANTILE_SKETCH_BUCKETS];
+    uint32_t count;
+    int32_t min;
+    int32_t max;
+    uint8_t min_octave;          // >= QUANTILE_SKETCH_SUB_BITS
+} quantile_sketch_t;
+
+void quantile_sketch_init(quantile_sketch_t *sketch, uint8_t min_octave);
+void quantile_sketch_add(quantile_sketch_t *sketch, int32_t value);
+
+// Add the samples of `src` to `dst`; both must have the same min_octave
+void quantile_sketch_merge(quantile_sketch_t *dst, const quantile_sketch_t *src);
+
+// Estimated q-quantile (0..1), 0 if the sketch is empty
+int32_t quantile_sketch_quantile(const quantile_sketch_t *sketch, float q);
+
+#endif // QUANTILE_SKETCH_H
@@ -0,0 +1,474 @@
+/*
+ * Feature report scheduler
+ *
+ * Reading every feature report on one timer spends as much bus time on the
+ * battery chemistry as on the input voltage. Instead each report in the
+ * poll list has a period, a priority and a jitter budget taken from its
+ * class (see report_scheduler.h):
+ *
+ *   class    period                  priority   jitter
+ *   live     CONFIG_UPS_POLL_INTERVAL_MS   0    period / 10
+ *   state    60 s                          1    period / 10
+ *   static   1 h                           2    period / 10
+ *
+ * When a report falls due, every report within its jitter budget of being
+ * due joins the sweep, so reads bunch into few sweeps instead of waking
+ * the task for each one. A sweep is capped at REPORT_SCHEDULER_MAX_SWEEP
+ * reads in priority order; whatever is left stays due and goes next.
+ *
+ * A report that STALLs SKIP_AFTER_STALLS times in a row is skipped: only
+ * re-probed every REPROBE_US. The skip list is a bitmap of report IDs saved
+ * in NVS under the model's VID/PID/bcdDevice and written only when it
+ * changes. Descriptors often declare reports the firmware never serves, so
+ * being declared is no exemption.
+ *
+ * A report that times out SKIP_AFTER_TIMEOUTS times in a row is skipped
+ * too, but for this connection only and re-probed every TIMEOUT_REPROBE_US:
+ * a UPS may be busy rather than lacking the report, so nothing is saved.
+ * Each timeout costs the 2 s control transfer wait plus recovery; without
+ * this a report that never completes costs that on every sweep.
+ *
+ * A report that answered since the UPS was connected is never skipped.
+ */
+
+#include "report_scheduler.h"
+#include "apc_hid_usage.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "report_sched";
+
+// As many as the parser's poll list holds (one per usage at most)
+#define MAX_REPORTS         APC_HID_MAX_USAGES
+
+#define LIVE_PERIOD_US      ((int64_t)CONFIG_UPS_POLL_INTERVAL_MS * 1000)
+#define STATE_PERIOD_US     (60 * 1000000LL)
+#define STATIC_PERIOD_US    (3600 * 1000000LL)
+
+#define SKIP_AFTER_STALLS   5
+#define REPROBE_US          (24 * 3600 * 1000000LL)
+#define SKIP_AFTER_TIMEOUTS 3
+#define TIMEOUT_REPROBE_US  (3600 * 1000000LL)
+
+#define NVS_NAMESPACE       "report_skip"
+
+typedef struct {
+    int64_t period_us;
+    int64_t jitter_us;
+    uint8_t priority;            // Lower reads first
+} class_params_t;
+
+static const class_params_t class_params[REPORT_CLASS_COUNT] = {
+    [REPORT_CLASS_LIVE]   = { LIVE_PERIOD_US,   LIVE_PERIOD_US / 10,   0 },
+    [REPORT_CLASS_STATE]  = { STATE_PERIOD_US,  STATE_PERIOD_US / 10,  1 },
+    [REPORT_CLASS_STATIC] = { STATIC_PERIOD_US, STATIC_PERIOD_US / 10, 2 },
+};
+
+typedef struct {
+    uint8_t report_id;
+    uint8_t cls;                 // report_class_t
+    uint8_t priority;
+    int64_t period_us;
+    int64_t jitter_us;
+    int64_t next_us;
+    uint8_t stalls;              // Consecutive STALLs
+    uint8_t timeouts;            // Consecutive timeouts
+    bool skipped;
+    bool timed_out;              // Skipped for timing out: this connection only, not saved
+    bool answered;               // Answered since the UPS was connected: never skipped
+} schedule_entry_t;
+
+// Decoding task only
+static schedule_entry_t entries[MAX_REPORTS];
+static int num_entries = 0;
+static int32_t last_status = -1;
+
+static report_scheduler_stats_t stats;
+
+// Skip list of the attached model, one bit per report ID (written by the
+// decoding task, formatted by any)
+static uint8_t skip_map[256 / 8];
+static uint16_t model_vid, model_pid, model_bcd;
+static bool have_model = false;
+
+// Fields whose fastest reader is a state or static report (set at build,
+// read by any task)
+static apc_field_mask_t slow_fields[REPORT_CLASS_COUNT];
+
+static report_class_t field_class(apc_field_t field)
+{
+    switch (field) {
+    case APC_FIELD_BATTERY_CHARGE:
+    case APC_FIELD_BATTERY_RUNTIME:
+    case APC_FIELD_BATTERY_VOLTAGE:
+    case APC_FIELD_INPUT_VOLTAGE:
+    case APC_FIELD_INPUT_FREQUENCY:
+    case APC_FIELD_OUTPUT_VOLTAGE:
+    case APC_FIELD_LOAD_PERCENT:
+    case APC_FIELD_SHUTDOWN_TIMER:
+    case APC_FIELD_REBOOT_TIMER:
+    case APC_FIELD_STATUS:
+        return REPORT_CLASS_LIVE;
+    case APC_FIELD_LAST_TRANSFER_REASON:
+    case APC_FIELD_SELF_TEST_RESULT:
+    case APC_FIELD_BEEPER_STATUS:
+    case APC_FIELD_INPUT_SENSITIVITY:
+        return REPORT_CLASS_STATE;
+    default:
+        return REPORT_CLASS_STATIC;
+    }
+}
+
+static bool skip_bit(uint8_t report_id)
+{
+    return (skip_map[report_id / 8] >> (report_id % 8)) & 1;
+}
+
+static void set_skip_bit(uint8_t report_id, bool skip)
+{
+    if (skip) {
+        skip_map[report_id / 8] |= (uint8_t)(1u << (report_id % 8));
+    } else {
+        skip_map[report_id / 8] &= (uint8_t)~(1u << (report_id % 8));
+    }
+}
+
+// NVS key: VID, PID and bcdDevice in hex (12 of the 15 characters allowed)
+static void model_key(char key[16])
+{
+    snprintf(key, 16, "%04x%04x%04x", model_vid, model_pid, model_bcd);
+}
+
+static void load_skip_list(void)
+{
+    memset(skip_map, 0, sizeof(skip_map));
+    char key[16];
+    model_key(key);
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        size_t len = sizeof(skip_map);
+        if (nvs_get_blob(nvs, key, skip_map, &len) != ESP_OK || len != sizeof(skip_map)) {
+            memset(skip_map, 0, sizeof(skip_map));
+        }
+        nvs_close(nvs);
+    }
+}
+
+static void save_skip_list(void)
+{
+    char key[16];
+    model_key(key);
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(nvs, key, skip_map, sizeof(skip_map)) == ESP_OK) {
+        nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+}
+
+static schedule_entry_t *find_entry(uint8_t report_id)
+{
+    for (int i = 0; i < num_entries; i++) {
+        if (entries[i].report_id == report_id) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+void report_scheduler_build(const apc_hid_parser_t *parser, uint16_t vid, uint16_t pid, uint16_t bcd_device,
+                            int64_t now_us)
+{
+    const apc_hid_usage_table_t *t = apc_hid_parser_get_table(parser);
+    const uint8_t *poll_reports;
+    int num_poll = apc_hid_parser_get_poll_list(parser, &poll_reports);
+
+    // Fields the UPS pushes on its own
+    apc_field_mask_t pushed = 0;
+    for (int u = 0; u < t->count; u++) {
+        if (t->usages[u].report_type == APC_HID_REPORT_INPUT) {
+            pushed |= APC_FIELD_BIT(t->usages[u].field);
+        }
+    }
+
+    model_vid = vid;
+    model_pid = pid;
+    model_bcd = bcd_device;
+    have_model = true;
+    load_skip_list();
+
+    if (num_poll > MAX_REPORTS) {
+        ESP_LOGW(TAG, "⚠️ Poll list has %d reports, scheduling the first %d", num_poll, MAX_REPORTS);
+        num_poll = MAX_REPORTS;
+    }
+
+    memset(stats.reports, 0, sizeof(stats.reports));
+    stats.pushed = 0;
+    stats.skipped = 0;
+    stats.timed_out = 0;
+    num_entries = 0;
+    last_status = -1;
+    apc_field_mask_t read_by[REPORT_CLASS_COUNT] = { 0 };
+
+    for (int i = 0; i < num_poll; i++) {
+        uint8_t report_id = poll_reports[i];
+        report_class_t cls = REPORT_CLASS_STATIC;
+        apc_field_mask_t fields = 0;
+        if (t->first[report_id] != APC_HID_NO_USAGE) {
+            for (int u = t->first[report_id]; u < t->first[report_id] + t->num[report_id]; u++) {
+                report_class_t c = field_class((apc_field_t)t->usages[u].field);
+                if (c < cls) {
+                    cls = c;
+                }
+                fields |= APC_FIELD_BIT(t->usages[u].field);
+            }
+        }
+        if (fields != 0 && (fields & ~pushed) == 0 && cls != REPORT_CLASS_STATIC) {
+            cls = REPORT_CLASS_STATIC;
+            stats.pushed++;
+        }
+
+        schedule_entry_t *e = &entries[num_entries++];
+        e->report_id = report_id;
+        e->cls = cls;
+        e->priority = class_params[cls].priority;
+        e->period_us = class_params[cls].period_us;
+        e->jitter_us = class_params[cls].jitter_us;
+        e->next_us = now_us;
+        e->stalls = 0;
+        e->timeouts = 0;
+        e->timed_out = false;
+        e->answered = false;
+        e->skipped = skip_bit(report_id);
+        if (e->skipped) {
+            e->next_us = now_us + REPROBE_US;
+            stats.skipped++;
+        }
+        stats.reports[cls]++;
+        read_by[cls] |= fields;
+    }
+
+    apc_field_mask_t state = read_by[REPORT_CLASS_STATE] & ~read_by[REPORT_CLASS_LIVE] & ~pushed;
+    apc_field_mask_t fixed = read_by[REPORT_CLASS_STATIC] & ~read_by[REPORT_CLASS_LIVE] &
+                             ~read_by[REPORT_CLASS_STATE] & ~pushed;
+    __atomic_store_n(&slow_fields[REPORT_CLASS_STATE], state, __ATOMIC_RELAXED);
+    __atomic_store_n(&slow_fields[REPORT_CLASS_STATIC], fixed, __ATOMIC_RELAXED);
+
+    ESP_LOGI(TAG, "📅 %d reports: %u live, %u state, %u static (%u covered by interrupt reports, %u skipped)",
+             num_entries, stats.reports[REPORT_CLASS_LIVE], stats.reports[REPORT_CLASS_STATE],
+             stats.reports[REPORT_CLASS_STATIC], stats.pushed, stats.skipped);
+}
+
+int report_scheduler_due(int64_t now_us, uint8_t *report_ids, int max_reports)
+{
+    bool any_due = false;
+    for (int i = 0; i < num_entries; i++) {
+        if (entries[i].next_us <= now_us) {
+            any_due = true;
+            break;
+        }
+    }
+    if (!any_due) {
+        return 0;
+    }
+
+    // Pick by priority, then by how overdue (a small selection; n <= MAX_REPORTS)
+    bool taken[MAX_REPORTS] = { false };
+    int count = 0;
+    while (count < max_reports) {
+        int best = -1;
+        for (int i = 0; i < num_entries; i++) {
+            const schedule_entry_t *e = &entries[i];
+            if (taken[i] || e->next_us - e->jitter_us > now_us) {
+                continue;
+            }
+            if (best < 0 || e->priority < entries[best].priority ||
+                (e->priority == entries[best].priority && e->next_us < entries[best].next_us)) {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        taken[best] = true;
+        schedule_entry_t *e = &entries[best];
+        e->next_us = now_us + (!e->skipped ? e->period_us : e->timed_out ? TIMEOUT_REPROBE_US : REPROBE_US);
+        stats.reads[e->cls]++;
+        report_ids[count++] = e->report_id;
+    }
+    return count;
+}
+
+int64_t report_scheduler_next_due(void)
+{
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < num_entries; i++) {
+        if (entries[i].next_us < next) {
+            next = entries[i].next_us;
+        }
+    }
+    return next;
+}
+
+static void skip_entry(schedule_entry_t *e, bool timed_out, int64_t now_us)
+{
+    e->skipped = true;
+    e->timed_out = timed_out;
+    e->next_us = now_us + (timed_out ? TIMEOUT_REPROBE_US : REPROBE_US);
+    stats.skipped++;
+    if (timed_out) {
+        stats.timed_out++;
+        ESP_LOGW(TAG, "⏭️ Report 0x%02X timed out %d times in a row, skipped until reconnect (re-probed hourly)",
+                 e->report_id, SKIP_AFTER_TIMEOUTS);
+        return;
+    }
+    set_skip_bit(e->report_id, true);
+    save_skip_list();
+    ESP_LOGW(TAG, "⏭️ Report 0x%02X not supported by %04X:%04X rev %04X, skipped (re-probed daily)",
+             e->report_id, model_vid, model_pid, model_bcd);
+}
+
+void report_scheduler_read_result(uint8_t report_id, esp_err_t err, int64_t now_us)
+{
+    schedule_entry_t *e = find_entry(report_id);
+    if (e == NULL) {
+        return;
+    }
+
+    if (err == ESP_OK) {
+        e->stalls = 0;
+        e->timeouts = 0;
+        e->answered = true;
+        if (e->skipped) {
+            e->skipped = false;
+            e->next_us = now_us + e->period_us;
+            stats.skipped--;
+            if (e->timed_out) {
+                e->timed_out = false;
+                stats.timed_out--;
+            } else {
+                set_skip_bit(report_id, false);
+                save_skip_list();
+            }
+            ESP_LOGI(TAG, "✅ Report 0x%02X answers again, no longer skipped", report_id);
+        }
+        return;
+    }
+
+    // Each kind only counts in a row; anything else (e.g. a device fault)
+    // says nothing about the report
+    uint8_t *count;
+    int limit;
+    if (err == ESP_ERR_NOT_SUPPORTED) {
+        e->timeouts = 0;
+        count = &e->stalls;
+        limit = SKIP_AFTER_STALLS;
+    } else if (err == ESP_ERR_TIMEOUT) {
+        e->stalls = 0;
+        count = &e->timeouts;
+        limit = SKIP_AFTER_TIMEOUTS;
+    } else {
+        return;
+    }
+
+    if (e->answered) {
+        ESP_LOGD(TAG, "Report 0x%02X failed (%s) but is known to answer, not skipped", report_id, esp_err_to_name(err));
+        return;
+    }
+    if (e->skipped || ++*count < limit) {
+        return;
+    }
+    skip_entry(e, err == ESP_ERR_TIMEOUT, now_us);
+}
+
+void report_scheduler_mark_read(uint8_t report_id, int64_t now_us)
+{
+    schedule_entry_t *e = find_entry(report_id);
+    if (e != NULL && !e->skipped) {
+        e->next_us = now_us + e->period_us;
+    }
+}
+
+bool report_scheduler_skipped(uint8_t report_id)
+{
+    schedule_entry_t *e = find_entry(report_id);
+    return e != NULL && e->skipped;
+}
+
+void report_scheduler_sample(apc_field_t field, int32_t value)
+{
+    if (field != APC_FIELD_STATUS) {
+        return;
+    }
+    bool changed = last_status >= 0 && value != last_status;
+    last_status = value;
+    if (!changed) {
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    for (int i = 0; i < num_entries; i++) {
+        if (entries[i].cls != REPORT_CLASS_STATIC && !entries[i].skipped && entries[i].next_us > now_us) {
+            entries[i].next_us = now_us;
+        }
+    }
+    stats.expedited++;
+}
+
+apc_field_mask_t report_scheduler_stale_fields(const ups_metrics_t *snapshot, int64_t stale_after_us, int64_t now_us)
+{
+    apc_field_mask_t state = __atomic_load_n(&slow_fields[REPORT_CLASS_STATE], __ATOMIC_RELAXED);
+    apc_field_mask_t fixed = __atomic_load_n(&slow_fields[REPORT_CLASS_STATIC], __ATOMIC_RELAXED);
+
+    apc_field_mask_t stale = apc_hid_stale_fields(snapshot, stale_after_us, now_us) & ~(state | fixed);
+    stale |= apc_hid_stale_fields(snapshot, STATE_PERIOD_US + stale_after_us, now_us) & state;
+    stale |= apc_hid_stale_fields(snapshot, STATIC_PERIOD_US + stale_after_us, now_us) & fixed;
+
+    // A derived field carries its oldest input's time (field order puts
+    // derived fields after their inputs)
+    for (int f = 0; f < APC_FIELD_COUNT; f++) {
+        apc_field_mask_t inputs = apc_hid_field_inputs((apc_field_t)f);
+        if (inputs != 0) {
+            stale = (stale & inputs) ? (stale | APC_FIELD_BIT(f)) : (stale & ~APC_FIELD_BIT(f));
+        }
+    }
+    return stale;
+}
+
+void report_scheduler_get_stats(report_scheduler_stats_t *out)
+{
+    *out = stats;
+}
+
+int report_scheduler_format_skipped(char *buffer, size_t buffer_size)
+{
+    if (!have_model) {
+        return snprintf(buffer, buffer_size, "no UPS yet");
+    }
+    int len = snprintf(buffer, buffer_size, "%04X:%04X rev %04X:", model_vid, model_pid, model_bcd);
+    int count = 0;
+    for (int id = 0; id < 256 && len >= 0 && (size_t)len < buffer_size; id++) {
+        if (skip_bit((uint8_t)id)) {
+            len += snprintf(buffer + len, buffer_size - len, "%s 0x%02X", count++ ? "," : "", id);
+        }
+    }
+    if (count == 0 && len >= 0 && (size_t)len < buffer_size) {
+        len += snprintf(buffer + len, buffer_size - len, " none");
+    }
+    // Skipped for timing out, not saved (decoding task state, read unlocked
+    // like the counters)
+    int timed_out = 0;
+    for (int i = 0; i < num_entries && len >= 0 && (size_t)len < buffer_size; i++) {
+        if (entries[i].skipped && entries[i].timed_out) {
+            len += snprintf(buffer + len, buffer_size - len, "%s 0x%02X", timed_out++ ? "," : "; timed out:",
+                            entries[i].report_id);
+        }
+    }
+    return len;
+}
@@ -0,0 +1,88 @@
+#ifndef REPORT_SCHEDULER_H
+#define REPORT_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "apc_hid_parser.h"
+
+// Feature report polling by how fast each report's values can change.
+// Every report in the model's poll list gets the class of its most volatile
+// field:
+// - live: voltages, load, frequency, timers; every UPS Poll Interval
+// - state: settings and results that change on events (transfer reason,
+//   self-test, beeper, sensitivity); every minute
+// - static: ratings, thresholds, chemistry, dates; at enumeration, then hourly
+// A report whose every field also arrives in interrupt reports is kept
+// current by the UPS and only read hourly. A change of PresentStatus makes
+// live and state reports due at once.
+//
+// Reports a model refuses (STALL, five times in a row) go on a skip list
+// kept in NVS per VID/PID/bcdDevice, so they cost no bus time from the next
+// connection on; they are re-probed daily. Reports that time out three
+// times in a row are skipped until the UPS reconnects and re-probed hourly.
+// A report that answered since the UPS was connected is never skipped, and
+// a skipped report is back as soon as it answers.
+typedef enum {
+    REPORT_CLASS_LIVE = 0,
+    REPORT_CLASS_STATE,
+    REPORT_CLASS_STATIC,
+    REPORT_CLASS_COUNT
+} report_class_t;
+
+// Most reports read in one sweep; the rest stay due for the next one
+#define REPORT_SCHEDULER_MAX_SWEEP 8
+
+// Decoding task only, from here to report_scheduler_sample()
+
+// Classify the parser's poll list against its usage table (after the report
+// descriptor is loaded) and load the model's skip list; every report not on
+// it is due at once
+void report_scheduler_build(const apc_hid_parser_t *parser, uint16_t vid, uint16_t pid, uint16_t bcd_device,
+                            int64_t now_us);
+
+// Reports to read now, highest priority first. Once one report is due, the
+// others within their jitter budget of being due are read in the same sweep.
+// The returned reports are rescheduled one period from now.
+int report_scheduler_due(int64_t now_us, uint8_t *report_ids, int max_reports);
+
+// Earliest time a report is due, INT64_MAX if none are scheduled
+int64_t report_scheduler_next_due(void);
+
+// Outcome of reading a report: ESP_OK counts as supported,
+// ESP_ERR_NOT_SUPPORTED (STALL) and ESP_ERR_TIMEOUT each count towards a
+// skip, anything else is ignored
+void report_scheduler_read_result(uint8_t report_id, esp_err_t err, int64_t now_us);
+
+// A report was read outside a sweep (e.g. a power-quality burst)
+void report_scheduler_mark_read(uint8_t report_id, int64_t now_us);
+bool report_scheduler_skipped(uint8_t report_id);
+
+// Parser sample hook: PresentStatus changes expedite live and state reports
+void report_scheduler_sample(apc_field_t field, int32_t value);
+
+// Any task from here on
+
+// apc_hid_stale_fields() with each field's own limit: `stale_after_us` for
+// live and pushed values, plus the read period for fields only state or
+// static reports carry. A derived field is stale when one of its inputs is.
+apc_field_mask_t report_scheduler_stale_fields(const ups_metrics_t *snapshot, int64_t stale_after_us, int64_t now_us);
+
+typedef struct {
+    uint8_t reports[REPORT_CLASS_COUNT];   // Scheduled reports per class
+    uint8_t pushed;                        // Reports demoted because interrupt reports cover them
+    uint8_t skipped;                       // Reports skipped, saved or for this connection
+    uint8_t timed_out;                     // Of those, skipped for timing out (not saved)
+    uint32_t reads[REPORT_CLASS_COUNT];    // Reads since boot per class
+    uint32_t expedited;                    // Status changes that made reports due early
+} report_scheduler_stats_t;
+
+// Counters only, no lock
+void report_scheduler_get_stats(report_scheduler_stats_t *stats);
+
+// The model and its skipped report IDs, e.g.
+// "051D:0002 rev 0106: 0x24, 0x36; timed out: 0x40"
+int report_scheduler_format_skipped(char *buffer, size_t buffer_size);
+
+#endif // REPORT_SCHEDULER_H
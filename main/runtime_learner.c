@@ -0,0 +1,361 @@
+/*
+ * Discharge-curve learner
+ *
+ * While the UPS is on battery, every load sample adds load x time to the
+ * episode's energy; charge samples track how far the charge has fallen.
+ * When line power returns, an episode long and deep enough becomes one
+ * point: x = ln(average watts), y = ln(runtime a full charge would last at
+ * that rate). A weighted least-squares line through the points gives
+ * Peukert's law, ln T_full = ln K - n ln P. Older episodes are decayed so
+ * the model follows the battery as it ages.
+ *
+ * Until the points span a useful range of loads, n is fixed at a typical
+ * lead-acid value and only K is fitted.
+ *
+ * The deepest discharges are the most telling and the likeliest never to
+ * see line power return, so an episode also ends when the UPS signals low
+ * battery (it shuts down next). The episode in progress is checkpointed to
+ * NVS every CHECKPOINT_DROP % of charge; one found at boot, left by a
+ * bridge that lost power or restarted on battery, is learned as it stood
+ * at its last checkpoint.
+ */
+
+#include "runtime_learner.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <math.h>
+#include <string.h>
+
+static const char *TAG = "runtime";
+
+#define NVS_NAMESPACE       "runtime"
+#define NVS_KEY_MODEL       "model"
+#define NVS_KEY_EPISODE     "episode"
+#define MODEL_VERSION       1
+
+#define MIN_EPISODE_US      (60 * 1000000LL)   // Shorter discharges say too little
+#define MIN_EPISODE_DROP    5                  // % charge
+#define EPISODE_DECAY       0.9f               // Weight left to older episodes
+#define DEFAULT_EXPONENT    1.2f               // Peukert n for sealed lead-acid
+#define MIN_SPREAD_LN_WATTS 0.1f               // Weighted variance of ln P needed to fit n
+#define MIN_EXPONENT        1.0f
+#define MAX_EXPONENT        1.6f
+#define CHECKPOINT_DROP     5                  // % charge between episode checkpoints
+
+// Longest load interval counted: the stale limit or two poll intervals
+#define STALE_US            (CONFIG_UPS_STALE_AFTER_MS * 1000LL)
+#define POLL_GAP_US         (2 * CONFIG_UPS_POLL_INTERVAL_MS * 1000LL)
+#define MAX_INTERVAL_US     (STALE_US > POLL_GAP_US ? STALE_US : POLL_GAP_US)
+
+// Weighted regression sums of (ln P, ln T_full), as stored in NVS
+typedef struct {
+    uint32_t version;
+    uint32_t episodes;
+    float s0;
+    float sx;
+    float sy;
+    float sxx;
+    float sxy;
+} runtime_model_t;
+
+static SemaphoreHandle_t learner_mutex = NULL;
+static runtime_model_t model;
+
+// A discharge as it stood at its last checkpoint, as stored in NVS
+typedef struct {
+    uint32_t version;
+    int32_t start_charge;
+    int32_t charge;
+    int32_t reserved;
+    int64_t duration_us;
+    int64_t load_us;
+    double watt_us;
+} episode_checkpoint_t;
+
+// Fitted from the model: ln T_full = intercept - exponent * ln P
+static float fit_intercept = 0.0f;
+static float fit_exponent = DEFAULT_EXPONENT;
+
+// Latest samples (decoding task only)
+static int32_t output_watts = -1;          // APC_FIELD_OUTPUT_POWER, held since load_time_us
+static int32_t charge = -1;
+static int64_t load_time_us = 0;
+static bool on_battery = false;
+
+// Current discharge
+static bool episode_active = false;
+static int64_t episode_start_us = 0;
+static int32_t episode_start_charge = 0;
+static double episode_watt_us = 0;
+static int64_t episode_load_us = 0;
+static int32_t checkpoint_charge = 0;      // Charge at the last checkpoint
+static bool have_status = false;           // A status sample was seen since boot
+
+static volatile int32_t predicted_runtime = -1;
+static runtime_episode_cb_t episode_cb = NULL;
+
+// Caller holds learner_mutex
+static void refit(void)
+{
+    fit_exponent = DEFAULT_EXPONENT;
+    if (model.episodes == 0 || model.s0 <= 0.0f) {
+        return;
+    }
+    float mean_x = model.sx / model.s0;
+    float mean_y = model.sy / model.s0;
+    float var_x = model.sxx / model.s0 - mean_x * mean_x;
+    if (model.episodes >= 2 && var_x >= MIN_SPREAD_LN_WATTS * MIN_SPREAD_LN_WATTS) {
+        float cov = model.sxy / model.s0 - mean_x * mean_y;
+        fit_exponent = fminf(fmaxf(-cov / var_x, MIN_EXPONENT), MAX_EXPONENT);
+    }
+    fit_intercept = mean_y + fit_exponent * mean_x;
+}
+
+// Caller holds learner_mutex
+static int32_t predict_locked(int32_t watts, int32_t charge_percent)
+{
+    if (model.episodes == 0 || watts <= 0 || charge_percent < 0) {
+        return -1;
+    }
+    float full_s = expf(fit_intercept - fit_exponent * logf((float)watts));
+    float s = full_s * (float)charge_percent / 100.0f;
+    return (s > (float)INT32_MAX) ? INT32_MAX : (int32_t)s;
+}
+
+static void save_model(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(nvs, NVS_KEY_MODEL, &model, sizeof(model)) == ESP_OK) {
+        nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+}
+
+static void save_checkpoint(int64_t now_us)
+{
+    episode_checkpoint_t cp = {
+        .version = MODEL_VERSION,
+        .start_charge = episode_start_charge,
+        .charge = charge,
+        .duration_us = now_us - episode_start_us,
+        .load_us = episode_load_us,
+        .watt_us = episode_watt_us,
+    };
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(nvs, NVS_KEY_EPISODE, &cp, sizeof(cp)) == ESP_OK) {
+        nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    checkpoint_charge = charge;
+}
+
+static void clear_checkpoint(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_erase_key(nvs, NVS_KEY_EPISODE) == ESP_OK) {
+        nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+}
+
+static void learn_episode(int64_t duration_us, int32_t drop, double watt_us, int64_t load_us)
+{
+    if (duration_us < MIN_EPISODE_US || drop < MIN_EPISODE_DROP || load_us <= 0) {
+        ESP_LOGI(TAG, "🔋 Discharge ignored (%lld s, %ld%% drop)", duration_us / 1000000, (long)drop);
+        return;
+    }
+
+    float watts = (float)(watt_us / (double)load_us);
+    if (watts < 1.0f) {
+        return;
+    }
+    float full_s = (float)duration_us / 1e6f * 100.0f / (float)drop;
+    float x = logf(watts);
+    float y = logf(full_s);
+
+    xSemaphoreTake(learner_mutex, portMAX_DELAY);
+    model.s0 = model.s0 * EPISODE_DECAY + 1.0f;
+    model.sx = model.sx * EPISODE_DECAY + x;
+    model.sy = model.sy * EPISODE_DECAY + y;
+    model.sxx = model.sxx * EPISODE_DECAY + x * x;
+    model.sxy = model.sxy * EPISODE_DECAY + x * y;
+    model.episodes++;
+    refit();
+    float exponent = fit_exponent;
+    xSemaphoreGive(learner_mutex);
+    save_model();
+
+    if (episode_cb != NULL) {
+        episode_cb(watts, full_s, exponent, drop);
+    }
+
+    ESP_LOGI(TAG, "🔋 Learned discharge #%lu: %.0f W, %ld%% in %lld s → %.0f s full, n=%.2f",
+             (unsigned long)model.episodes, watts, (long)drop, duration_us / 1000000, full_s, fit_exponent);
+}
+
+static void end_episode(int64_t now_us)
+{
+    episode_active = false;
+    clear_checkpoint();
+    learn_episode(now_us - episode_start_us, episode_start_charge - charge, episode_watt_us, episode_load_us);
+}
+
+// A discharge checkpointed before the bridge restarted ends where it was
+// last saved; what happened while the bridge was down is unknown
+static void end_saved_episode(void)
+{
+    episode_checkpoint_t cp;
+    size_t len = sizeof(cp);
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    esp_err_t err = nvs_get_blob(nvs, NVS_KEY_EPISODE, &cp, &len);
+    nvs_close(nvs);
+    if (err != ESP_OK) {
+        return;
+    }
+    clear_checkpoint();
+    if (len == sizeof(cp) && cp.version == MODEL_VERSION) {
+        ESP_LOGI(TAG, "🔋 Discharge interrupted by a restart, learning it up to its last checkpoint");
+        learn_episode(cp.duration_us, cp.start_charge - cp.charge, cp.watt_us, cp.load_us);
+    }
+}
+
+esp_err_t runtime_learner_init(void)
+{
+    learner_mutex = xSemaphoreCreateMutex();
+    if (learner_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create learner mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(&model, 0, sizeof(model));
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        size_t len = sizeof(model);
+        if (nvs_get_blob(nvs, NVS_KEY_MODEL, &model, &len) != ESP_OK ||
+            len != sizeof(model) || model.version != MODEL_VERSION) {
+            memset(&model, 0, sizeof(model));
+        }
+        nvs_close(nvs);
+    }
+    model.version = MODEL_VERSION;
+    refit();
+
+    ESP_LOGI(TAG, "🔋 Runtime model: %lu discharges, n=%.2f", (unsigned long)model.episodes, fit_exponent);
+    return ESP_OK;
+}
+
+void runtime_learner_sample(apc_field_t field, int32_t value)
+{
+    if (learner_mutex == NULL) {
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+
+    switch (field) {
+    case APC_FIELD_BATTERY_CHARGE:
+        charge = value;
+        if (episode_active && checkpoint_charge - charge >= CHECKPOINT_DROP) {
+            save_checkpoint(now_us);
+        }
+        break;
+
+    case APC_FIELD_OUTPUT_POWER: {
+        // Watts held since the previous output power sample
+        int64_t elapsed_us = now_us - load_time_us;
+        if (episode_active && output_watts > 0 && load_time_us != 0 && elapsed_us <= MAX_INTERVAL_US) {
+            episode_watt_us += (double)output_watts * elapsed_us;
+            episode_load_us += elapsed_us;
+        }
+        output_watts = value;
+        load_time_us = now_us;
+        break;
+    }
+
+    case APC_FIELD_STATUS: {
+        if (!have_status) {
+            have_status = true;
+            end_saved_episode();
+        }
+        bool was_on_battery = on_battery;
+        on_battery = !(value & APC_STATUS_BIT(APC_STATUS_ONLINE));
+        if (on_battery && !was_on_battery && charge >= 0) {
+            episode_active = true;
+            episode_start_us = now_us;
+            episode_start_charge = charge;
+            episode_watt_us = 0;
+            episode_load_us = 0;
+            checkpoint_charge = charge;
+        } else if (episode_active && (!on_battery || (value & APC_STATUS_BIT(APC_STATUS_LOW_BATTERY)))) {
+            // Line power is back, or the UPS is about to shut down
+            end_episode(now_us);
+        }
+        return;
+    }
+
+    default:
+        return;
+    }
+
+    xSemaphoreTake(learner_mutex, portMAX_DELAY);
+    predicted_runtime = predict_locked(output_watts, charge);
+    xSemaphoreGive(learner_mutex);
+}
+
+int32_t runtime_learner_predict(int32_t watts)
+{
+    if (learner_mutex == NULL) {
+        return -1;
+    }
+    xSemaphoreTake(learner_mutex, portMAX_DELAY);
+    int32_t s = predict_locked(watts, charge);
+    xSemaphoreGive(learner_mutex);
+    return s;
+}
+
+int32_t runtime_learner_predicted_runtime(void)
+{
+    return predicted_runtime;
+}
+
+void runtime_learner_get_info(runtime_model_info_t *info)
+{
+    if (learner_mutex == NULL) {
+        memset(info, 0, sizeof(*info));
+        return;
+    }
+    xSemaphoreTake(learner_mutex, portMAX_DELAY);
+    info->episodes = model.episodes;
+    info->exponent = fit_exponent;
+    info->full_runtime_100w = (model.episodes > 0) ? expf(fit_intercept - fit_exponent * logf(100.0f)) : 0.0f;
+    xSemaphoreGive(learner_mutex);
+}
+
+void runtime_learner_set_episode_callback(runtime_episode_cb_t callback)
+{
+    episode_cb = callback;
+}
+
+int32_t runtime_learner_charge(void)
+{
+    return charge;
+}
+
+int32_t runtime_learner_watts(void)
+{
+    return output_watts;
+}
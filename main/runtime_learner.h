@@ -0,0 +1,45 @@
+#ifndef RUNTIME_LEARNER_H
+#define RUNTIME_LEARNER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "apc_hid_parser.h"
+
+// Runtime prediction learned from real on-battery episodes.
+//
+// Each discharge gives one point (average watts, full-charge runtime at that
+// load); a Peukert model T_full = K / P^n is fitted over them and kept in
+// NVS. Predicted runtime = charge% x T_full at the present load.
+
+typedef struct {
+    uint32_t episodes;           // Discharges learned from (0 = no model yet)
+    float exponent;              // Peukert n
+    float full_runtime_100w;     // T_full at 100 W, seconds
+} runtime_model_info_t;
+
+// Load the learned model (call after nvs_flash_init)
+esp_err_t runtime_learner_init(void);
+
+// Parser sample hook: output power, charge and status samples
+void runtime_learner_sample(apc_field_t field, int32_t value);
+
+// Seconds left from the current charge at `watts`, -1 without a model
+int32_t runtime_learner_predict(int32_t watts);
+
+// Seconds left at the present load, updated with every sample; -1 without
+// a model or before load and charge are known
+int32_t runtime_learner_predicted_runtime(void);
+
+void runtime_learner_get_info(runtime_model_info_t *info);
+
+// Called from the decoding task for every discharge learned from, with its
+// average load, the full-charge runtime it implies, the fitted exponent and
+// how far the charge fell (%)
+typedef void (*runtime_episode_cb_t)(float watts, float full_runtime_s, float exponent, int32_t drop);
+void runtime_learner_set_episode_callback(runtime_episode_cb_t callback);
+
+// Present charge and load as last sampled (-1 if unknown)
+int32_t runtime_learner_charge(void);
+int32_t runtime_learner_watts(void);
+
+#endif // RUNTIME_LEARNER_H
@@ -0,0 +1,441 @@
+/*
+ * Battery state-of-health estimator
+ *
+ * Every signal is compared with a baseline: the best median of three
+ * consecutive measurements the installed battery has shown. One lucky
+ * reading moves no median, so noise cannot lock in a baseline the battery
+ * never meets again, while a replacement recovers by itself (two of its
+ * first three measurements beat the old battery's). Until three exist the
+ * baseline is the less favorable median of those so far.
+ *
+ * - capacity: each discharge the runtime learner accepts gives the runtime
+ *   a full charge would last; scaled to 100 W with the fitted exponent
+ *   (T100 = T_full * (P / 100)^n) so discharges at different loads compare.
+ *   Only discharges of MIN_BASELINE_DROP % or more feed the baseline; a
+ *   shallower one is only scored against it
+ * - internal resistance: the drop from the on-line battery voltage to the
+ *   lowest voltage in the first SAG_WINDOW_US on battery, over the current
+ *   drawn (R = dV / (P / V))
+ * - charge time: seconds per % recharged after a discharge
+ *
+ * Each completed measurement updates SoH (weighted ratio of the components
+ * seen so far, smoothed) and appends it to a small NVS history. A
+ * least-squares line through the history projects the replacement date.
+ */
+
+#include "soh_estimator.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+static const char *TAG = "soh";
+
+#define NVS_NAMESPACE       "soh"
+#define NVS_KEY_STATE       "state"
+#define STATE_VERSION       2
+
+#define HISTORY_LEN         16
+#define BASELINE_WINDOW     3          // Consecutive measurements per median
+
+#define SAG_WINDOW_US       (30 * 1000000LL)
+#define LINE_VOLTAGE_MAX_AGE_US (CONFIG_UPS_STALE_AFTER_MS * 1000LL)
+#define MIN_SAG_WATTS       20
+#define MIN_SAG_CV          5          // Below this the 10 mV resolution dominates
+#define MIN_RECHARGE        10         // % recharged for a charge-time measurement
+#define MIN_BASELINE_DROP   20         // % discharged for a capacity baseline
+
+// Component weights: capacity is what matters, resistance moves earlier,
+// charge time is the noisiest
+#define WEIGHT_CAPACITY     0.6f
+#define WEIGHT_RESISTANCE   0.3f
+#define WEIGHT_CHARGE       0.1f
+#define SMOOTHING           0.3f       // Weight of the newest measurement
+
+#define REPLACE_SOH         60.0f      // % at which a battery is due
+#define MIN_TREND_POINTS    3
+#define MIN_TREND_SPAN_S    (7 * 86400.0)
+#define MAX_PROJECTION_S    (10 * 365 * 86400.0)
+#define CLOCK_VALID_AFTER   1600000000 // Before SNTP, time() counts from boot
+
+typedef struct {
+    uint32_t time;                      // Unix seconds, 0 if the clock was not set
+    float soh;
+} soh_point_t;
+
+typedef struct {
+    float best;                         // Best full-window median, 0 = none
+    float recent[BASELINE_WINDOW];      // Newest first
+    uint32_t count;                     // Valid entries in recent[]
+} soh_baseline_t;
+
+// As stored in NVS
+typedef struct {
+    uint32_t version;
+    soh_baseline_t capacity;            // Full-charge seconds at 100 W
+    soh_baseline_t resistance;          // Ohms
+    soh_baseline_t charge_time;         // Seconds per % recharged
+    float capacity_ratio;               // Latest component ratios, < 0 = none
+    float resistance_ratio;
+    float charge_ratio;
+    float soh;                          // %, < 0 = none yet
+    uint32_t history_count;
+    uint32_t history_head;
+    soh_point_t history[HISTORY_LEN];
+} soh_state_t;
+
+static SemaphoreHandle_t soh_mutex = NULL;
+static soh_state_t state;
+
+// Latest samples (decoding task only)
+static int32_t output_watts = -1;          // APC_FIELD_OUTPUT_POWER
+static int32_t charge = -1;
+static int32_t line_voltage_cv = -1;
+static int64_t line_voltage_us = 0;
+static bool on_battery = false;
+
+// Voltage sag in the first seconds on battery
+static bool sag_active = false;
+static int64_t sag_start_us = 0;
+static int32_t sag_line_cv = 0;
+static int32_t sag_min_cv = 0;
+static int32_t sag_watts = 0;
+
+// Recharge after a discharge
+static bool recharge_active = false;
+static int64_t recharge_start_us = 0;
+static int32_t recharge_start_charge = 0;
+
+static volatile int32_t health = -1;
+
+static void save_state(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(nvs, NVS_KEY_STATE, &state, sizeof(state)) == ESP_OK) {
+        nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+}
+
+static bool is_better(float a, float b, bool higher_better)
+{
+    return higher_better ? a > b : a < b;
+}
+
+// Median of the recent measurements; of two, the less favorable one
+static float baseline_median(const soh_baseline_t *b, bool higher_better)
+{
+    float sorted[BASELINE_WINDOW];
+    uint32_t n = b->count;
+    memcpy(sorted, b->recent, n * sizeof(float));
+    // Worst first
+    for (uint32_t i = 1; i < n; i++) {
+        float v = sorted[i];
+        uint32_t j = i;
+        while (j > 0 && is_better(sorted[j - 1], v, higher_better)) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    return sorted[(n - 1) / 2];
+}
+
+// Baseline to compare a measurement with, 0 = none yet. Caller holds soh_mutex
+static float baseline_value(const soh_baseline_t *b, bool higher_better)
+{
+    if (b->best > 0.0f) {
+        return b->best;
+    }
+    return (b->count > 0) ? baseline_median(b, higher_better) : 0.0f;
+}
+
+// Add a measurement and return the baseline it is compared with; a better
+// median of the last BASELINE_WINDOW becomes the baseline. Caller holds
+// soh_mutex
+static float baseline_add(soh_baseline_t *b, float value, bool higher_better)
+{
+    memmove(&b->recent[1], &b->recent[0], (BASELINE_WINDOW - 1) * sizeof(float));
+    b->recent[0] = value;
+    if (b->count < BASELINE_WINDOW) {
+        b->count++;
+    }
+    if (b->count == BASELINE_WINDOW) {
+        float median = baseline_median(b, higher_better);
+        if (b->best <= 0.0f || is_better(median, b->best, higher_better)) {
+            b->best = median;
+        }
+    }
+    return baseline_value(b, higher_better);
+}
+
+// Caller holds soh_mutex
+static void update_health(void)
+{
+    float sum = 0.0f;
+    float weight = 0.0f;
+    if (state.capacity_ratio >= 0.0f) {
+        sum += WEIGHT_CAPACITY * state.capacity_ratio;
+        weight += WEIGHT_CAPACITY;
+    }
+    if (state.resistance_ratio >= 0.0f) {
+        sum += WEIGHT_RESISTANCE * state.resistance_ratio;
+        weight += WEIGHT_RESISTANCE;
+    }
+    if (state.charge_ratio >= 0.0f) {
+        sum += WEIGHT_CHARGE * state.charge_ratio;
+        weight += WEIGHT_CHARGE;
+    }
+    if (weight <= 0.0f) {
+        return;
+    }
+
+    float raw = 100.0f * sum / weight;
+    state.soh = (state.soh < 0.0f) ? raw : state.soh + SMOOTHING * (raw - state.soh);
+
+    time_t now = time(NULL);
+    soh_point_t *point = &state.history[state.history_head];
+    point->time = (now >= CLOCK_VALID_AFTER) ? (uint32_t)now : 0;
+    point->soh = state.soh;
+    state.history_head = (state.history_head + 1) % HISTORY_LEN;
+    if (state.history_count < HISTORY_LEN) {
+        state.history_count++;
+    }
+
+    health = (int32_t)lroundf(state.soh);
+}
+
+// Record one measurement (decoding task)
+static void commit_measurement(const char *what, float ratio, float *component)
+{
+    xSemaphoreTake(soh_mutex, portMAX_DELAY);
+    *component = fminf(ratio, 1.0f);
+    update_health();
+    float soh = state.soh;
+    xSemaphoreGive(soh_mutex);
+    save_state();
+
+    ESP_LOGI(TAG, "🩺 %s at %.0f%% of baseline → SoH %.0f%%", what, ratio * 100.0f, soh);
+}
+
+static void end_sag(void)
+{
+    sag_active = false;
+
+    int32_t sag_cv = sag_line_cv - sag_min_cv;
+    if (sag_watts < MIN_SAG_WATTS || sag_cv < MIN_SAG_CV || sag_min_cv <= 0) {
+        return;
+    }
+    float volts = (float)sag_min_cv / 100.0f;
+    float amps = (float)sag_watts / volts;
+    float ohms = ((float)sag_cv / 100.0f) / amps;
+
+    xSemaphoreTake(soh_mutex, portMAX_DELAY);
+    float baseline = baseline_add(&state.resistance, ohms, false);
+    xSemaphoreGive(soh_mutex);
+    float ratio = baseline / ohms;
+
+    ESP_LOGI(TAG, "🩺 Sag %.2f V at %ld W → %.0f mΩ (baseline %.0f mΩ)", (float)sag_cv / 100.0f,
+             (long)sag_watts, ohms * 1000.0f, baseline * 1000.0f);
+    commit_measurement("Resistance", ratio, &state.resistance_ratio);
+}
+
+esp_err_t soh_estimator_init(void)
+{
+    soh_mutex = xSemaphoreCreateMutex();
+    if (soh_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create SoH mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(&state, 0, sizeof(state));
+    nvs_handle_t nvs;
+    bool loaded = false;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        size_t len = sizeof(state);
+        loaded = nvs_get_blob(nvs, NVS_KEY_STATE, &state, &len) == ESP_OK &&
+                 len == sizeof(state) && state.version == STATE_VERSION;
+        nvs_close(nvs);
+    }
+    if (!loaded) {
+        memset(&state, 0, sizeof(state));
+        state.version = STATE_VERSION;
+        state.capacity_ratio = -1.0f;
+        state.resistance_ratio = -1.0f;
+        state.charge_ratio = -1.0f;
+        state.soh = -1.0f;
+    }
+    if (state.soh >= 0.0f) {
+        health = (int32_t)lroundf(state.soh);
+    }
+
+    ESP_LOGI(TAG, "🩺 Battery health: %ld%% (%lu measurements)", (long)health,
+             (unsigned long)state.history_count);
+    return ESP_OK;
+}
+
+void soh_estimator_sample(apc_field_t field, int32_t value)
+{
+    if (soh_mutex == NULL) {
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+
+    switch (field) {
+    case APC_FIELD_OUTPUT_POWER:
+        output_watts = value;
+        if (sag_active && output_watts > sag_watts) {
+            sag_watts = output_watts;
+        }
+        break;
+
+    case APC_FIELD_BATTERY_VOLTAGE:
+        if (!on_battery) {
+            line_voltage_cv = value;
+            line_voltage_us = now_us;
+        } else if (sag_active) {
+            if (value < sag_min_cv) {
+                sag_min_cv = value;
+            }
+            if (now_us - sag_start_us >= SAG_WINDOW_US) {
+                end_sag();
+            }
+        }
+        break;
+
+    case APC_FIELD_BATTERY_CHARGE:
+        charge = value;
+        if (recharge_active && !on_battery && charge >= 100) {
+            recharge_active = false;
+            int32_t recharged = 100 - recharge_start_charge;
+            if (recharged >= MIN_RECHARGE) {
+                float s_per_pct = (float)(now_us - recharge_start_us) / 1e6f / (float)recharged;
+                xSemaphoreTake(soh_mutex, portMAX_DELAY);
+                float baseline = baseline_add(&state.charge_time, s_per_pct, false);
+                xSemaphoreGive(soh_mutex);
+                float ratio = baseline / s_per_pct;
+                ESP_LOGI(TAG, "🩺 Recharged %ld%% at %.0f s/%% (baseline %.0f s/%%)", (long)recharged,
+                         s_per_pct, baseline);
+                commit_measurement("Charge time", ratio, &state.charge_ratio);
+            }
+        }
+        break;
+
+    case APC_FIELD_STATUS: {
+        bool was_on_battery = on_battery;
+        on_battery = !(value & APC_STATUS_BIT(APC_STATUS_ONLINE));
+        if (on_battery && !was_on_battery) {
+            recharge_active = false;
+            sag_active = line_voltage_cv > 0 && now_us - line_voltage_us <= LINE_VOLTAGE_MAX_AGE_US;
+            sag_start_us = now_us;
+            sag_line_cv = line_voltage_cv;
+            sag_min_cv = line_voltage_cv;
+            sag_watts = output_watts;
+        } else if (!on_battery && was_on_battery) {
+            if (sag_active) {
+                end_sag();
+            }
+            recharge_active = charge >= 0 && charge < 100;
+            recharge_start_us = now_us;
+            recharge_start_charge = charge;
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void soh_estimator_discharge(float watts, float full_runtime_s, float exponent, int32_t drop)
+{
+    if (soh_mutex == NULL || watts <= 0.0f || full_runtime_s <= 0.0f) {
+        return;
+    }
+    float full_100w_s = full_runtime_s * powf(watts / 100.0f, exponent);
+
+    // A shallow discharge extrapolates a few % of charge to a full one: too
+    // coarse to set the baseline, but still scored against it
+    xSemaphoreTake(soh_mutex, portMAX_DELAY);
+    float baseline = (drop >= MIN_BASELINE_DROP) ? baseline_add(&state.capacity, full_100w_s, true)
+                                                 : baseline_value(&state.capacity, true);
+    xSemaphoreGive(soh_mutex);
+
+    ESP_LOGI(TAG, "🩺 Capacity %.0f s at 100 W from a %ld%% discharge (baseline %.0f s)", full_100w_s,
+             (long)drop, baseline);
+    if (baseline <= 0.0f) {
+        return;
+    }
+    commit_measurement("Capacity", full_100w_s / baseline, &state.capacity_ratio);
+}
+
+int32_t soh_estimator_health(void)
+{
+    return health;
+}
+
+bool soh_estimator_replace_date(char *buffer, size_t buffer_size)
+{
+    if (soh_mutex == NULL) {
+        return false;
+    }
+
+    // Fit soh = a + b * t over the timed history, t relative to the first
+    // point so float keeps its precision
+    xSemaphoreTake(soh_mutex, portMAX_DELAY);
+    uint32_t origin = 0;
+    double n = 0, st = 0, ss = 0, stt = 0, sts = 0, t_max = 0;
+    for (uint32_t i = 0; i < state.history_count; i++) {
+        uint32_t index = (state.history_head + HISTORY_LEN - state.history_count + i) % HISTORY_LEN;
+        const soh_point_t *point = &state.history[index];
+        if (point->time == 0) {
+            continue;
+        }
+        if (origin == 0) {
+            origin = point->time;
+        }
+        double t = (double)(point->time - origin);
+        n += 1;
+        st += t;
+        ss += point->soh;
+        stt += t * t;
+        sts += t * point->soh;
+        t_max = t;
+    }
+    float soh = state.soh;
+    xSemaphoreGive(soh_mutex);
+
+    time_t now = time(NULL);
+    if (n < MIN_TREND_POINTS || t_max < MIN_TREND_SPAN_S || now < CLOCK_VALID_AFTER) {
+        return false;
+    }
+    double var = n * stt - st * st;
+    if (var <= 0) {
+        return false;
+    }
+    double slope = (n * sts - st * ss) / var;  // % per second
+    if (slope >= 0) {
+        return false;
+    }
+    double intercept = (ss - slope * st) / n;
+
+    double t_replace = (REPLACE_SOH - intercept) / slope;
+    time_t when = (time_t)origin + (time_t)t_replace;
+    if (soh <= REPLACE_SOH || when < now) {
+        when = now;
+    }
+    if ((double)(when - now) > MAX_PROJECTION_S) {
+        return false;
+    }
+
+    struct tm tm;
+    gmtime_r(&when, &tm);
+    return strftime(buffer, buffer_size, "%Y-%m-%d", &tm) > 0;
+}
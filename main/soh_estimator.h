@@ -0,0 +1,38 @@
+#ifndef SOH_ESTIMATOR_H
+#define SOH_ESTIMATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "apc_hid_parser.h"
+
+// Battery state of health, long before the UPS's own replace-battery flag.
+//
+// Three signals, each compared with a baseline for this battery (the best
+// median of three consecutive measurements):
+// - capacity: full-charge runtime of each learned discharge, normalized to
+//   100 W with the Peukert exponent
+// - internal resistance: battery voltage sag in the first 30 s on battery
+//   divided by the current drawn
+// - charge time: seconds per % to recharge after a discharge
+// SoH is their weighted ratio, smoothed over events. A least-squares trend
+// over the last events projects when SoH reaches 60%.
+
+// Load the history (call after nvs_flash_init)
+esp_err_t soh_estimator_init(void);
+
+// Parser sample hook: status, battery voltage, charge and output power
+void soh_estimator_sample(apc_field_t field, int32_t value);
+
+// Runtime learner episode hook (runtime_episode_cb_t)
+void soh_estimator_discharge(float watts, float full_runtime_s, float exponent, int32_t drop);
+
+// State of health in %, -1 before the first event
+int32_t soh_estimator_health(void);
+
+// Projected replacement date (YYYY-MM-DD, UTC); false without a declining
+// trend or before the clock is set
+bool soh_estimator_replace_date(char *buffer, size_t buffer_size);
+
+#endif // SOH_ESTIMATOR_H
@@ -0,0 +1,114 @@
+#include "telemetry.h"
+#include "quantile_sketch.h"
+#include "apc_hid_parser.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+
+static const char *TAG = "telemetry";
+
+#define SKETCH_PERIOD_US (6 * 3600 * 1000000LL)
+#define SKETCHES_PER_DAY 4
+
+typedef struct {
+    const char *name;
+    const char *unit;
+    uint8_t min_octave;          // Smallest value resolved: 2^min_octave
+} telemetry_info_t;
+
+static const telemetry_info_t metric_info[TELEMETRY_COUNT] = {
+    [TELEMETRY_INPUT_VOLTAGE]   = { "input_voltage",   "V",  9 },  // From 51.2 V (0.1 V units)
+    [TELEMETRY_USB_RTT]         = { "usb_rtt",         "ms", 7 },  // 128 µs .. 33 ms
+    [TELEMETRY_PUBLISH_LATENCY] = { "publish_latency", "ms", 9 },  // 512 µs .. 131 ms
+};
+
+typedef struct {
+    quantile_sketch_t sketch;
+    uint32_t epoch;              // 6 h period + 1 (0 = unused)
+} telemetry_slot_t;
+
+static telemetry_slot_t slots[TELEMETRY_COUNT][SKETCHES_PER_DAY];
+static SemaphoreHandle_t telemetry_mutex = NULL;
+
+esp_err_t telemetry_init(void)
+{
+    for (int m = 0; m < TELEMETRY_COUNT; m++) {
+        for (int i = 0; i < SKETCHES_PER_DAY; i++) {
+            quantile_sketch_init(&slots[m][i].sketch, metric_info[m].min_octave);
+            slots[m][i].epoch = 0;
+        }
+    }
+    telemetry_mutex = xSemaphoreCreateMutex();
+    if (telemetry_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create telemetry mutex");
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "📈 Telemetry: %d metrics, %u bytes of sketches", TELEMETRY_COUNT, (unsigned)sizeof(slots));
+    return ESP_OK;
+}
+
+void telemetry_record(telemetry_metric_t metric, int32_t value)
+{
+    if (telemetry_mutex == NULL || metric >= TELEMETRY_COUNT) {
+        return;
+    }
+    uint32_t epoch = (uint32_t)(esp_timer_get_time() / SKETCH_PERIOD_US) + 1;
+    telemetry_slot_t *slot = &slots[metric][epoch % SKETCHES_PER_DAY];
+
+    xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+    if (slot->epoch != epoch) {
+        quantile_sketch_init(&slot->sketch, metric_info[metric].min_octave);
+        slot->epoch = epoch;
+    }
+    quantile_sketch_add(&slot->sketch, value);
+    xSemaphoreGive(telemetry_mutex);
+}
+
+uint32_t telemetry_quantiles(telemetry_metric_t metric, const float *q, int num, int32_t *out)
+{
+    if (telemetry_mutex == NULL || metric >= TELEMETRY_COUNT) {
+        return 0;
+    }
+    uint32_t epoch = (uint32_t)(esp_timer_get_time() / SKETCH_PERIOD_US) + 1;
+
+    // Static: too large for the callers' stacks, and only used under the mutex
+    static quantile_sketch_t day;
+
+    xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+    quantile_sketch_init(&day, metric_info[metric].min_octave);
+    for (int i = 0; i < SKETCHES_PER_DAY; i++) {
+        const telemetry_slot_t *slot = &slots[metric][i];
+        if (slot->epoch != 0 && slot->epoch <= epoch && epoch - slot->epoch < SKETCHES_PER_DAY) {
+            quantile_sketch_merge(&day, &slot->sketch);
+        }
+    }
+    if (day.count > 0) {
+        for (int i = 0; i < num; i++) {
+            out[i] = quantile_sketch_quantile(&day, q[i]);
+        }
+    }
+    uint32_t count = day.count;
+    xSemaphoreGive(telemetry_mutex);
+    return count;
+}
+
+const char* telemetry_name(telemetry_metric_t metric)
+{
+    return (metric < TELEMETRY_COUNT) ? metric_info[metric].name : "unknown";
+}
+
+const char* telemetry_unit(telemetry_metric_t metric)
+{
+    return (metric < TELEMETRY_COUNT) ? metric_info[metric].unit : "";
+}
+
+int telemetry_format(telemetry_metric_t metric, int32_t value, char *buffer, size_t buffer_size)
+{
+    if (metric == TELEMETRY_INPUT_VOLTAGE) {
+        return apc_hid_format_fixed(APC_FIELD_INPUT_VOLTAGE, value, buffer, buffer_size);
+    }
+    // µs as ms with two decimals
+    return snprintf(buffer, buffer_size, "%ld.%02ld", (long)(value / 1000), (long)((value % 1000) / 10));
+}
@@ -0,0 +1,34 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Day-long value distributions (p50/p95/p99) with a fixed memory budget.
+// Each metric keeps four 6 h quantile sketches in a ring; queries merge the
+// ones from the last 24 h.
+
+typedef enum {
+    TELEMETRY_INPUT_VOLTAGE = 0,     // Fixed point like APC_FIELD_INPUT_VOLTAGE
+    TELEMETRY_USB_RTT,               // Control transfer submit to completion, µs
+    TELEMETRY_PUBLISH_LATENCY,       // MQTT publish to broker ack, µs
+    TELEMETRY_COUNT
+} telemetry_metric_t;
+
+esp_err_t telemetry_init(void);
+
+// Safe from any task; a no-op before telemetry_init()
+void telemetry_record(telemetry_metric_t metric, int32_t value);
+
+// Estimate `num` quantiles (0..1) over the last 24 h. Returns the number of
+// samples they are based on (0 = no data, `out` untouched).
+uint32_t telemetry_quantiles(telemetry_metric_t metric, const float *q, int num, int32_t *out);
+
+// Metric identifier ("input_voltage", ...), display unit, and a value
+// formatted in that unit (latencies are shown in ms)
+const char* telemetry_name(telemetry_metric_t metric);
+const char* telemetry_unit(telemetry_metric_t metric);
+int telemetry_format(telemetry_metric_t metric, int32_t value, char *buffer, size_t buffer_size);
+
+#endif // TELEMETRY_H
@@ -46,15 +46,30 @@
  *
  * This is why GET_REPORT was timing out - we weren't processing library events!
  *
+ * THREE TASKS (each blocks until it has work, nothing polls):
+ * ─────────────────────────────────────────────────────────────────────────
+ * 1. usb_lib   - usb_lib_task(): library events, forever
+ * 2. usb_client - usb_client_task(): client events, so every callback
+ *    (device attach/removal, transfer completions) runs here
+ * 3. usb_host  - usb_host_task(): opens, sets up and closes the UPS, control
+ *    transfers and decoding. Waits on its task notification for a
+ *    completion, a report or a device event.
+ * Callbacks only record what happened and notify; the device handle and the
+ * parser are owned by usb_host_task() alone.
+ *
  * THREAD SAFETY:
  * ─────────────────────────────────────────────────────────────────────────
- * - transfer_mutex: Prevents interrupt and control transfers from running simultaneously
- * - transfer_done: Semaphore to signal when a transfer callback has fired
+ * - transfer_mutex: One control transfer at a time
+ * - NOTIFY_* bits: Completion and event wake-ups, direct to the waiting task
+ * - intr_queue: Interrupt IN reports, from the completion callback to the parser
+ * - new_dev_queue: Addresses of enumerated devices, from the client callback
+ * - __atomic builtins: the few flags both sides read (ups_connected,
+ *   intr_running, intr_stalled, gone_device, in_flight counts)
  *
  * DATA FLOW:
  * ─────────────────────────────────────────────────────────────────────────
- * USB Device → Interrupt Transfer → Raw HID Report (bytes) →
- * apc_hid_parser.c (decode) → ups_metrics_t struct →
+ * USB Device → Interrupt Transfer (always armed, see INTERRUPT IN PIPELINE) →
+ * intr_queue → apc_hid_parser.c (decode) → ups_metrics_t struct →
  * main.c (MQTT publish) → Home Assistant
  *
  * ═══════════════════════════════════════════════════════════════════════════
@@ -62,11 +77,20 @@
 
 #include "usb_host_manager.h"
 #include "apc_hid_parser.h"
+#include "apc_hid_trace.h"
+#include "usb_trace.h"
+#include "telemetry.h"
+#include "power_quality.h"
+#include "report_scheduler.h"
+#include "esp_timer.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "usb/usb_host.h"
+#include <stdlib.h>
 #include <string.h>
 
 static const char *TAG = "usb_host";
@@ -74,23 +98,24 @@ static const char *TAG = "usb_host";
 //══════════════════════════════════════════════════════════════════════════════
 // USB DEVICE IDENTIFICATION
 //══════════════════════════════════════════════════════════════════════════════
-// APC UPS USB Vendor/Product IDs (identifies this specific UPS model)
-// VID 0x051D = American Power Conversion
-// PID 0x0002 = Back-UPS series (Back-UPS XS 1000M, etc.)
-// PID 0x0003 = Smart-UPS series (Smart-UPS C 1500, etc.)
-#define APC_VID 0x051d
-#define APC_PID_BACKUPS  0x0002
-#define APC_PID_SMARTUPS 0x0003
-#define IS_APC_UPS(vid, pid) ((vid) == APC_VID && ((pid) == APC_PID_BACKUPS || (pid) == APC_PID_SMARTUPS))
+// APC UPS USB Vendor/Product IDs (APC_VID, APC_PID_* in apc_hid_parser.h)
+// Every supported PID has a decoder profile with its layout and poll list
+#define IS_APC_UPS(vid, pid) ((vid) == APC_VID && apc_hid_profile_for_pid(pid) != NULL)
 
 //══════════════════════════════════════════════════════════════════════════════
 // USB HOST STATE TRACKING
 //══════════════════════════════════════════════════════════════════════════════
 // These variables track the current state of the USB connection
-static bool ups_connected = false;           // Is UPS physically connected?
+static bool ups_connected = false;           // Is UPS physically connected? Atomic: read by any task
 static SemaphoreHandle_t usb_mutex = NULL;   // Mutex for USB library access
 static usb_host_client_handle_t usb_client = NULL;  // Our USB client handle
-static usb_device_handle_t ups_device = NULL;       // Handle to the UPS device
+static usb_device_handle_t ups_device = NULL;       // Handle to the UPS device, NULL once it is gone (usb_host_task() only)
+
+// usb_host_task() owns the UPS from usb_host_device_open() to
+// usb_host_device_close(): claimed_device stays set after removal until every
+// transfer has come back (see device_reap())
+static usb_device_handle_t claimed_device = NULL;
+static bool interface_claimed = false;
 
 //══════════════════════════════════════════════════════════════════════════════
 // HID (Human Interface Device) CONFIGURATION
@@ -102,90 +127,73 @@ static usb_device_handle_t ups_device = NULL;       // Handle to the UPS device
 // This is where the UPS automatically sends status updates
 #define HID_INTERRUPT_IN_EP 0x81
 
-// USB Host client event handler
-static void usb_host_client_event_cb(const usb_host_client_event_msg_t *event_msg, void *arg)
-{
-    ESP_LOGI(TAG, "DEBUG: Event callback triggered, event=%d", event_msg->event);
+// HID class descriptors (HID 1.11 §7.1)
+#define HID_DESC_TYPE_HID     0x21
+#define HID_DESC_TYPE_REPORT  0x22
+#define HID_REPORT_DESC_MAX   2048
 
-    switch (event_msg->event) {
-        case USB_HOST_CLIENT_EVENT_NEW_DEV:
-            ESP_LOGI(TAG, "🆕 New USB device detected (addr=%d)", event_msg->new_dev.address);
+// Addresses of newly enumerated devices, queued by the client callback and
+// opened by usb_host_task(), which may block on control transfers while the
+// client task delivers their completions
+#define NEW_DEV_QUEUE_LEN   4
+static QueueHandle_t new_dev_queue = NULL;
 
-            // Open the device
-            usb_device_handle_t dev_hdl;
-            esp_err_t err = usb_host_device_open(usb_client, event_msg->new_dev.address, &dev_hdl);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to open device: %s", esp_err_to_name(err));
-                break;
-            }
+// Last device the client callback saw removed; usb_host_task() compares it
+// with the UPS, resets the parser and releases the device. Atomic.
+static usb_device_handle_t gone_device = NULL;
 
-            // Get device descriptor
-            const usb_device_desc_t *dev_desc;
-            err = usb_host_get_device_descriptor(dev_hdl, &dev_desc);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to get device descriptor: %s", esp_err_to_name(err));
-                usb_host_device_close(usb_client, dev_hdl);
-                break;
-            }
+// Task notification bits (eSetBits). A control transfer completion wakes the
+// task that submitted it; reports and device events wake usb_host_task().
+#define NOTIFY_CONTROL_DONE (1u << 0)
+#define NOTIFY_REPORT       (1u << 1)
+#define NOTIFY_DEVICE       (1u << 2)
+
+// Longest usb_host_task() sleeps while a UPS is attached, for power-quality
+// bursts (200 ms period) and the alive log; without a UPS it only wakes on
+// a device event or the alive log
+#define WORKER_WAIT_MS      100
+#define ALIVE_LOG_US        (5 * 1000000LL)
 
-            ESP_LOGI(TAG, "DEBUG: Device VID:PID = %04X:%04X", dev_desc->idVendor, dev_desc->idProduct);
+static TaskHandle_t usb_worker = NULL;       // usb_host_task(), atomic: set once it runs
 
-            // Check if this is our APC UPS
-            if (IS_APC_UPS(dev_desc->idVendor, dev_desc->idProduct)) {
-                ESP_LOGI(TAG, "🔌 APC UPS found! VID:PID = %04X:%04X",
-                         dev_desc->idVendor, dev_desc->idProduct);
+static void notify_worker(uint32_t bits)
+{
+    TaskHandle_t worker = __atomic_load_n(&usb_worker, __ATOMIC_ACQUIRE);
+    if (worker != NULL) {
+        xTaskNotify(worker, bits, eSetBits);
+    }
+}
 
-                ups_device = dev_hdl;
-                ups_connected = true;
+// Interrupt IN transfers are re-armed while set; cleared when the device
+// goes away. Atomic: written by usb_host_task(), read in the client task.
+static bool intr_running = false;
 
-                // Claim HID interface FIRST (before inspecting)
-                err = usb_host_interface_claim(usb_client, ups_device, HID_INTERFACE, 0);
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to claim interface: %s", esp_err_to_name(err));
-                } else {
-                    ESP_LOGI(TAG, "✅ HID interface claimed successfully");
-                }
+// Parser the attached UPS reports are decoded into, owned by usb_host_task()
+static apc_hid_parser_t *ups_parser = NULL;
 
-                // Get configuration descriptor to inspect endpoints (after claiming)
-                const usb_config_desc_t *config_desc;
-                err = usb_host_get_active_config_descriptor(dev_hdl, &config_desc);
-                if (err == ESP_OK) {
-                    ESP_LOGI(TAG, "📋 Config: %d interfaces", config_desc->bNumInterfaces);
-
-                    // Parse interfaces and endpoints (don't claim again!)
-                    int offset = 0;
-                    const usb_intf_desc_t *intf = usb_parse_interface_descriptor(config_desc, HID_INTERFACE, 0, &offset);
-                    if (intf) {
-                        ESP_LOGI(TAG, "  Interface %d: class=0x%02X, endpoints=%d",
-                                 HID_INTERFACE, intf->bInterfaceClass, intf->bNumEndpoints);
-
-                        // Log endpoints
-                        int ep_offset = offset;
-                        for (int e = 0; e < intf->bNumEndpoints; e++) {
-                            const usb_ep_desc_t *ep = usb_parse_endpoint_descriptor_by_index(intf, e, config_desc->wTotalLength, &ep_offset);
-                            if (ep) {
-                                ESP_LOGI(TAG, "    Endpoint 0x%02X: type=%d, maxPacket=%d",
-                                         ep->bEndpointAddress,
-                                         ep->bmAttributes & 0x03,
-                                         ep->wMaxPacketSize);
-                            }
-                        }
-                    }
-                }
-            } else {
-                ESP_LOGI(TAG, "⚠️ Not an APC UPS (VID:PID = %04X:%04X), expected VID=%04X",
-                         dev_desc->idVendor, dev_desc->idProduct, APC_VID);
-                usb_host_device_close(usb_client, dev_hdl);
+// USB Host client event handler: records the event and wakes usb_host_task(),
+// which opens, sets up and closes the device
+static void usb_host_client_event_cb(const usb_host_client_event_msg_t *event_msg, void *arg)
+{
+    ESP_LOGI(TAG, "DEBUG: Event callback triggered, event=%d", event_msg->event);
+
+    switch (event_msg->event) {
+        case USB_HOST_CLIENT_EVENT_NEW_DEV:
+            ESP_LOGI(TAG, "🆕 New USB device detected (addr=%d)", event_msg->new_dev.address);
+            if (xQueueSend(new_dev_queue, &event_msg->new_dev.address, 0) != pdTRUE) {
+                ESP_LOGW(TAG, "⚠️ Too many devices attached at once, addr=%d ignored", event_msg->new_dev.address);
+                break;
             }
+            notify_worker(NOTIFY_DEVICE);
             break;
 
         case USB_HOST_CLIENT_EVENT_DEV_GONE:
             ESP_LOGW(TAG, "🚫 USB device removed");
-            if (event_msg->dev_gone.dev_hdl == ups_device) {
-                ups_connected = false;
-                ups_device = NULL;
-                ESP_LOGI(TAG, "❌ APC UPS disconnected");
-            }
+            // In-flight interrupt transfers come back as NO_DEVICE and are
+            // not re-armed; usb_host_task() matches the handle against the
+            // UPS, then releases the transfers and closes it
+            __atomic_store_n(&gone_device, event_msg->dev_gone.dev_hdl, __ATOMIC_RELEASE);
+            notify_worker(NOTIFY_DEVICE);
             break;
 
         default:
@@ -198,37 +206,213 @@ static void usb_host_client_event_cb(const usb_host_client_event_msg_t *event_ms
 // THREAD SYNCHRONIZATION FOR USB TRANSFERS
 //══════════════════════════════════════════════════════════════════════════════
 
-// transfer_done: Binary semaphore to signal when a USB transfer callback fires
-// - We submit a transfer (returns immediately)
-// - We wait on this semaphore
-// - When data arrives, callback fires and gives this semaphore
+// Completion is signalled with a direct-to-task notification:
+// - We submit a pooled transfer (returns immediately), its slot as context
+// - We block on NOTIFY_CONTROL_DONE until the slot is no longer in flight
+// - When data arrives, the callback (client task) clears it and notifies us
 // - We wake up and process the data
-static SemaphoreHandle_t transfer_done;
 
-// transfer_mutex: Prevents simultaneous interrupt + control transfers
-// WHY NEEDED: The USB hardware can only handle one transfer at a time per endpoint
-// - Interrupt transfers use endpoint 0x81
-// - Control transfers use endpoint 0x00
-// - But they share internal USB resources, so we serialize them
+// transfer_mutex: One control transfer at a time
+// - Control transfers share endpoint 0x00
+// - Interrupt transfers on 0x81 have their own pipe and stay in flight
+//   alongside (see INTERRUPT IN PIPELINE)
 static SemaphoreHandle_t transfer_mutex;
 
+//══════════════════════════════════════════════════════════════════════════════
+// TRANSFER POOL
+//══════════════════════════════════════════════════════════════════════════════
+// Transfers are DMA-capable heap blocks. Allocating one per GET_REPORT
+// fragments internal RAM over weeks of uptime, so every transfer the device
+// needs is allocated once when it is claimed and recycled until it is gone:
+// - CONTROL_POOL_SIZE control transfers for GET_REPORT. One is in use at a
+//   time; the spare covers a transfer that timed out and is still owned by
+//   the host controller (see DEVICE RESET).
+// - INTR_TRANSFERS interrupt IN transfers (see INTERRUPT IN PIPELINE)
+// A request larger than a pooled buffer (the report descriptor, once per
+// device) gets a one-off transfer, freed as soon as it is back. Without
+// CONFIG_USB_TRANSFER_POOL every control request does, for soak comparisons.
+#define CONTROL_POOL_SIZE       2
+#define CONTROL_TRANSFER_SIZE   (8 + 64)    // Setup packet + largest report
+#define INTR_TRANSFERS          2
+#define INTR_TRANSFER_SIZE      64
+
+#ifdef CONFIG_USB_TRANSFER_POOL
+#define CONTROL_POOLED          true
+#else
+#define CONTROL_POOLED          false
+#endif
+
+typedef struct {
+    usb_transfer_t *transfer;
+    TaskHandle_t waiter;         // Task to notify on completion
+    bool in_flight;              // Atomic: set on submit, cleared by transfer_callback()
+} control_slot_t;
+
+static control_slot_t control_pool[CONTROL_POOL_SIZE];
+static control_slot_t control_oversize;
+static usb_transfer_t *intr_transfers[INTR_TRANSFERS];
+
+// Counters for /status (usb_host_get_transfer_stats())
+static uint32_t control_submitted = 0;
+static uint32_t control_timeouts = 0;
+static uint32_t device_faults = 0;
+static uint32_t device_resets = 0;
+static uint32_t oversize_allocs = 0;
+
+static void transfer_pool_create(void)
+{
+    for (int i = 0; i < CONTROL_POOL_SIZE && CONTROL_POOLED; i++) {
+        if (control_pool[i].transfer == NULL &&
+            usb_host_transfer_alloc(CONTROL_TRANSFER_SIZE, 0, &control_pool[i].transfer) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to allocate control transfer %d", i);
+        }
+    }
+    for (int i = 0; i < INTR_TRANSFERS; i++) {
+        if (intr_transfers[i] == NULL &&
+            usb_host_transfer_alloc(INTR_TRANSFER_SIZE, 0, &intr_transfers[i]) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to allocate interrupt transfer %d", i);
+        }
+    }
+}
+
+static bool slot_in_flight(control_slot_t *slot)
+{
+    return __atomic_load_n(&slot->in_flight, __ATOMIC_ACQUIRE);
+}
+
+static bool control_pool_idle(void)
+{
+    for (int i = 0; i < CONTROL_POOL_SIZE; i++) {
+        if (slot_in_flight(&control_pool[i])) {
+            return false;
+        }
+    }
+    return !slot_in_flight(&control_oversize);
+}
+
+static void free_slot(control_slot_t *slot)
+{
+    if (slot->transfer != NULL) {
+        usb_host_transfer_free(slot->transfer);
+        slot->transfer = NULL;
+    }
+}
+
+// Caller makes sure nothing is in flight
+static void transfer_pool_release(void)
+{
+    for (int i = 0; i < CONTROL_POOL_SIZE; i++) {
+        free_slot(&control_pool[i]);
+    }
+    free_slot(&control_oversize);
+    for (int i = 0; i < INTR_TRANSFERS; i++) {
+        if (intr_transfers[i] != NULL) {
+            usb_host_transfer_free(intr_transfers[i]);
+            intr_transfers[i] = NULL;
+        }
+    }
+}
+
+// An idle slot able to carry `size` bytes (setup packet included), or NULL
+// with `err` set: ESP_ERR_INVALID_STATE when every fitting slot is still in
+// flight, ESP_ERR_NO_MEM when a one-off transfer cannot be allocated
+static control_slot_t *control_slot_acquire(size_t size, esp_err_t *err)
+{
+    if (!CONTROL_POOLED || size > CONTROL_TRANSFER_SIZE) {
+        control_slot_t *slot = &control_oversize;
+        if (slot_in_flight(slot)) {
+            *err = ESP_ERR_INVALID_STATE;
+            return NULL;
+        }
+        free_slot(slot);
+        if (usb_host_transfer_alloc(size, 0, &slot->transfer) != ESP_OK) {
+            *err = ESP_ERR_NO_MEM;
+            return NULL;
+        }
+        oversize_allocs++;
+        return slot;
+    }
+    for (int i = 0; i < CONTROL_POOL_SIZE; i++) {
+        if (control_pool[i].transfer != NULL && !slot_in_flight(&control_pool[i])) {
+            return &control_pool[i];
+        }
+    }
+    *err = ESP_ERR_INVALID_STATE;
+    return NULL;
+}
+
+// Wait up to `wait_ms` for the slot's transfer to come back; true once it has.
+// Reports, device events and other slots' completions may wake us first.
+static bool control_slot_wait(control_slot_t *slot, int wait_ms)
+{
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(wait_ms);
+    while (slot_in_flight(slot)) {
+        TickType_t now = xTaskGetTickCount();
+        if ((int32_t)(deadline - now) <= 0) {
+            return false;
+        }
+        xTaskNotifyWait(0, NOTIFY_CONTROL_DONE, NULL, deadline - now);
+    }
+    return true;
+}
+
+//══════════════════════════════════════════════════════════════════════════════
+// DEVICE RESET
+//══════════════════════════════════════════════════════════════════════════════
+// A control transfer the UPS never finished keeps its slot until the host
+// controller gives it back. Endpoint 0 belongs to the host library, so it
+// cannot be halted and flushed like 0x81. Once every pooled transfer is held
+// that way, the root port is powered off: the library reports the UPS as
+// removed and returns every transfer in flight, endpoint 0 included, and the
+// usual removal path closes the handle. device_reap() then powers the port
+// back on and the UPS enumerates afresh.
+static bool port_resetting = false;          // usb_host_task() only
+
+static void device_reset(void)
+{
+    if (port_resetting) {
+        return;
+    }
+    esp_err_t err = usb_host_lib_set_root_port_power(false);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "❌ Failed to power off the USB port: %s", esp_err_to_name(err));
+        return;
+    }
+    port_resetting = true;
+    device_resets++;
+    ESP_LOGW(TAG, "🔄 USB port powered off to re-enumerate the UPS");
+}
+
+static void device_reset_finish(void)
+{
+    if (!port_resetting) {
+        return;
+    }
+    port_resetting = false;
+    esp_err_t err = usb_host_lib_set_root_port_power(true);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "❌ Failed to power the USB port back on: %s", esp_err_to_name(err));
+        return;
+    }
+    ESP_LOGI(TAG, "🔌 USB port powered on, waiting for the UPS to enumerate");
+}
+
 //══════════════════════════════════════════════════════════════════════════════
 // USB TRANSFER COMPLETION CALLBACK
 //══════════════════════════════════════════════════════════════════════════════
-// This function is called by the USB driver when a transfer completes
-// CRITICAL: This runs in interrupt context, so keep it FAST and minimal
-// - Just signal the semaphore
-// - Don't do heavy processing here
-// - Let the main task wake up and handle the data
+// This function is called from usb_host_client_handle_events() in the
+// client task when a transfer completes
+// - Keep it FAST and minimal: trace the completion, hand the slot back and
+//   wake the task that submitted it (which may have given up waiting: the
+//   slot is then free for the next request, and the completion is still
+//   traced)
+// - Let that task handle the data
 static void transfer_callback(usb_transfer_t *transfer)
 {
-    // Signal that transfer is complete by "giving" the semaphore
-    // The waiting task will wake up when it tries to "take" this semaphore
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    xSemaphoreGiveFromISR(transfer_done, &xHigherPriorityTaskWoken);
-    if (xHigherPriorityTaskWoken) {
-        portYIELD_FROM_ISR();
-    }
+    control_slot_t *slot = (control_slot_t *)transfer->context;
+    usb_trace_complete(transfer);  // Before the slot is handed back and reused
+    __atomic_store_n(&slot->in_flight, false, __ATOMIC_RELEASE);
+    xTaskNotify(slot->waiter, NOTIFY_CONTROL_DONE, eSetBits);
 }
 
 //══════════════════════════════════════════════════════════════════════════════
@@ -253,7 +437,7 @@ static void transfer_callback(usb_transfer_t *transfer)
 //
 // THE CRITICAL FIX - WHY TWO EVENT HANDLERS:
 // ────────────────────────────────────────────────────────────────────────────
-// In the wait loop, we MUST call BOTH:
+// A control transfer only completes while BOTH are being processed:
 // - usb_host_lib_handle_events()    → Processes control transfer at hardware level
 // - usb_host_client_handle_events() → Fires our callback when data arrives
 //
@@ -265,131 +449,113 @@ static void transfer_callback(usb_transfer_t *transfer)
 // - Control transfers need BOTH lib and client events
 // - The documentation doesn't clearly explain this difference
 //
-static esp_err_t get_hid_report(uint8_t report_id, uint8_t *buffer, size_t buffer_size, size_t *actual_length)
+// The usb_lib and usb_client tasks run both all the time, so here we just
+// block until the callback notifies us. Must not be called from a callback.
+//
+static esp_err_t control_transfer_in(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
+                                     uint8_t *buffer, size_t buffer_size, size_t *actual_length)
 {
-    if (ups_device == NULL) {
+    // One read of the handle for the whole transfer
+    usb_device_handle_t dev = ups_device;
+    if (dev == NULL || port_resetting) {
         return ESP_ERR_INVALID_STATE;
     }
 
-    // Acquire mutex: Only one USB transfer at a time
-    // This prevents interrupt and control transfers from interfering
+    // One control transfer at a time; interrupt IN transfers don't take the mutex
     if (xSemaphoreTake(transfer_mutex, pdMS_TO_TICKS(5000)) != pdTRUE) {
-        ESP_LOGW(TAG, "Failed to acquire transfer mutex for GET_REPORT");
+        ESP_LOGW(TAG, "Failed to acquire transfer mutex for control request 0x%02X", bRequest);
         return ESP_ERR_TIMEOUT;
     }
 
-    // Prepare USB transfer for control request
-    usb_transfer_t *transfer;
-    esp_err_t err = usb_host_transfer_alloc(buffer_size + 8, 0, &transfer);  // +8 for setup packet
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to allocate control transfer: %s", esp_err_to_name(err));
+    // Prepare USB transfer for control request (+8 for setup packet)
+    esp_err_t err;
+    control_slot_t *slot = control_slot_acquire(buffer_size + 8, &err);
+    if (slot == NULL && err == ESP_ERR_INVALID_STATE) {
+        // Every slot is held by a transfer the UPS never finished
+        device_faults++;
+        ESP_LOGE(TAG, "❌ Device fault: no control transfer came back, request 0x%02X/0x%04X refused",
+                 bRequest, wValue);
+        device_reset();
+    }
+    if (slot == NULL) {
         xSemaphoreGive(transfer_mutex);
         return err;
     }
+    usb_transfer_t *transfer = slot->transfer;
+    slot->waiter = xTaskGetCurrentTaskHandle();
 
-    // Setup control GET_REPORT request
-    // Request Type: 0xA1 = Device-to-Host, Class, Interface
-    // Request: 0x01 = GET_REPORT
-    // Value: (ReportType << 8) | ReportID, where ReportType=3 for Feature Report
-    // Index: Interface number (0)
-    // Length: Expected report size
-    // NOTE: Changed from Input Reports (type 1) to Feature Reports (type 3)
-    // because voltage/load/frequency are synchronous polled values, not async events
-    transfer->device_handle = ups_device;
+    transfer->device_handle = dev;
     transfer->bEndpointAddress = 0x00;  // Control endpoint
     transfer->callback = transfer_callback;
-    transfer->context = NULL;
+    transfer->context = slot;
     transfer->num_bytes = buffer_size + 8;
     transfer->timeout_ms = 1000;
 
     // Fill setup packet
     usb_setup_packet_t *setup = (usb_setup_packet_t *)transfer->data_buffer;
-    setup->bmRequestType = 0xA1;  // Device-to-Host, Class, Interface
-    setup->bRequest = 0x01;        // GET_REPORT
-    setup->wValue = (3 << 8) | report_id;  // Feature Report (type 3), Report ID
-    setup->wIndex = HID_INTERFACE;
+    setup->bmRequestType = bmRequestType;
+    setup->bRequest = bRequest;
+    setup->wValue = wValue;
+    setup->wIndex = wIndex;
     setup->wLength = buffer_size;
 
-    // Create semaphore if not already created
-    if (transfer_done == NULL) {
-        transfer_done = xSemaphoreCreateBinary();
-        if (transfer_done == NULL) {
-            ESP_LOGE(TAG, "Failed to create transfer semaphore");
-            usb_host_transfer_free(transfer);
-            xSemaphoreGive(transfer_mutex);
-            return ESP_ERR_NO_MEM;
-        }
-    }
-
-    // Submit transfer
+    // Submit transfer (traced first: transfer_callback() traces the completion
+    // in the client task, possibly before the submit returns)
+    int64_t submit_us = esp_timer_get_time();
+    usb_trace_submit(transfer);
+    __atomic_store_n(&slot->in_flight, true, __ATOMIC_RELEASE);
     err = usb_host_transfer_submit_control(usb_client, transfer);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to submit GET_REPORT for 0x%02X: %s", report_id, esp_err_to_name(err));
-        usb_host_transfer_free(transfer);
+        __atomic_store_n(&slot->in_flight, false, __ATOMIC_RELEASE);
+        ESP_LOGE(TAG, "Failed to submit control request 0x%02X/0x%04X: %s", bRequest, wValue, esp_err_to_name(err));
         xSemaphoreGive(transfer_mutex);
         return err;
     }
+    control_submitted++;
 
-    ESP_LOGD(TAG, "🔍 Requesting report ID 0x%02X...", report_id);
+    ESP_LOGD(TAG, "🔍 Control request 0x%02X, wValue 0x%04X...", bRequest, wValue);
 
     // Wait for transfer completion
-    // CRITICAL: Must process BOTH lib and client events for control transfers
     const int max_wait_ms = 2000;
-    const int poll_interval_ms = 10;
-    int waited_ms = 0;
-    bool transfer_complete = false;
-
-    // ═══════════════════════════════════════════════════════════════════════
-    // THE CRITICAL WAIT LOOP - This is what makes control transfers work!
-    // ═══════════════════════════════════════════════════════════════════════
-    while (waited_ms < max_wait_ms && !transfer_complete) {
-        // STEP 1: Process library-level events (hardware USB processing)
-        // This is ESSENTIAL for control transfers to actually execute
-        uint32_t event_flags;
-        usb_host_lib_handle_events(pdMS_TO_TICKS(5), &event_flags);
-
-        // STEP 2: Process client-level events (fires our callback)
-        // This checks if our transfer_callback has been called
-        usb_host_client_handle_events(usb_client, pdMS_TO_TICKS(5));
-
-        // STEP 3: Check if callback fired (semaphore was given)
-        // Non-blocking check (timeout=0) so we keep looping
-        if (xSemaphoreTake(transfer_done, 0) == pdTRUE) {
-            transfer_complete = true;
-            break;
-        }
-        waited_ms += poll_interval_ms;
-    }
-    // ═══════════════════════════════════════════════════════════════════════
+    bool transfer_complete = control_slot_wait(slot, max_wait_ms);
 
     if (transfer_complete) {
         if (transfer->status == USB_TRANSFER_STATUS_COMPLETED) {
+            telemetry_record(TELEMETRY_USB_RTT, (int32_t)(esp_timer_get_time() - submit_us));
+
             // Data starts after 8-byte setup packet
             *actual_length = transfer->actual_num_bytes - 8;
-            if (*actual_length > 0 && *actual_length <= buffer_size) {
-                memcpy(buffer, transfer->data_buffer + 8, *actual_length);
-                ESP_LOGD(TAG, "✅ GET_REPORT 0x%02X: %d bytes", report_id, *actual_length);
+            if ((*actual_length > 0 || buffer_size == 0) && *actual_length <= buffer_size) {
+                if (*actual_length > 0) {
+                    memcpy(buffer, transfer->data_buffer + 8, *actual_length);
+                }
+                ESP_LOGD(TAG, "✅ Control 0x%04X: %d bytes", wValue, *actual_length);
                 err = ESP_OK;
             } else {
                 err = ESP_ERR_INVALID_SIZE;
             }
         } else if (transfer->status == USB_TRANSFER_STATUS_STALL) {
-            ESP_LOGD(TAG, "⚠️  Report 0x%02X not available (STALL)", report_id);
+            ESP_LOGD(TAG, "⚠️  Control 0x%04X not available (STALL)", wValue);
             err = ESP_ERR_NOT_SUPPORTED;
         } else {
-            ESP_LOGD(TAG, "⚠️  GET_REPORT 0x%02X failed, status=%d", report_id, transfer->status);
+            ESP_LOGD(TAG, "⚠️  Control 0x%04X failed, status=%d", wValue, transfer->status);
             err = ESP_FAIL;
         }
-        usb_host_transfer_free(transfer);
+        if (slot == &control_oversize) {
+            free_slot(slot);
+        }
     } else {
-        ESP_LOGW(TAG, "⚠️  GET_REPORT 0x%02X timeout after %dms, aborting", report_id, max_wait_ms);
+        ESP_LOGW(TAG, "⚠️  Control 0x%04X timeout after %dms, aborting", wValue, max_wait_ms);
         ESP_LOGW(TAG, "   Transfer status: %d (0=no_device, 1=completed, 2=error, 3=timed_out, 4=cancelled, 5=stall, 6=overflow, 7=skipped)",
                  transfer->status);
 
-        // Cancel and free the transfer
-        // Don't wait forever - the UPS doesn't support this report ID
-        usb_host_transfer_free(transfer);
-        err = ESP_ERR_NOT_SUPPORTED;
+        // Don't wait forever. Unlike a STALL, a timeout does not say the UPS
+        // lacks this report (it may be busy), so it is reported as
+        // ESP_ERR_TIMEOUT. The transfer stays with the host controller; the
+        // next request takes the other pooled transfer, and one finding
+        // none free resets the UPS (see DEVICE RESET).
+        control_timeouts++;
+        err = ESP_ERR_TIMEOUT;
     }
 
     // Release mutex
@@ -397,137 +563,480 @@ static esp_err_t get_hid_report(uint8_t report_id, uint8_t *buffer, size_t buffe
     return err;
 }
 
-// Read HID report from interrupt endpoint
-static esp_err_t read_hid_report(uint8_t *buffer, size_t buffer_size, size_t *actual_length)
+static esp_err_t get_hid_report(uint8_t report_id, uint8_t *buffer, size_t buffer_size, size_t *actual_length)
 {
-    if (ups_device == NULL) {
-        return ESP_ERR_INVALID_STATE;
+    // Request Type: 0xA1 = Device-to-Host, Class, Interface
+    // Request: 0x01 = GET_REPORT
+    // Value: (ReportType << 8) | ReportID, where ReportType=3 for Feature Report
+    // Index: Interface number (0)
+    // Length: Expected report size
+    // NOTE: Changed from Input Reports (type 1) to Feature Reports (type 3)
+    // because voltage/load/frequency are synchronous polled values, not async events
+    return control_transfer_in(0xA1, 0x01, (3 << 8) | report_id, HID_INTERFACE,
+                               buffer, buffer_size, actual_length);
+}
+
+//══════════════════════════════════════════════════════════════════════════════
+// REPORT DESCRIPTOR: TEACH THE PARSER THIS MODEL'S LAYOUT
+//══════════════════════════════════════════════════════════════════════════════
+// GET_DESCRIPTOR(Report) is a standard request addressed to the interface:
+//    - bmRequestType: 0x81 (Device-to-Host, Standard, Interface recipient)
+//    - bRequest: 0x06 (GET_DESCRIPTOR)
+//    - wValue: (0x22 << 8) | 0 (Report descriptor, index 0)
+// The descriptor lists every report ID with the bit offset, size, logical
+// range and unit exponent of each value, so the parser can decode any APC
+// model without hardcoded offsets.
+static void load_report_descriptor(uint16_t desc_length)
+{
+    size_t length = desc_length ? desc_length : HID_REPORT_DESC_MAX;
+    if (length > HID_REPORT_DESC_MAX) {
+        length = HID_REPORT_DESC_MAX;
     }
 
-    // Acquire mutex to prevent concurrent transfers
-    if (xSemaphoreTake(transfer_mutex, pdMS_TO_TICKS(5000)) != pdTRUE) {
-        ESP_LOGW(TAG, "Failed to acquire transfer mutex for interrupt read");
-        return ESP_ERR_TIMEOUT;
+    uint8_t *desc = malloc(length);
+    if (desc == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %d bytes for report descriptor", length);
+        return;
     }
 
-    // Create semaphore if not already created
-    if (transfer_done == NULL) {
-        transfer_done = xSemaphoreCreateBinary();
-        if (transfer_done == NULL) {
-            ESP_LOGE(TAG, "Failed to create transfer semaphore");
-            xSemaphoreGive(transfer_mutex);
-            return ESP_ERR_NO_MEM;
+    size_t actual = 0;
+    esp_err_t err = control_transfer_in(0x81, 0x06, (HID_DESC_TYPE_REPORT << 8), HID_INTERFACE,
+                                        desc, length, &actual);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "📜 Report descriptor: %d bytes", actual);
+        apc_hid_parser_load_descriptor(ups_parser, desc, actual);
+    } else {
+        ESP_LOGW(TAG, "⚠️ Report descriptor unavailable (%s), using built-in layout", esp_err_to_name(err));
+        apc_hid_parser_use_default_table(ups_parser);
+    }
+    free(desc);
+}
+
+//══════════════════════════════════════════════════════════════════════════════
+// INTERRUPT IN PIPELINE
+//══════════════════════════════════════════════════════════════════════════════
+// Two transfers on endpoint 0x81 are kept in flight for as long as the UPS is
+// attached: while the host controller holds one, the other is being
+// resubmitted, so no report is missed between polls. Completion callbacks run
+// in usb_client_task(), alongside usb_host_task() blocked on a control
+// transfer or its next event; they only copy the report into intr_queue,
+// resubmit and notify usb_host_task(), which drains the queue into the parser
+// every loop and between the feature reports of a sweep. A transfer that
+// comes back stalled, or fails to resubmit, is re-armed by usb_host_task()
+// (see interrupt_pipeline_service()), so the pipeline never dies while the
+// UPS stays attached.
+#define INTR_QUEUE_LEN      8
+
+typedef struct {
+    uint8_t length;
+    uint8_t data[INTR_TRANSFER_SIZE];
+} intr_report_t;
+
+static QueueHandle_t intr_queue = NULL;
+static int intr_in_flight = 0;                    // Atomic: armed here, returned in the client task
+static bool intr_armed[INTR_TRANSFERS];           // Atomic, per transfer: set on submit, cleared once it is back for good
+static bool intr_stalled = false;                 // Atomic: set by the callback, cleared by interrupt_pipeline_service()
+static uint32_t intr_dropped = 0;                 // Reports lost to a full queue
+static uint32_t intr_stalls = 0;                  // Endpoint 0x81 STALLs cleared
+
+// Re-arm retries back off from INTR_REARM_MIN_MS to INTR_REARM_MAX_MS while
+// no transfer can be submitted (usb_host_task() only)
+#define INTR_REARM_MIN_MS   1000
+#define INTR_REARM_MAX_MS   60000
+static int64_t intr_rearm_us = 0;
+static int intr_rearm_ms = INTR_REARM_MIN_MS;
+
+// A transfer that is not re-armed: the STALL or failed submit is left to
+// interrupt_pipeline_service(), which re-arms it
+static void interrupt_transfer_returned(usb_transfer_t *transfer)
+{
+    int index = (int)(intptr_t)transfer->context;
+    __atomic_store_n(&intr_armed[index], false, __ATOMIC_RELEASE);
+    int left = __atomic_sub_fetch(&intr_in_flight, 1, __ATOMIC_ACQ_REL);
+    if (transfer->status == USB_TRANSFER_STATUS_STALL) {
+        __atomic_store_n(&intr_stalled, true, __ATOMIC_RELEASE);
+        ESP_LOGW(TAG, "⚠️ Interrupt endpoint 0x%02X stalled, %d transfer(s) left", HID_INTERRUPT_IN_EP, left);
+    }
+    notify_worker(NOTIFY_DEVICE);  // Re-arm, or reap once none are left
+}
+
+static void interrupt_in_callback(usb_transfer_t *transfer)
+{
+    usb_trace_complete(transfer);
+
+    if (transfer->status == USB_TRANSFER_STATUS_COMPLETED && transfer->actual_num_bytes > 0) {
+        intr_report_t report;
+        report.length = (transfer->actual_num_bytes < INTR_TRANSFER_SIZE) ? transfer->actual_num_bytes : INTR_TRANSFER_SIZE;
+        memcpy(report.data, transfer->data_buffer, report.length);
+        if (xQueueSend(intr_queue, &report, 0) != pdTRUE) {
+            intr_dropped++;
         }
+        notify_worker(NOTIFY_REPORT);
     }
 
-    // Prepare USB transfer
-    usb_transfer_t *transfer;
-    esp_err_t err = usb_host_transfer_alloc(buffer_size, 0, &transfer);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to allocate transfer: %s", esp_err_to_name(err));
-        xSemaphoreGive(transfer_mutex);
-        return err;
+    // Re-arm at once unless the device is gone or the endpoint stalled
+    bool rearm = __atomic_load_n(&intr_running, __ATOMIC_ACQUIRE) &&
+                 transfer->status != USB_TRANSFER_STATUS_NO_DEVICE &&
+                 transfer->status != USB_TRANSFER_STATUS_CANCELED &&
+                 transfer->status != USB_TRANSFER_STATUS_STALL;
+    if (rearm && usb_host_transfer_submit(transfer) == ESP_OK) {
+        usb_trace_submit(transfer);
+        return;
     }
+    interrupt_transfer_returned(transfer);
+}
 
-    // Setup interrupt IN transfer
-    transfer->device_handle = ups_device;
-    transfer->bEndpointAddress = HID_INTERRUPT_IN_EP;
-    transfer->callback = transfer_callback;
-    transfer->context = NULL;
-    transfer->num_bytes = buffer_size;
-    transfer->timeout_ms = 1000;
+// Submit every pooled interrupt transfer not already in flight
+static void interrupt_pipeline_arm(usb_device_handle_t dev)
+{
+    for (int i = 0; i < INTR_TRANSFERS; i++) {
+        usb_transfer_t *transfer = intr_transfers[i];
+        if (transfer == NULL || __atomic_load_n(&intr_armed[i], __ATOMIC_ACQUIRE)) {
+            continue;  // Pool allocation failed (logged there), or armed
+        }
+        transfer->device_handle = dev;
+        transfer->bEndpointAddress = HID_INTERRUPT_IN_EP;
+        transfer->callback = interrupt_in_callback;
+        transfer->context = (void *)(intptr_t)i;
+        transfer->num_bytes = INTR_TRANSFER_SIZE;
+
+        // Counted before submitting: the completion may run at once
+        __atomic_store_n(&intr_armed[i], true, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&intr_in_flight, 1, __ATOMIC_ACQ_REL);
+        usb_trace_submit(transfer);
+        esp_err_t err = usb_host_transfer_submit(transfer);
+        if (err != ESP_OK) {
+            __atomic_sub_fetch(&intr_in_flight, 1, __ATOMIC_ACQ_REL);
+            __atomic_store_n(&intr_armed[i], false, __ATOMIC_RELEASE);
+            ESP_LOGE(TAG, "Failed to submit interrupt transfer %d: %s", i, esp_err_to_name(err));
+        }
+    }
+}
+
+static void interrupt_pipeline_start(usb_device_handle_t dev)
+{
+    if (dev == NULL) {
+        return;
+    }
+    if (intr_queue == NULL) {
+        intr_queue = xQueueCreate(INTR_QUEUE_LEN, sizeof(intr_report_t));
+        if (intr_queue == NULL) {
+            ESP_LOGE(TAG, "Failed to create interrupt report queue");
+            return;
+        }
+    }
 
-    // Submit transfer
-    err = usb_host_transfer_submit(transfer);
+    __atomic_store_n(&intr_stalled, false, __ATOMIC_RELEASE);
+    intr_rearm_us = 0;
+    intr_rearm_ms = INTR_REARM_MIN_MS;
+    __atomic_store_n(&intr_running, true, __ATOMIC_RELEASE);
+    interrupt_pipeline_arm(dev);
+    ESP_LOGI(TAG, "📥 Interrupt IN pipeline armed: %d transfers on 0x%02X",
+             __atomic_load_n(&intr_in_flight, __ATOMIC_ACQUIRE), HID_INTERRUPT_IN_EP);
+}
+
+// Halt and flush 0x81 on our side (returning any transfer still queued, as
+// CANCELED), clear it, then CLEAR_FEATURE(ENDPOINT_HALT) so the UPS resets
+// its data toggle and sends again (USB 2.0 §9.4.1)
+static void interrupt_endpoint_clear_stall(usb_device_handle_t dev)
+{
+    esp_err_t err = usb_host_endpoint_halt(dev, HID_INTERRUPT_IN_EP);
+    if (err == ESP_OK) {
+        err = usb_host_endpoint_flush(dev, HID_INTERRUPT_IN_EP);
+    }
+    if (err == ESP_OK) {
+        err = usb_host_endpoint_clear(dev, HID_INTERRUPT_IN_EP);
+    }
+    if (err == ESP_OK) {
+        // Standard, endpoint recipient; no data stage either way
+        size_t actual = 0;
+        err = control_transfer_in(0x02, 0x01, 0x0000, HID_INTERRUPT_IN_EP, NULL, 0, &actual);
+    }
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to submit transfer: %s", esp_err_to_name(err));
-        usb_host_transfer_free(transfer);
-        xSemaphoreGive(transfer_mutex);
-        return err;
+        ESP_LOGW(TAG, "⚠️ Clearing the stall on 0x%02X failed: %s", HID_INTERRUPT_IN_EP, esp_err_to_name(err));
+        return;
     }
+    intr_stalls++;
+    ESP_LOGI(TAG, "✅ Interrupt endpoint 0x%02X stall cleared", HID_INTERRUPT_IN_EP);
+}
 
-    // Wait for transfer to complete while processing USB events
-    // The callback can ONLY fire when usb_host_client_handle_events() is called
-    // So we must poll events while waiting, not just block on semaphore
-    ESP_LOGD(TAG, "⏳ Waiting for transfer completion (endpoint 0x%02X)...", HID_INTERRUPT_IN_EP);
+// Keeps INTR_TRANSFERS in flight while the UPS is attached: a transfer that
+// came back stalled or could not be resubmitted is re-armed here, after the
+// stall is cleared
+static void interrupt_pipeline_service(usb_device_handle_t dev, int64_t now_us)
+{
+    if (dev == NULL || !__atomic_load_n(&intr_running, __ATOMIC_ACQUIRE) ||
+        __atomic_load_n(&intr_in_flight, __ATOMIC_ACQUIRE) >= INTR_TRANSFERS || now_us < intr_rearm_us) {
+        return;
+    }
+    if (__atomic_exchange_n(&intr_stalled, false, __ATOMIC_ACQ_REL)) {
+        interrupt_endpoint_clear_stall(dev);
+    }
+    interrupt_pipeline_arm(dev);
 
-    // Poll for up to 2000ms (transfer timeout is 1000ms + extra margin for slow callbacks)
-    const int max_wait_ms = 2000;
-    const int poll_interval_ms = 10;
-    int waited_ms = 0;
-    bool transfer_complete = false;
+    if (__atomic_load_n(&intr_in_flight, __ATOMIC_ACQUIRE) > 0) {
+        intr_rearm_ms = INTR_REARM_MIN_MS;
+    } else if (intr_rearm_ms < INTR_REARM_MAX_MS) {
+        intr_rearm_ms *= 2;
+    }
+    intr_rearm_us = now_us + intr_rearm_ms * 1000LL;
+    ESP_LOGI(TAG, "📥 Interrupt IN pipeline re-armed: %d transfers on 0x%02X",
+             __atomic_load_n(&intr_in_flight, __ATOMIC_ACQUIRE), HID_INTERRUPT_IN_EP);
+}
 
-    while (waited_ms < max_wait_ms && !transfer_complete) {
-        // Process USB client events - this is where callbacks fire!
-        usb_host_client_handle_events(usb_client, pdMS_TO_TICKS(poll_interval_ms));
+// Once the UPS is gone and every transfer has come back, free the pool,
+// release the interface and close the handle usb_host_device_open() gave us.
+// Runs whether or not the pipeline was ever started.
+static void device_reap(void)
+{
+    if (claimed_device == NULL || ups_device != NULL || __atomic_load_n(&intr_running, __ATOMIC_ACQUIRE) ||
+        __atomic_load_n(&intr_in_flight, __ATOMIC_ACQUIRE) > 0 || !control_pool_idle()) {
+        return;
+    }
+    transfer_pool_release();
+    if (interface_claimed) {
+        usb_host_interface_release(usb_client, claimed_device, HID_INTERFACE);
+        interface_claimed = false;
+    }
+    usb_host_device_close(usb_client, claimed_device);
+    claimed_device = NULL;
+    ESP_LOGI(TAG, "📥 UPS released");
+    device_reset_finish();
+}
 
-        // Check if semaphore was signaled (non-blocking check)
-        if (xSemaphoreTake(transfer_done, 0) == pdTRUE) {
-            transfer_complete = true;
-            break;
+// Decode every queued interrupt report (each is its own snapshot)
+static void drain_interrupt_reports(void)
+{
+    intr_report_t report;
+    while (intr_queue != NULL && xQueueReceive(intr_queue, &report, 0) == pdTRUE) {
+        ESP_LOGD(TAG, "📥 HID Report ID: 0x%02X, Length: %d", report.data[0], report.length);
+        apc_hid_parse_report(ups_parser, report.data[0], report.data, report.length);
+    }
+}
+
+static bool interrupt_reports_waiting(void)
+{
+    return intr_queue != NULL && uxQueueMessagesWaiting(intr_queue) > 0;
+}
+
+//══════════════════════════════════════════════════════════════════════════════
+// DEVICE LIFECYCLE (usb_host_task() only)
+//══════════════════════════════════════════════════════════════════════════════
+// The client callback only queues new addresses and records removals. Every
+// handle usb_host_device_open() returns is closed here or in device_reap(),
+// whatever stage the device was removed at.
+
+// Removal seen by the client callback for the handle we hold
+static bool ups_removed(void)
+{
+    return claimed_device != NULL && __atomic_load_n(&gone_device, __ATOMIC_ACQUIRE) == claimed_device;
+}
+
+// Stop using the UPS and put the parser back on the default table; its
+// transfers are released and the handle closed by device_reap()
+static void device_detach(void)
+{
+    __atomic_store_n(&intr_running, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&ups_connected, false, __ATOMIC_RELEASE);
+    ups_device = NULL;
+    apc_hid_parser_use_default_table(ups_parser);
+    ESP_LOGI(TAG, "❌ APC UPS disconnected");
+}
+
+// Length of the report descriptor from the HID descriptor of the interface,
+// 0 if not found. Also logs the interface's endpoints.
+static uint16_t report_descriptor_length(usb_device_handle_t dev_hdl)
+{
+    const usb_config_desc_t *config_desc;
+    if (usb_host_get_active_config_descriptor(dev_hdl, &config_desc) != ESP_OK) {
+        return 0;
+    }
+    ESP_LOGI(TAG, "📋 Config: %d interfaces", config_desc->bNumInterfaces);
+
+    int offset = 0;
+    const usb_intf_desc_t *intf = usb_parse_interface_descriptor(config_desc, HID_INTERFACE, 0, &offset);
+    if (intf == NULL) {
+        return 0;
+    }
+    ESP_LOGI(TAG, "  Interface %d: class=0x%02X, endpoints=%d",
+             HID_INTERFACE, intf->bInterfaceClass, intf->bNumEndpoints);
+
+    int ep_offset = offset;
+    for (int e = 0; e < intf->bNumEndpoints; e++) {
+        const usb_ep_desc_t *ep = usb_parse_endpoint_descriptor_by_index(intf, e, config_desc->wTotalLength, &ep_offset);
+        if (ep) {
+            ESP_LOGI(TAG, "    Endpoint 0x%02X: type=%d, maxPacket=%d",
+                     ep->bEndpointAddress,
+                     ep->bmAttributes & 0x03,
+                     ep->wMaxPacketSize);
         }
+    }
 
-        waited_ms += poll_interval_ms;
+    // HID descriptor follows the interface descriptor and gives the length
+    // of the report descriptor
+    int hid_offset = offset;
+    const uint8_t *hid = (const uint8_t *)usb_parse_next_descriptor_of_type(
+        (const usb_standard_desc_t *)intf, config_desc->wTotalLength, HID_DESC_TYPE_HID, &hid_offset);
+    if (hid && hid[0] >= 9 && hid[6] == HID_DESC_TYPE_REPORT) {
+        uint16_t length = hid[7] | (hid[8] << 8);
+        ESP_LOGI(TAG, "  HID report descriptor: %d bytes", length);
+        return length;
     }
+    return 0;
+}
 
-    if (transfer_complete) {
-        ESP_LOGD(TAG, "🔔 Transfer callback fired, status=%d (after %dms)", transfer->status, waited_ms);
+// Open a newly enumerated device. An APC UPS is claimed, its profile and
+// report descriptor loaded and its reports scheduled; anything else is
+// closed again.
+static void device_attach(uint8_t address)
+{
+    usb_device_handle_t dev_hdl;
+    __atomic_store_n(&gone_device, NULL, __ATOMIC_RELEASE);
+    esp_err_t err = usb_host_device_open(usb_client, address, &dev_hdl);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open device: %s", esp_err_to_name(err));
+        return;
+    }
 
-        // Copy data and get actual length
-        if (transfer->status == USB_TRANSFER_STATUS_COMPLETED) {
-            *actual_length = transfer->actual_num_bytes;
-            memcpy(buffer, transfer->data_buffer, transfer->actual_num_bytes);
+    const usb_device_desc_t *dev_desc;
+    err = usb_host_get_device_descriptor(dev_hdl, &dev_desc);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to get device descriptor: %s", esp_err_to_name(err));
+        usb_host_device_close(usb_client, dev_hdl);
+        return;
+    }
 
-            if (*actual_length > 0) {
-                ESP_LOGI(TAG, "✅ HID report received: %d bytes", *actual_length);
-                ESP_LOG_BUFFER_HEX_LEVEL(TAG, buffer, (*actual_length < 16) ? *actual_length : 16, ESP_LOG_INFO);
-            }
-            err = ESP_OK;
-        } else if (transfer->status == USB_TRANSFER_STATUS_TIMED_OUT) {
-            ESP_LOGD(TAG, "⏱️  Transfer timed out (USB level) - device not sending data");
-            err = ESP_ERR_TIMEOUT;
-        } else if (transfer->status == USB_TRANSFER_STATUS_STALL) {
-            ESP_LOGW(TAG, "⚠️  Transfer stalled - endpoint may not be ready");
-            err = ESP_FAIL;
-        } else if (transfer->status == USB_TRANSFER_STATUS_ERROR) {
-            ESP_LOGW(TAG, "❌ Transfer error");
-            err = ESP_FAIL;
-        } else if (transfer->status == USB_TRANSFER_STATUS_NO_DEVICE) {
-            ESP_LOGW(TAG, "❌ Device disconnected");
-            err = ESP_FAIL;
-        } else {
-            ESP_LOGW(TAG, "❌ Transfer failed with unknown status: %d", transfer->status);
-            err = ESP_FAIL;
+    ESP_LOGI(TAG, "DEBUG: Device VID:PID = %04X:%04X", dev_desc->idVendor, dev_desc->idProduct);
+
+    if (!IS_APC_UPS(dev_desc->idVendor, dev_desc->idProduct)) {
+        ESP_LOGI(TAG, "⚠️ Not an APC UPS (VID:PID = %04X:%04X), expected VID=%04X",
+                 dev_desc->idVendor, dev_desc->idProduct, APC_VID);
+        usb_host_device_close(usb_client, dev_hdl);
+        return;
+    }
+    if (claimed_device != NULL) {
+        ESP_LOGW(TAG, "⚠️ A UPS is already attached, addr=%d ignored", address);
+        usb_host_device_close(usb_client, dev_hdl);
+        return;
+    }
+
+    ESP_LOGI(TAG, "🔌 APC UPS found! VID:PID = %04X:%04X", dev_desc->idVendor, dev_desc->idProduct);
+    uint16_t pid = dev_desc->idProduct;
+    uint16_t bcd_device = dev_desc->bcdDevice;
+
+    // Claim HID interface FIRST (before inspecting)
+    err = usb_host_interface_claim(usb_client, dev_hdl, HID_INTERFACE, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to claim interface: %s", esp_err_to_name(err));
+        usb_host_device_close(usb_client, dev_hdl);
+        return;
+    }
+    ESP_LOGI(TAG, "✅ HID interface claimed successfully");
+    claimed_device = dev_hdl;
+    interface_claimed = true;
+
+    uint16_t desc_length = report_descriptor_length(dev_hdl);
+
+    // Pick the model's decoder profile once; the descriptor refines it
+    apc_hid_parser_select_profile(ups_parser, apc_hid_profile_for_pid(pid));
+    transfer_pool_create();
+    ups_device = dev_hdl;
+    __atomic_store_n(&ups_connected, true, __ATOMIC_RELEASE);
+    load_report_descriptor(desc_length);
+
+    // The UPS may have gone while we waited for its descriptor
+    if (ups_removed()) {
+        device_detach();
+        return;
+    }
+    report_scheduler_build(ups_parser, APC_VID, pid, bcd_device, esp_timer_get_time());
+    interrupt_pipeline_start(ups_device);
+}
+
+// A removed UPS first, then its release, then new devices (a UPS plugged
+// back in waits until the old handle is closed)
+static void device_events(void)
+{
+    if (ups_device != NULL && ups_removed()) {
+        device_detach();
+    }
+    device_reap();
+
+    uint8_t address;
+    while ((claimed_device == NULL || ups_device != NULL) &&
+           xQueueReceive(new_dev_queue, &address, 0) == pdTRUE) {
+        device_attach(address);
+    }
+}
+
+static bool device_events_waiting(void)
+{
+    if (ups_device != NULL && ups_removed()) {
+        return true;
+    }
+    return (claimed_device == NULL || ups_device != NULL) && uxQueueMessagesWaiting(new_dev_queue) > 0;
+}
+
+//══════════════════════════════════════════════════════════════════════════════
+// EVENT TASKS: LIBRARY DAEMON AND CLIENT
+//══════════════════════════════════════════════════════════════════════════════
+#define USB_LIB_TASK_STACK       3072
+#define USB_LIB_TASK_PRIORITY    6
+#define USB_CLIENT_TASK_STACK    4096
+#define USB_CLIENT_TASK_PRIORITY 6
+
+// Library events: enumeration and the hardware side of every transfer
+static void usb_lib_task(void *arg)
+{
+    ESP_LOGI(TAG, "📡 USB library task started");
+    while (1) {
+        uint32_t event_flags = 0;
+        esp_err_t err = usb_host_lib_handle_events(portMAX_DELAY, &event_flags);
+        if (err != ESP_OK && err != ESP_ERR_TIMEOUT) {
+            ESP_LOGW(TAG, "⚠️ USB lib event error: %s", esp_err_to_name(err));
+        }
+        if (event_flags & USB_HOST_LIB_EVENT_FLAGS_NO_CLIENTS) {
+            ESP_LOGW(TAG, "⚠️ No USB clients registered");
         }
+        if (event_flags & USB_HOST_LIB_EVENT_FLAGS_ALL_FREE) {
+            ESP_LOGI(TAG, "DEBUG: All devices freed");
+        }
+    }
+}
 
-        // CRITICAL: Only free after callback has fired
-        usb_host_transfer_free(transfer);
-    } else {
-        // Timeout waiting for callback - this should be very rare
-        // Continue waiting until callback fires to avoid memory corruption
-        ESP_LOGW(TAG, "⚠️  App-level timeout (%dms), continuing to wait for USB callback...", max_wait_ms);
-
-        // Keep processing events until callback fires (with no time limit)
-        while (!transfer_complete) {
-            usb_host_client_handle_events(usb_client, pdMS_TO_TICKS(poll_interval_ms));
-            if (xSemaphoreTake(transfer_done, 0) == pdTRUE) {
-                transfer_complete = true;
-                ESP_LOGW(TAG, "✅ Late callback received, freeing transfer");
-                usb_host_transfer_free(transfer);
-                break;
+// Client events: runs usb_host_client_event_cb() and every transfer callback
+static void usb_client_task(void *arg)
+{
+    ESP_LOGI(TAG, "📡 USB client task started");
+    int error_count = 0;
+    const int MAX_ERRORS = 10;
+
+    while (1) {
+        esp_err_t err = usb_host_client_handle_events(usb_client, portMAX_DELAY);
+
+        if (err != ESP_OK && err != ESP_ERR_TIMEOUT) {
+            error_count++;
+            ESP_LOGW(TAG, "⚠️ USB client event error (%d/%d): %s",
+                     error_count, MAX_ERRORS, esp_err_to_name(err));
+
+            if (error_count >= MAX_ERRORS) {
+                ESP_LOGE(TAG, "❌ USB Host failed too many times, disabling USB host");
+                ESP_LOGE(TAG, "💡 Hint: This board may not support USB OTG on external pins");
+                ESP_LOGE(TAG, "📝 Using simulated UPS data only");
+                vTaskDelete(NULL);  // Kill this task
+                return;
             }
-            vTaskDelay(pdMS_TO_TICKS(poll_interval_ms));
+
+            vTaskDelay(pdMS_TO_TICKS(1000));  // Back off on errors
+        } else if (err == ESP_OK) {
+            error_count = 0;  // Reset error count on success
         }
-        err = ESP_ERR_TIMEOUT;
     }
-
-    // Release mutex
-    xSemaphoreGive(transfer_mutex);
-    return err;
 }
 
-esp_err_t usb_host_init(void)
+esp_err_t usb_host_init(apc_hid_parser_t *parser)
 {
+    ups_parser = parser;
     ESP_LOGI(TAG, "DEBUG: usb_host_init() called");
     ESP_LOGI(TAG, "🚀 Initializing USB Host for APC UPS");
     ESP_LOGW(TAG, "⚠️ Note: Many ESP32-S3 dev boards don't expose USB OTG pins");
@@ -547,6 +1056,12 @@ esp_err_t usb_host_init(void)
         return ESP_FAIL;
     }
 
+    new_dev_queue = xQueueCreate(NEW_DEV_QUEUE_LEN, sizeof(uint8_t));
+    if (new_dev_queue == NULL) {
+        ESP_LOGE(TAG, "❌ Failed to create device event queue");
+        return ESP_FAIL;
+    }
+
     // Install USB Host library
     ESP_LOGI(TAG, "DEBUG: Installing USB Host library");
     const usb_host_config_t host_config = {
@@ -563,6 +1078,12 @@ esp_err_t usb_host_init(void)
         return ret;
     }
 
+    if (xTaskCreate(usb_lib_task, "usb_lib", USB_LIB_TASK_STACK, NULL, USB_LIB_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "❌ Failed to create USB library task");
+        usb_host_uninstall();
+        return ESP_ERR_NO_MEM;
+    }
+
     // Register USB host client
     const usb_host_client_config_t client_config = {
         .is_synchronous = false,
@@ -581,6 +1102,11 @@ esp_err_t usb_host_init(void)
         return ret;
     }
 
+    if (xTaskCreate(usb_client_task, "usb_client", USB_CLIENT_TASK_STACK, NULL, USB_CLIENT_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "❌ Failed to create USB client task");
+        return ESP_ERR_NO_MEM;
+    }
+
     ESP_LOGI(TAG, "✅ USB Host initialized successfully");
     ESP_LOGI(TAG, "🔍 Waiting for APC UPS (VID=%04X, PID=%04X or %04X)", APC_VID, APC_PID_BACKUPS, APC_PID_SMARTUPS);
 
@@ -590,138 +1116,124 @@ esp_err_t usb_host_init(void)
 void usb_host_task(void *arg)
 {
     ESP_LOGI(TAG, "📡 USB Host task started");
-    ESP_LOGI(TAG, "DEBUG: Polling for USB events every 100ms");
+    __atomic_store_n(&usb_worker, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
 
     uint8_t report_buffer[64];
     size_t report_len;
-    int error_count = 0;
-    const int MAX_ERRORS = 10;
+    esp_err_t err;
     int loop_count = 0;
     int poll_cycle = 0;
-
-    // Report IDs to actively poll (verified from NUT explore output)
-    // These are Feature Reports that MUST be polled, NOT sent via interrupt
-    // Organized by category for clarity
-    const uint8_t poll_reports[] = {
-        // === CRITICAL REAL-TIME METRICS (poll every cycle) ===
-        0x09,  // Battery voltage (UPS.PowerSummary.Voltage) - 16-bit, /100 for V
-        0x31,  // Input voltage (UPS.Input.Voltage) - 16-bit
-        0x50,  // Load percentage (UPS.PowerConverter.PercentLoad) - 8-bit
-
-        // === BATTERY INFORMATION ===
-        0x08,  // Battery nominal voltage (UPS.PowerSummary.ConfigVoltage) - 16-bit (12V)
-        0x0E,  // Full charge capacity (100% - not used, just logged)
-        0x0F,  // Battery charge warning threshold (50%)
-        0x11,  // Battery charge low threshold (UPS.PowerSummary.RemainingCapacityLimit = 10%)
-        0x24,  // Battery runtime low threshold (UPS.Battery.RemainingTimeLimit = 120s)
-        0x17,  // Reboot timer (120s)
-        0x03,  // Battery chemistry type (reports code 4 = NiMH)
-        0x07,  // UPS manufacture date (days since reference = 21690)
-        0x20,  // Battery manufacture date (days since reference = 21690)
-
-        // === INPUT POWER CONFIGURATION ===
-        0x30,  // Input nominal voltage (UPS.Input.ConfigVoltage) - 8-bit (120V)
-        0x32,  // Low voltage transfer point (88V)
-        0x33,  // High voltage transfer point (139V)
-        0x34,  // Input sensitivity adjustment
-        0x35,  // Input sensitivity (low/medium/high)
-        0x36,  // Input frequency (50/60Hz)
-
-        // === UPS CONFIGURATION ===
-        0x52,  // Real power nominal (600W)
-        0x15,  // Shutdown timer (-1 = not active)
-        0x10,  // Beeper status (enabled/disabled/muted)
-        0x18,  // Self-test result
-    };
-    const int num_poll_reports = sizeof(poll_reports) / sizeof(poll_reports[0]);
+    int64_t next_alive_us = 0;
 
     while (1) {
         loop_count++;
 
-        // Log every 50 loops (5 seconds) to show task is alive
-        if (loop_count % 50 == 0) {
-            ESP_LOGI(TAG, "DEBUG: USB task alive, loop %d, UPS connected: %d", loop_count, ups_connected);
-        }
-
-        // CRITICAL: Handle USB host LIBRARY events first (device connection/disconnection)
-        uint32_t event_flags;
-        esp_err_t err = usb_host_lib_handle_events(pdMS_TO_TICKS(10), &event_flags);
-        if (err != ESP_OK && err != ESP_ERR_TIMEOUT) {
-            ESP_LOGW(TAG, "⚠️ USB lib event error: %s", esp_err_to_name(err));
-        }
-        if (event_flags & USB_HOST_LIB_EVENT_FLAGS_NO_CLIENTS) {
-            ESP_LOGW(TAG, "⚠️ No USB clients registered");
-        }
-        if (event_flags & USB_HOST_LIB_EVENT_FLAGS_ALL_FREE) {
-            ESP_LOGI(TAG, "DEBUG: All devices freed");
+        // Log every 5 seconds to show task is alive
+        if (esp_timer_get_time() >= next_alive_us) {
+            next_alive_us = esp_timer_get_time() + ALIVE_LOG_US;
+            ESP_LOGI(TAG, "DEBUG: USB task alive, loop %d, UPS connected: %d, interrupt reports dropped: %lu, "
+                     "DMA heap free %u, largest %u", loop_count, ups_connected, (unsigned long)intr_dropped,
+                     (unsigned)heap_caps_get_free_size(MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL),
+                     (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL));
         }
 
-        // Handle USB host CLIENT events (our callback)
-        err = usb_host_client_handle_events(usb_client, pdMS_TO_TICKS(10));
-
-        if (err != ESP_OK && err != ESP_ERR_TIMEOUT) {
-            error_count++;
-            ESP_LOGW(TAG, "⚠️ USB client event error (%d/%d): %s",
-                     error_count, MAX_ERRORS, esp_err_to_name(err));
-
-            if (error_count >= MAX_ERRORS) {
-                ESP_LOGE(TAG, "❌ USB Host failed too many times, disabling USB host");
-                ESP_LOGE(TAG, "💡 Hint: This board may not support USB OTG on external pins");
-                ESP_LOGE(TAG, "📝 Using simulated UPS data only");
-                vTaskDelete(NULL);  // Kill this task
-                return;
-            }
-
-            vTaskDelay(pdMS_TO_TICKS(1000));  // Back off on errors
-            continue;
-        } else if (err == ESP_OK) {
-            error_count = 0;  // Reset error count on success
-            ESP_LOGI(TAG, "DEBUG: USB client event received (not timeout)");
-        }
+        device_events();
 
         // If UPS is connected, try to read HID reports
         if (ups_connected && ups_device != NULL) {
-            // Passive: Read interrupt transfers (UPS sends automatically)
-            err = read_hid_report(report_buffer, sizeof(report_buffer), &report_len);
-
-            if (err == ESP_OK && report_len > 0) {
-                // First byte is usually the report ID
-                uint8_t report_id = report_buffer[0];
-
-                ESP_LOGD(TAG, "📥 HID Report ID: 0x%02X, Length: %d", report_id, report_len);
-
-                // Parse the report
-                apc_hid_parse_report(report_id, report_buffer, report_len, NULL);
+            // Passive: reports the UPS pushed (first byte is the report ID)
+            drain_interrupt_reports();
+            interrupt_pipeline_service(ups_device, esp_timer_get_time());
+
+            // Power-quality burst: input voltage between poll cycles, at most
+            // one report per loop (see power_quality.c for the limits)
+            if (power_quality_burst_due(esp_timer_get_time())) {
+                int voltage_report = apc_hid_parser_poll_report_for(ups_parser, APC_FIELD_INPUT_VOLTAGE);
+                if (voltage_report >= 0 && !report_scheduler_skipped((uint8_t)voltage_report)) {
+                    err = get_hid_report((uint8_t)voltage_report, report_buffer, sizeof(report_buffer), &report_len);
+                    report_scheduler_read_result((uint8_t)voltage_report, err, esp_timer_get_time());
+                    if (err == ESP_OK && report_len > 0) {
+                        apc_hid_parse_report(ups_parser, (uint8_t)voltage_report, report_buffer, report_len);
+                        report_scheduler_mark_read((uint8_t)voltage_report, esp_timer_get_time());
+                    }
+                }
             }
 
             // RE-ENABLED: Using correct Feature Report IDs from NUT exploration
-            // Poll on first loop and then every 20 loops (~40 seconds)
-            if (loop_count == 1 || loop_count % 20 == 0) {
-                ESP_LOGI(TAG, "🔄 Active polling cycle %d: Requesting %d reports...", poll_cycle++, num_poll_reports);
-
+            // Feature reports come from the model profile, limited to IDs the
+            // usage table decodes; each is read on its own schedule (live
+            // values every poll interval, static ones hourly)
+            uint8_t poll_reports[REPORT_SCHEDULER_MAX_SWEEP];
+            int num_poll_reports = report_scheduler_due(esp_timer_get_time(), poll_reports, REPORT_SCHEDULER_MAX_SWEEP);
+            if (num_poll_reports > 0) {
+                ESP_LOGD(TAG, "🔄 Active polling cycle %d: Requesting %d reports...", poll_cycle++, num_poll_reports);
+
+                // The whole sweep reaches readers as one snapshot
+                apc_hid_batch_begin(ups_parser);
                 for (int i = 0; i < num_poll_reports; i++) {
                     uint8_t report_id = poll_reports[i];
                     err = get_hid_report(report_id, report_buffer, sizeof(report_buffer), &report_len);
+                    report_scheduler_read_result(report_id, err, esp_timer_get_time());
 
                     if (err == ESP_OK && report_len > 0) {
                         // Parse the polled report
-                        apc_hid_parse_report(report_id, report_buffer, report_len, NULL);
+                        apc_hid_batch_apply(ups_parser, report_id, report_buffer, report_len);
+                    }
+
+                    // A pushed report (e.g. on battery) is not held until the
+                    // sweep ends: publish what we have, decode it, go on
+                    if (interrupt_reports_waiting()) {
+                        apc_hid_batch_commit(ups_parser);
+                        drain_interrupt_reports();
+                        apc_hid_batch_begin(ups_parser);
                     }
 
                     // Small delay between polls to avoid overwhelming UPS
                     vTaskDelay(pdMS_TO_TICKS(20));
                 }
+                apc_hid_batch_commit(ups_parser);
 
-                ESP_LOGI(TAG, "✅ Polling cycle %d complete", poll_cycle - 1);
+                apc_hid_cache_stats_t cache;
+                apc_hid_get_cache_stats(ups_parser, &cache);
+                ESP_LOGD(TAG, "✅ Polling cycle %d complete (unchanged reports: %lu hits, %lu misses)",
+                         poll_cycle - 1, (unsigned long)cache.hits, (unsigned long)cache.misses);
             }
         }
 
-        // Small delay
-        vTaskDelay(pdMS_TO_TICKS(100));
+        device_reap();
+
+        // Sleep until a report or device event arrives, the next sweep is
+        // due or (with a UPS attached) a burst poll may be
+        if (!interrupt_reports_waiting() && !device_events_waiting()) {
+            int64_t wait_us = next_alive_us - esp_timer_get_time();
+            if (ups_connected) {
+                int64_t poll_us = report_scheduler_next_due() - esp_timer_get_time();
+                if (poll_us < wait_us) {
+                    wait_us = poll_us;
+                }
+                if (wait_us > WORKER_WAIT_MS * 1000LL) {
+                    wait_us = WORKER_WAIT_MS * 1000LL;
+                }
+            }
+            if (wait_us > 0) {
+                xTaskNotifyWait(0, NOTIFY_REPORT | NOTIFY_DEVICE, NULL, pdMS_TO_TICKS((wait_us + 999) / 1000));
+            }
+        }
     }
 }
 
 bool usb_ups_is_connected(void)
 {
-    return ups_connected;
+    return __atomic_load_n(&ups_connected, __ATOMIC_ACQUIRE);
+}
+
+void usb_host_get_transfer_stats(usb_transfer_stats_t *stats)
+{
+    stats->control = control_submitted;
+    stats->timeouts = control_timeouts;
+    stats->device_faults = device_faults;
+    stats->resets = device_resets;
+    stats->oversize = oversize_allocs;
+    stats->intr_dropped = intr_dropped;
+    stats->intr_stalls = intr_stalls;
 }
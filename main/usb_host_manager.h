@@ -3,9 +3,27 @@
 
 #include <stdbool.h>
 #include "esp_err.h"
+#include "apc_hid_parser.h"
 
-esp_err_t usb_host_init(void);
+// Reports from the UPS are decoded into `parser`
+esp_err_t usb_host_init(apc_hid_parser_t *parser);
 void usb_host_task(void *arg);
 bool usb_ups_is_connected(void);
 
+// USB transfer counters since boot. Transfers come from a pool allocated
+// when the UPS is claimed; a request finding every control transfer held by
+// one that timed out is refused as a device fault, and the UPS is
+// re-enumerated by power-cycling the USB port.
+typedef struct {
+    uint32_t control;                  // Control transfers submitted
+    uint32_t timeouts;                 // Control transfers the UPS did not finish in time
+    uint32_t device_faults;            // Requests refused: every pooled transfer still held by the device
+    uint32_t resets;                   // USB port power cycles after a device fault
+    uint32_t oversize;                 // One-off allocations: requests larger than a pooled transfer, or all without the pool
+    uint32_t intr_dropped;             // Interrupt reports lost to a full queue
+    uint32_t intr_stalls;              // Interrupt endpoint STALLs cleared and re-armed
+} usb_transfer_stats_t;
+
+void usb_host_get_transfer_stats(usb_transfer_stats_t *stats);
+
 #endif // USB_HOST_MANAGER_H
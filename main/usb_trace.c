@@ -0,0 +1,233 @@
+#include "usb_trace.h"
+
+#if CONFIG_USB_TRACE
+
+#include <string.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#define TRACE_DEPTH CONFIG_USB_TRACE_DEPTH
+
+// Writers are the USB task (submissions) and the USB client task
+// (completions, resubmissions), serialized by `lock`. A record is filled in
+// place and only becomes visible to readers once `head` is advanced past it.
+static usb_trace_record_t ring[TRACE_DEPTH];
+static uint32_t head = 0;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Linux errno values, as usbmon reports URB status
+#define URB_EINPROGRESS (-115)
+
+static int32_t urb_status(usb_transfer_status_t status)
+{
+    switch (status) {
+    case USB_TRANSFER_STATUS_COMPLETED: return 0;
+    case USB_TRANSFER_STATUS_TIMED_OUT: return -110;    // ETIMEDOUT
+    case USB_TRANSFER_STATUS_CANCELED:  return -2;      // ENOENT
+    case USB_TRANSFER_STATUS_STALL:     return -32;     // EPIPE
+    case USB_TRANSFER_STATUS_OVERFLOW:  return -75;     // EOVERFLOW
+    case USB_TRANSFER_STATUS_SKIPPED:   return -18;     // EXDEV
+    case USB_TRANSFER_STATUS_NO_DEVICE: return -19;     // ENODEV
+    default:                            return -71;     // EPROTO
+    }
+}
+
+static void record_locked(const usb_transfer_t *transfer, uint8_t event)
+{
+    uint32_t seq = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    usb_trace_record_t *r = &ring[seq % TRACE_DEPTH];
+
+    const uint8_t *data = transfer->data_buffer;
+    int length = (event == 'S') ? transfer->num_bytes : transfer->actual_num_bytes;
+    r->seq = seq;
+    r->urb = (uint32_t)(uintptr_t)transfer;
+    r->time_us = esp_timer_get_time();
+    r->status = (event == 'S') ? URB_EINPROGRESS : urb_status(transfer->status);
+    r->event = event;
+    r->endpoint = transfer->bEndpointAddress;
+    r->has_setup = 0;
+
+    // Control transfers carry the setup packet in front of the data; its
+    // direction bit says which way the data stage goes
+    if ((transfer->bEndpointAddress & 0x7F) == 0) {
+        memcpy(r->setup, data, sizeof(r->setup));
+        r->has_setup = (event == 'S');
+        if (data[0] & 0x80) {
+            r->endpoint |= 0x80;
+        }
+        data += sizeof(r->setup);
+        length = (length > (int)sizeof(r->setup)) ? length - (int)sizeof(r->setup) : 0;
+    }
+    r->length = (uint16_t)length;
+
+    // Data travels with the submission going out and with the completion coming in
+    bool in = (r->endpoint & 0x80) != 0;
+    size_t n = ((event == 'C') == in) ? (size_t)length : 0;
+    if (n > USB_TRACE_DATA_BYTES) {
+        n = USB_TRACE_DATA_BYTES;
+    }
+    memcpy(r->data, data, n);
+    r->captured = (uint8_t)n;
+
+    __atomic_store_n(&head, seq + 1, __ATOMIC_RELEASE);
+}
+
+static void record(const usb_transfer_t *transfer, uint8_t event)
+{
+    portENTER_CRITICAL(&lock);
+    record_locked(transfer, event);
+    portEXIT_CRITICAL(&lock);
+}
+
+void usb_trace_submit(const usb_transfer_t *transfer)
+{
+    record(transfer, 'S');
+}
+
+void usb_trace_complete(const usb_transfer_t *transfer)
+{
+    record(transfer, 'C');
+}
+
+size_t usb_trace_copy(usb_trace_record_t *out, size_t max_records)
+{
+    uint32_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    uint32_t count = (end < TRACE_DEPTH) ? end : TRACE_DEPTH;
+    if (count > max_records) {
+        count = max_records;
+    }
+    uint32_t start = end - count;
+
+    for (uint32_t i = 0; i < count; i++) {
+        out[i] = ring[(start + i) % TRACE_DEPTH];
+    }
+
+    // Drop records the writer may have overwritten while we were copying
+    // (it fills slot `head` before publishing it, hence the extra slot).
+    uint32_t now = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    uint32_t oldest_intact = (now + 1 > TRACE_DEPTH) ? now + 1 - TRACE_DEPTH : 0;
+    size_t skip = (oldest_intact > start) ? oldest_intact - start : 0;
+    if (skip >= count) {
+        return 0;
+    }
+    if (skip > 0) {
+        memmove(out, out + skip, (count - skip) * sizeof(*out));
+    }
+    return count - skip;
+}
+
+//══════════════════════════════════════════════════════════════════════════════
+// PCAPNG EXPORT
+//══════════════════════════════════════════════════════════════════════════════
+// Section Header Block, one Interface Description Block with link type
+// LINKTYPE_USB_LINUX_MMAPPED (220) at microsecond resolution, then one
+// Enhanced Packet Block per record: the 64-byte usbmon header followed by
+// the captured data. Everything is little-endian, like the ESP32.
+
+#define BLOCK_SHB          0x0A0D0D0A
+#define BLOCK_IDB          0x00000001
+#define BLOCK_EPB          0x00000006
+#define BYTE_ORDER_MAGIC   0x1A2B3C4D
+#define LINKTYPE_USB_LINUX_MMAPPED 220
+#define USBMON_HEADER_SIZE 64
+
+// usbmon binary header (linux/Documentation/usb/usbmon.rst, "mmapped" form)
+typedef struct __attribute__((packed)) {
+    uint64_t id;
+    uint8_t type;
+    uint8_t xfer_type;           // 0 iso, 1 interrupt, 2 control, 3 bulk
+    uint8_t epnum;
+    uint8_t devnum;
+    uint16_t busnum;
+    char flag_setup;             // 0 = setup present
+    char flag_data;              // 0 = data present
+    int64_t ts_sec;
+    int32_t ts_usec;
+    int32_t status;
+    uint32_t length;
+    uint32_t len_cap;
+    uint8_t setup[8];
+    int32_t interval;
+    int32_t start_frame;
+    uint32_t xfer_flags;
+    uint32_t ndesc;
+} usbmon_header_t;
+
+_Static_assert(sizeof(usbmon_header_t) == USBMON_HEADER_SIZE, "usbmon header must be 64 bytes");
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+    return p + sizeof(v);
+}
+
+size_t usb_trace_pcapng_header(uint8_t *out)
+{
+    uint8_t *p = out;
+
+    // Section Header Block (28 bytes), section length unknown
+    p = put32(p, BLOCK_SHB);
+    p = put32(p, 28);
+    p = put32(p, BYTE_ORDER_MAGIC);
+    p = put32(p, 1);             // Major 1, minor 0
+    p = put32(p, 0xFFFFFFFF);
+    p = put32(p, 0xFFFFFFFF);
+    p = put32(p, 28);
+
+    // Interface Description Block (20 bytes), default microsecond timestamps
+    p = put32(p, BLOCK_IDB);
+    p = put32(p, 20);
+    p = put32(p, LINKTYPE_USB_LINUX_MMAPPED);
+    p = put32(p, USBMON_HEADER_SIZE + USB_TRACE_DATA_BYTES);  // Snap length
+    p = put32(p, 20);
+
+    return p - out;
+}
+
+size_t usb_trace_pcapng_packet(const usb_trace_record_t *r, int64_t wall_offset_us, uint8_t *out)
+{
+    int64_t time_us = r->time_us + wall_offset_us;
+    uint32_t captured = USBMON_HEADER_SIZE + r->captured;
+    uint32_t padded = (captured + 3) & ~3u;
+    uint32_t block_len = 32 + padded;
+
+    uint8_t *p = out;
+    p = put32(p, BLOCK_EPB);
+    p = put32(p, block_len);
+    p = put32(p, 0);             // Interface 0
+    p = put32(p, (uint32_t)((uint64_t)time_us >> 32));
+    p = put32(p, (uint32_t)time_us);
+    p = put32(p, captured);
+    p = put32(p, captured);
+
+    uint8_t xfer_type = ((r->endpoint & 0x7F) == 0) ? 2 : 1;
+    usbmon_header_t h = {
+        .id = r->urb,
+        .type = r->event,
+        .xfer_type = xfer_type,
+        .epnum = r->endpoint,
+        .devnum = 1,
+        .busnum = 1,
+        .flag_setup = r->has_setup ? 0 : '-',
+        .flag_data = (r->captured > 0) ? 0 : ((r->endpoint & 0x80) ? '<' : '>'),
+        .ts_sec = time_us / 1000000,
+        .ts_usec = (int32_t)(time_us % 1000000),
+        .status = r->status,
+        .length = r->length,
+        .len_cap = r->captured,
+    };
+    if (r->has_setup) {
+        memcpy(h.setup, r->setup, sizeof(h.setup));
+    }
+    memcpy(p, &h, sizeof(h));
+    p += sizeof(h);
+    memcpy(p, r->data, r->captured);
+    p += r->captured;
+    memset(p, 0, padded - captured);
+    p += padded - captured;
+
+    p = put32(p, block_len);
+    return p - out;
+}
+
+#endif // CONFIG_USB_TRACE
@@ -0,0 +1,59 @@
+#ifndef USB_TRACE_H
+#define USB_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "usb/usb_host.h"
+
+//══════════════════════════════════════════════════════════════════════════════
+// USB TRAFFIC RECORDER (Kconfig: USB_TRACE)
+//══════════════════════════════════════════════════════════════════════════════
+// Records the submission and completion of every transfer to the UPS
+// (setup packet, data, status, microsecond time) in a RAM ring. GET
+// /usbtrace exports it as pcapng with usbmon headers, which Wireshark
+// decodes as USB HID. Disabled, the hooks compile to nothing; enabled, each
+// one is a header fill and a memcpy of at most USB_TRACE_DATA_BYTES.
+
+#define USB_TRACE_DATA_BYTES 64
+
+typedef struct {
+    uint32_t seq;
+    uint32_t urb;                // Transfer identity, pairs submit and complete
+    int64_t time_us;             // esp_timer time
+    int32_t status;              // Linux errno style: 0, -EINPROGRESS (submit), -EPIPE...
+    uint16_t length;             // Bytes requested (submit) or transferred (complete)
+    uint8_t captured;            // Bytes in data[]
+    uint8_t event;               // 'S' submit, 'C' complete
+    uint8_t endpoint;            // bEndpointAddress, direction in bit 7
+    uint8_t has_setup;
+    uint8_t reserved[2];
+    uint8_t setup[8];
+    uint8_t data[USB_TRACE_DATA_BYTES];
+} usb_trace_record_t;
+
+#if CONFIG_USB_TRACE
+
+// USB task and USB client task (transfer callbacks)
+void usb_trace_submit(const usb_transfer_t *transfer);
+void usb_trace_complete(const usb_transfer_t *transfer);
+
+// Copy the newest records (oldest first). Returns the number copied.
+size_t usb_trace_copy(usb_trace_record_t *out, size_t max_records);
+
+// pcapng export: the section and interface header, then one packet block
+// per record. `wall_offset_us` turns esp_timer time into Unix time (0 to
+// keep time since boot). Each returns the bytes written to `out`.
+#define USB_TRACE_PCAPNG_HEADER_SIZE 48
+#define USB_TRACE_PCAPNG_PACKET_MAX  (32 + 64 + USB_TRACE_DATA_BYTES)
+size_t usb_trace_pcapng_header(uint8_t *out);
+size_t usb_trace_pcapng_packet(const usb_trace_record_t *record, int64_t wall_offset_us, uint8_t *out);
+
+#else
+
+static inline void usb_trace_submit(const usb_transfer_t *transfer) { }
+static inline void usb_trace_complete(const usb_transfer_t *transfer) { }
+
+#endif // CONFIG_USB_TRACE
+
+#endif // USB_TRACE_H
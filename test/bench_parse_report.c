@@ -0,0 +1,69 @@
+/*
+ * Cost of apc_hid_parse_report() per report
+ *
+ * Built once per trace configuration (see CMakeLists.txt), so the same
+ * loop shows what each HID report trace level and the binary trace add.
+ * Reports alternate between two payloads per ID, so none of them is a
+ * dedupe cache hit and every one is fully decoded.
+ *
+ *   bench_parse_report_<variant> [iterations]
+ */
+
+#include "apc_hid_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#ifndef BENCH_VARIANT
+#define BENCH_VARIANT "none"
+#endif
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : 200000;
+    apc_hid_parser_t *parser = apc_hid_parser_create();
+    if (parser == NULL || iterations <= 0) {
+        return 1;
+    }
+
+    // Interrupt charge/runtime and status, plus the input voltage feature report
+    uint8_t r0c[2][4] = { { 0x0C, 95, 0x74, 0x09 }, { 0x0C, 96, 0x70, 0x09 } };
+    uint8_t r16[2][5] = { { 0x16, 0x0D, 0, 0, 0 }, { 0x16, 0x0D, 1, 0, 0 } };
+    uint8_t r31[2][3] = { { 0x31, 121, 0 }, { 0x31, 122, 0 } };
+
+    uint64_t start_ns = now_ns();
+#if HAVE_TSC
+    uint64_t start_tsc = __rdtsc();
+#endif
+    for (int i = 0; i < iterations; i++) {
+        int k = i & 1;
+        apc_hid_parse_report(parser, 0x0C, r0c[k], sizeof(r0c[k]));
+        apc_hid_parse_report(parser, 0x16, r16[k], sizeof(r16[k]));
+        apc_hid_parse_report(parser, 0x31, r31[k], sizeof(r31[k]));
+    }
+#if HAVE_TSC
+    uint64_t tsc = __rdtsc() - start_tsc;
+#endif
+    uint64_t ns = now_ns() - start_ns;
+
+    double reports = 3.0 * iterations;
+    printf("%-8s %8.1f ns/report", BENCH_VARIANT, ns / reports);
+#if HAVE_TSC
+    printf("  %8.0f TSC cycles/report", tsc / reports);
+#endif
+    printf("\n");
+
+    apc_hid_parser_destroy(parser);
+    return 0;
+}
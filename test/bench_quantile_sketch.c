@@ -0,0 +1,123 @@
+/*
+ * quantile_sketch update cost and accuracy
+ *
+ * Feeds a day of one-second samples per distribution into four 6 h
+ * sketches, as telemetry.c does, merges them and compares p50/p95/p99
+ * against the exact quantiles of the sorted samples. Exits non-zero if
+ * an estimate is off by more than the sketch's 3% bound. Each
+ * distribution stays inside its sketch's eight octaves; beyond them
+ * values are clamped to the last bucket by design.
+ *
+ *   bench_quantile_sketch [repeats]
+ */
+
+#include "quantile_sketch.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SAMPLES_PER_DAY 86400
+#define SKETCHES_PER_DAY 4
+#define MAX_ERROR_PCT 3.0
+
+typedef struct {
+    const char *name;
+    uint8_t min_octave;          // As in telemetry.c
+    double center;               // Mean, or median of a lognormal
+    double sigma;                // Of the value, or of its log
+    bool lognormal;
+} distribution_t;
+
+static const distribution_t distributions[] = {
+    { "input voltage, normal(121.0 V, 2.5 V), 0.1 V units", 9, 1210.0,  25.0, false },
+    { "USB round trip, lognormal(2 ms, 0.6), us",           7, 2000.0,  0.6,  true },
+    { "publish latency, lognormal(10 ms, 0.6), us",         9, 10000.0, 0.6,  true },
+};
+
+static int32_t samples[SAMPLES_PER_DAY];
+static int32_t sorted[SAMPLES_PER_DAY];
+
+// xorshift64*, so every run sees the same samples
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static double uniform(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0) + 1e-12;
+}
+
+static double gaussian(void)
+{
+    return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+static int compare_int32(const void *a, const void *b)
+{
+    int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    int repeats = (argc > 1) ? atoi(argv[1]) : 20;
+    if (repeats <= 0) {
+        return 1;
+    }
+    static const float quantiles[] = { 0.50f, 0.95f, 0.99f };
+    int failures = 0;
+
+    printf("sketch: %zu bytes, %d buckets\n", sizeof(quantile_sketch_t), QUANTILE_SKETCH_BUCKETS);
+
+    for (size_t d = 0; d < sizeof(distributions) / sizeof(distributions[0]); d++) {
+        const distribution_t *dist = &distributions[d];
+        for (int i = 0; i < SAMPLES_PER_DAY; i++) {
+            double z = dist->sigma * gaussian();
+            samples[i] = (int32_t)(dist->lognormal ? dist->center * exp(z) : dist->center + z);
+            sorted[i] = samples[i];
+        }
+        qsort(sorted, SAMPLES_PER_DAY, sizeof(sorted[0]), compare_int32);
+
+        quantile_sketch_t period[SKETCHES_PER_DAY];
+        double start = now_ns();
+        for (int r = 0; r < repeats; r++) {
+            for (int k = 0; k < SKETCHES_PER_DAY; k++) {
+                quantile_sketch_init(&period[k], dist->min_octave);
+            }
+            for (int i = 0; i < SAMPLES_PER_DAY; i++) {
+                quantile_sketch_add(&period[i / (SAMPLES_PER_DAY / SKETCHES_PER_DAY)], samples[i]);
+            }
+        }
+        double add_ns = (now_ns() - start) / ((double)repeats * SAMPLES_PER_DAY);
+
+        quantile_sketch_t day;
+        quantile_sketch_init(&day, dist->min_octave);
+        start = now_ns();
+        for (int k = 0; k < SKETCHES_PER_DAY; k++) {
+            quantile_sketch_merge(&day, &period[k]);
+        }
+        double merge_ns = (now_ns() - start) / SKETCHES_PER_DAY;
+
+        printf("%s\n  add %.1f ns/sample, merge %.0f ns/sketch\n", dist->name, add_ns, merge_ns);
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            int32_t exact = sorted[(int)(quantiles[q] * (SAMPLES_PER_DAY - 1))];
+            int32_t estimate = quantile_sketch_quantile(&day, quantiles[q]);
+            double error_pct = 100.0 * (estimate - exact) / exact;
+            bool ok = fabs(error_pct) <= MAX_ERROR_PCT;
+            printf("  p%02.0f exact %7ld  estimate %7ld  error %+.2f%%%s\n", quantiles[q] * 100,
+                   (long)exact, (long)estimate, error_pct, ok ? "" : "  FAIL");
+            failures += !ok;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
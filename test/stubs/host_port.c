@@ -0,0 +1,36 @@
+// Host build: the few ESP-IDF and FreeRTOS calls the host-built sources make
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    // Format as the device would, so trace costs stay in benchmarks
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    (void)level;
+    (void)tag;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    (void)ticks;
+}
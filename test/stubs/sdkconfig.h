@@ -0,0 +1,16 @@
+// Host build: the Kconfig options the host-built sources read. Any of them
+// can be overridden per target from CMakeLists.txt.
+#pragma once
+
+#ifndef CONFIG_APC_HID_TRACE_LEVEL
+#define CONFIG_APC_HID_TRACE_LEVEL 0
+#endif
+#ifndef CONFIG_APC_HID_BINARY_TRACE
+#define CONFIG_APC_HID_BINARY_TRACE 0
+#endif
+#ifndef CONFIG_APC_HID_BINARY_TRACE_DEPTH
+#define CONFIG_APC_HID_BINARY_TRACE_DEPTH 32
+#endif
+#ifndef CONFIG_APC_HID_GLITCH_FILTER
+#define CONFIG_APC_HID_GLITCH_FILTER 1
+#endif
@@ -0,0 +1,248 @@
+/*
+ * Glitch filter unit tests
+ *
+ * The stages on their own through apc_hid_filter_apply(), then the filter
+ * inside the parser: what gets stored, and what the raw sample hook sees.
+ */
+
+#include "apc_hid_filter.h"
+#include "apc_hid_parser.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);        \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+// One sample through the filter, keeping `stored` as the parser would
+static apc_filter_result_t feed(apc_hid_filter_t *f, apc_field_t field, int32_t sample,
+                                int32_t *stored, bool *have_stored)
+{
+    int32_t value = sample;
+    apc_filter_result_t r = apc_hid_filter_apply(f, field, &value, *stored, *have_stored);
+    if (r != APC_FILTER_HELD) {
+        *stored = value;
+        *have_stored = true;
+    }
+    return r;
+}
+
+static void test_median_window_fill(void)
+{
+    apc_hid_filter_t f;
+    apc_hid_filter_reset(&f);
+    apc_hid_filter_configure(&f, APC_FIELD_OUTPUT_VOLTAGE, &(apc_hid_filter_config_t){ .median = 3 });
+    int32_t stored = 0;
+    bool have = false;
+
+    // A glitch among the first samples must not be stored
+    CHECK(feed(&f, APC_FIELD_OUTPUT_VOLTAGE, 0, &stored, &have) == APC_FILTER_HELD);
+    CHECK(feed(&f, APC_FIELD_OUTPUT_VOLTAGE, 1210, &stored, &have) == APC_FILTER_HELD);
+    CHECK(!have);
+    CHECK(feed(&f, APC_FIELD_OUTPUT_VOLTAGE, 1212, &stored, &have) == APC_FILTER_REPLACED);
+    CHECK(have && stored == 1210);
+}
+
+static void test_median_rejects_glitch(void)
+{
+    apc_hid_filter_t f;
+    apc_hid_filter_reset(&f);
+    apc_hid_filter_configure(&f, APC_FIELD_OUTPUT_VOLTAGE, &(apc_hid_filter_config_t){ .median = 3 });
+    int32_t stored = 0;
+    bool have = false;
+    for (int i = 0; i < 3; i++) {
+        feed(&f, APC_FIELD_OUTPUT_VOLTAGE, 1210, &stored, &have);
+    }
+    CHECK(stored == 1210);
+
+    // A lone 0 V is replaced, a sustained one gets through on its second sample
+    CHECK(feed(&f, APC_FIELD_OUTPUT_VOLTAGE, 0, &stored, &have) == APC_FILTER_REPLACED);
+    CHECK(stored == 1210);
+    CHECK(feed(&f, APC_FIELD_OUTPUT_VOLTAGE, 1210, &stored, &have) == APC_FILTER_PASS);
+    CHECK(feed(&f, APC_FIELD_OUTPUT_VOLTAGE, 1210, &stored, &have) == APC_FILTER_PASS);
+    CHECK(feed(&f, APC_FIELD_OUTPUT_VOLTAGE, 0, &stored, &have) == APC_FILTER_REPLACED);
+    CHECK(feed(&f, APC_FIELD_OUTPUT_VOLTAGE, 0, &stored, &have) == APC_FILTER_PASS);
+    CHECK(stored == 0);
+
+    // Repeats of the stored value from the dedupe cache fill the window too
+    apc_hid_filter_repeat(&f, APC_FIELD_OUTPUT_VOLTAGE, stored);
+    CHECK(feed(&f, APC_FIELD_OUTPUT_VOLTAGE, 1210, &stored, &have) == APC_FILTER_REPLACED);
+    CHECK(stored == 0);
+
+    CHECK(f.stats.smoothed == 3);
+    CHECK(f.stats.field[APC_FIELD_OUTPUT_VOLTAGE] == 3);
+}
+
+static void test_step_hold_confirm(void)
+{
+    apc_hid_filter_t f;
+    apc_hid_filter_reset(&f);
+    apc_hid_filter_configure(&f, APC_FIELD_BATTERY_CHARGE,
+                             &(apc_hid_filter_config_t){ .max_step = 20, .confirm = 2 });
+    int32_t stored = 0;
+    bool have = false;
+
+    // The first sample has nothing to step from
+    CHECK(feed(&f, APC_FIELD_BATTERY_CHARGE, 100, &stored, &have) == APC_FILTER_PASS);
+    CHECK(feed(&f, APC_FIELD_BATTERY_CHARGE, 95, &stored, &have) == APC_FILTER_PASS);
+
+    // A jump is held until a second sample agrees (within max_step) on the new level
+    CHECK(feed(&f, APC_FIELD_BATTERY_CHARGE, 0, &stored, &have) == APC_FILTER_HELD);
+    CHECK(stored == 95);
+    CHECK(feed(&f, APC_FIELD_BATTERY_CHARGE, 95, &stored, &have) == APC_FILTER_PASS);
+    CHECK(feed(&f, APC_FIELD_BATTERY_CHARGE, 40, &stored, &have) == APC_FILTER_HELD);
+    CHECK(feed(&f, APC_FIELD_BATTERY_CHARGE, 42, &stored, &have) == APC_FILTER_PASS);
+    CHECK(stored == 42);
+
+    // Two jumps to different levels don't confirm each other
+    CHECK(feed(&f, APC_FIELD_BATTERY_CHARGE, 100, &stored, &have) == APC_FILTER_HELD);
+    CHECK(feed(&f, APC_FIELD_BATTERY_CHARGE, 0, &stored, &have) == APC_FILTER_HELD);
+    CHECK(stored == 42);
+
+    CHECK(f.stats.step_held == 4);
+}
+
+static void test_enum_confirm(void)
+{
+    apc_hid_filter_t f;
+    apc_hid_filter_reset(&f);
+    apc_hid_filter_configure(&f, APC_FIELD_BEEPER_STATUS, &(apc_hid_filter_config_t){ .confirm = 2 });
+    int32_t stored = 0;
+    bool have = false;
+
+    CHECK(feed(&f, APC_FIELD_BEEPER_STATUS, 2, &stored, &have) == APC_FILTER_PASS);
+    CHECK(feed(&f, APC_FIELD_BEEPER_STATUS, 3, &stored, &have) == APC_FILTER_HELD);
+    CHECK(stored == 2);
+
+    // The stored code in between resets the count
+    CHECK(feed(&f, APC_FIELD_BEEPER_STATUS, 2, &stored, &have) == APC_FILTER_PASS);
+    CHECK(feed(&f, APC_FIELD_BEEPER_STATUS, 3, &stored, &have) == APC_FILTER_HELD);
+    CHECK(feed(&f, APC_FIELD_BEEPER_STATUS, 3, &stored, &have) == APC_FILTER_PASS);
+    CHECK(stored == 3);
+
+    CHECK(f.stats.enum_held == 2);
+}
+
+static void test_configure(void)
+{
+    apc_hid_filter_t f;
+    apc_hid_filter_reset(&f);
+
+    // Build-time defaults are in effect (HID glitch filter on)
+    CHECK(f.config[APC_FIELD_INPUT_VOLTAGE].median == 3);
+    CHECK(f.config[APC_FIELD_BATTERY_CHARGE].max_step == 20);
+
+    apc_hid_filter_configure(&f, APC_FIELD_INPUT_VOLTAGE, &(apc_hid_filter_config_t){ .median = 4 });
+    CHECK(f.config[APC_FIELD_INPUT_VOLTAGE].median == 3);
+    apc_hid_filter_configure(&f, APC_FIELD_INPUT_VOLTAGE, &(apc_hid_filter_config_t){ .median = 9 });
+    CHECK(f.config[APC_FIELD_INPUT_VOLTAGE].median == APC_FILTER_MAX_MEDIAN);
+    apc_hid_filter_configure(&f, APC_FIELD_INPUT_VOLTAGE, NULL);
+    CHECK(f.config[APC_FIELD_INPUT_VOLTAGE].median == 0);
+
+    // Status bits are never filtered
+    apc_hid_filter_configure(&f, APC_FIELD_STATUS, &(apc_hid_filter_config_t){ .confirm = 2 });
+    CHECK(f.config[APC_FIELD_STATUS].confirm == 0);
+}
+
+static int32_t last_raw_voltage = -1;
+
+static void on_raw_sample(apc_field_t field, int32_t value, void *ctx)
+{
+    (void)ctx;
+    if (field == APC_FIELD_INPUT_VOLTAGE) {
+        last_raw_voltage = value;
+    }
+}
+
+static int32_t stored_input_voltage(apc_hid_parser_t *parser, bool *present)
+{
+    static ups_metrics_t snapshot;
+    apc_hid_get_snapshot(parser, &snapshot);
+    *present = apc_hid_field_present(&snapshot, APC_FIELD_INPUT_VOLTAGE);
+    return snapshot.value[APC_FIELD_INPUT_VOLTAGE];
+}
+
+static void test_parser(void)
+{
+    apc_hid_parser_t *parser = apc_hid_parser_create();
+    CHECK(parser != NULL);
+    if (parser == NULL) {
+        return;
+    }
+    apc_hid_parser_set_raw_sample_callback(parser, on_raw_sample, NULL);
+    bool present;
+
+    // Input voltage report 0x31 of the built-in Back-UPS layout, in volts
+    uint8_t glitch[] = { 0x31, 0, 0 };
+    uint8_t normal[] = { 0x31, 121, 0 };
+    uint8_t normal2[] = { 0x31, 122, 0 };
+
+    apc_hid_parse_report(parser, 0x31, glitch, sizeof(glitch));
+    CHECK(last_raw_voltage == 0);
+    stored_input_voltage(parser, &present);
+    CHECK(!present);
+
+    apc_hid_parse_report(parser, 0x31, normal, sizeof(normal));
+    apc_hid_parse_report(parser, 0x31, normal2, sizeof(normal2));
+    int32_t settled = stored_input_voltage(parser, &present);
+    CHECK(present);
+
+    // The raw hook sees a glitch the stored value never shows
+    apc_hid_parse_report(parser, 0x31, glitch, sizeof(glitch));
+    CHECK(last_raw_voltage == 0);
+    CHECK(stored_input_voltage(parser, &present) == settled);
+
+    apc_hid_parser_destroy(parser);
+
+    // A filtered sample drops the cached bytes of its report: 231 after the
+    // replaced 234 is decoded again, not a hit repeating the 233 it stored
+    parser = apc_hid_parser_create();
+    CHECK(parser != NULL);
+    if (parser == NULL) {
+        return;
+    }
+    static const uint8_t volts[] = { 230, 233, 231, 234 };
+    for (size_t i = 0; i < sizeof(volts); i++) {
+        uint8_t report[] = { 0x31, volts[i], 0 };
+        apc_hid_parse_report(parser, 0x31, report, sizeof(report));
+    }
+    CHECK(stored_input_voltage(parser, &present) == 2330);
+    apc_hid_cache_stats_t before, after;
+    apc_hid_get_cache_stats(parser, &before);
+    uint8_t steady[] = { 0x31, 231, 0 };
+    for (int i = 0; i < 3; i++) {
+        apc_hid_parse_report(parser, 0x31, steady, sizeof(steady));
+    }
+    CHECK(stored_input_voltage(parser, &present) == 2310);
+    apc_hid_get_cache_stats(parser, &after);
+    CHECK(after.hits - before.hits < 3);
+
+    apc_hid_parser_destroy(parser);
+}
+
+int main(void)
+{
+    static const struct {
+        const char *name;
+        void (*run)(void);
+    } tests[] = {
+        { "median window fill", test_median_window_fill },
+        { "median rejects glitch", test_median_rejects_glitch },
+        { "step hold and confirm", test_step_hold_confirm },
+        { "enum confirm", test_enum_confirm },
+        { "configure", test_configure },
+        { "parser", test_parser },
+    };
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int before = failures;
+        tests[i].run();
+        printf("%s %s\n", failures == before ? "ok  " : "FAIL", tests[i].name);
+    }
+    return failures == 0 ? 0 : 1;
+}